@@ -29,4 +29,37 @@ uint32_t readEeprom(uint16_t add)
     return EEPROM_EERDWR_R;
 }
 
+/*
+ * Writes size bytes starting at word address add, packed 4 per word
+ * (little endian); words that already hold the value are not rewritten
+ */
+void writeEepromBlock(uint16_t add, uint8_t data[], uint16_t size)
+{
+    uint16_t i;
+    uint32_t word;
+    for (i = 0; i < size; i += 4)
+    {
+        word = data[i];
+        if (i + 1 < size)
+            word |= (uint32_t)data[i+1] << 8;
+        if (i + 2 < size)
+            word |= (uint32_t)data[i+2] << 16;
+        if (i + 3 < size)
+            word |= (uint32_t)data[i+3] << 24;
+        if (readEeprom(add) != word)
+            writeEeprom(add, word);
+        add++;
+    }
+}
 
+void readEepromBlock(uint16_t add, uint8_t data[], uint16_t size)
+{
+    uint16_t i;
+    uint32_t word = 0;
+    for (i = 0; i < size; i++)
+    {
+        if ((i & 3) == 0)
+            word = readEeprom(add++);
+        data[i] = word >> (8 * (i & 3));
+    }
+}
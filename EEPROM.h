@@ -11,9 +11,18 @@
 #include "tm4c123gh6pm.h"
 #include <stdint.h>
 
+// Word addresses of persisted data
+#define EEPROM_MQTT_BROKER_IP   0x0020      // 4 words, one per octet
+#define EEPROM_MQTT_SUBS        0x0040      // subscription set
+#define EEPROM_MQTT_SUBS_WORDS  192
+#define EEPROM_CONFIG           0x0100      // configuration slots, see config.h
+#define EEPROM_CONFIG_WORDS     128
+
 void initEeprom();
 void writeEeprom(uint16_t add, uint32_t eedata);
 uint32_t readEeprom(uint16_t add);
+void writeEepromBlock(uint16_t add, uint8_t data[], uint16_t size);
+void readEepromBlock(uint16_t add, uint8_t data[], uint16_t size);
 
 
 #endif /* EEPROM_H_ */
@@ -10,7 +10,24 @@
 // System Clock:    40 MHz
 
 // Hardware configuration:
-// Timer 4
+// SysTick (1 ms uptime counter)
+
+// Software timers on a hierarchical timing wheel with 1 ms resolution.
+// Level 0 has one slot per millisecond for the next 256 ms; levels 1-3
+// have 64 slots each covering 256 ms, 16.4 s and 17.5 min, so a timer up to
+// 18.6 h ahead is filed in O(1) by the level its delay falls in (longer ones
+// are refiled when their slot comes up). Every 256 ms the next level 1 slot
+// is cascaded down into level 0, and so on upwards, so each timer moves at
+// most three times before it expires. Slots are doubly linked lists, so
+// stopping a timer by its handle is O(1) as well.
+// Every SysTick posts EVENT_TICK; its handler, timerService(), advances the
+// wheel to the current uptime and runs the callbacks of expired timers in
+// the main loop, where they may send packets, post events, start or stop
+// timers (their own included).
+// When the CPU is about to sleep, startTickless() stretches the SysTick
+// period to the next slot timerNextExpiry() finds, so an idle board is not
+// woken every ms; stopTickless() brings back 1 ms ticks in the same phase
+// and adds the ms slept to the uptime.
 
 //-----------------------------------------------------------------------------
 // Device includes, defines, and assembler directives
@@ -20,136 +37,384 @@
 #include <stdint.h>
 #include <stdbool.h>
 #include "tm4c123gh6pm.h"
+#include "event.h"
 #include "timer.h"
+#include "trace.h"
+
+#define TIMER_NIL       0xFF            // end of a list
+
+#define WHEEL0_BITS     8
+#define WHEELN_BITS     6
+#define WHEEL0_SIZE     (1 << WHEEL0_BITS)
+#define WHEELN_SIZE     (1 << WHEELN_BITS)
+#define WHEEL_LEVELS    3               // above level 0
+#define WHEEL_MAX_DELAY ((1UL << (WHEEL0_BITS + WHEEL_LEVELS * WHEELN_BITS)) - 1)
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _timer
+{
+    _timerCallback callback;
+    void* context;
+    uint32_t expires;                   // uptime in ms
+    uint32_t period;                    // 0 for one shot
+    uint32_t delay;                     // for restartTimer()
+    uint8_t* list;                      // slot holding the timer, NULL if stopped
+    uint8_t next;
+    uint8_t prev;
+    uint8_t generation;
+} timer;
 
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
-#define NUM_TIMERS 10
+timer timers[MAX_TIMERS];
+uint8_t timerFree;
+uint8_t wheel0[WHEEL0_SIZE];
+uint8_t wheelN[WHEEL_LEVELS][WHEELN_SIZE];
+uint32_t wheelTime = 0;                 // last ms processed
 
-_callback fn[NUM_TIMERS];
-uint32_t period[NUM_TIMERS];
-uint32_t ticks[NUM_TIMERS];
-bool reload[NUM_TIMERS];
+volatile uint32_t uptimeMs = 0;
+uint32_t ticklessLoad;                  // SysTick ticks to the tickless wake
+uint32_t ticklessMs;                    // ms boundaries until then
 
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
-void initimer()
+static void timerLink(uint8_t t)
+{
+    uint32_t expires = timers[t].expires;
+    uint32_t delay = expires - wheelTime;
+    uint8_t* list;
+
+    if (delay < WHEEL0_SIZE)
+        list = &wheel0[expires & (WHEEL0_SIZE - 1)];
+    else if (delay < 1UL << (WHEEL0_BITS + WHEELN_BITS))
+        list = &wheelN[0][(expires >> WHEEL0_BITS) & (WHEELN_SIZE - 1)];
+    else if (delay < 1UL << (WHEEL0_BITS + 2 * WHEELN_BITS))
+        list = &wheelN[1][(expires >> (WHEEL0_BITS + WHEELN_BITS)) & (WHEELN_SIZE - 1)];
+    else
+    {
+        // beyond the wheel: file at its far end, refiled when cascaded
+        if (delay > WHEEL_MAX_DELAY)
+            expires = wheelTime + WHEEL_MAX_DELAY;
+        list = &wheelN[2][(expires >> (WHEEL0_BITS + 2 * WHEELN_BITS)) & (WHEELN_SIZE - 1)];
+    }
+    timers[t].list = list;
+    timers[t].prev = TIMER_NIL;
+    timers[t].next = *list;
+    if (*list != TIMER_NIL)
+        timers[*list].prev = t;
+    *list = t;
+}
+
+static void timerUnlink(uint8_t t)
+{
+    if (timers[t].prev != TIMER_NIL)
+        timers[timers[t].prev].next = timers[t].next;
+    else
+        *timers[t].list = timers[t].next;
+    if (timers[t].next != TIMER_NIL)
+        timers[timers[t].next].prev = timers[t].prev;
+    timers[t].list = NULL;
+}
+
+// Returns the timer of a handle, or TIMER_NIL if it is stale
+static uint8_t timerFind(timerHandle handle)
+{
+    uint8_t t = (handle & 0xFF) - 1;
+    if (t >= MAX_TIMERS || timers[t].generation != handle >> 8 || timers[t].callback == NULL)
+        return TIMER_NIL;
+    return t;
+}
+
+static void timerRelease(uint8_t t)
+{
+    if (timers[t].list != NULL)
+        timerUnlink(t);
+    timers[t].callback = NULL;
+    timers[t].generation++;
+    timers[t].next = timerFree;
+    timerFree = t;
+}
+
+static timerHandle timerStart(_timerCallback callback, void* context, uint32_t ms, uint32_t period)
+{
+    uint8_t t = timerFree;
+    if (t == TIMER_NIL || callback == NULL)
+        return TIMER_NONE;
+    timerFree = timers[t].next;
+    if (ms == 0)
+        ms = 1;                         // the current ms may already be processed
+    timers[t].callback = callback;
+    timers[t].context = context;
+    timers[t].delay = ms;
+    timers[t].period = period;
+    timers[t].expires = getUptimeMs() + ms;
+    timerLink(t);
+    return ((timerHandle)timers[t].generation << 8) | (t + 1);
+}
+
+static void timerTick(uint8_t type, uint8_t arg)
+{
+    timerService();
+}
+
+// Needs initEvents() first
+void initTimers()
+{
+    uint16_t i;
+    for (i = 0; i < WHEEL0_SIZE; i++)
+        wheel0[i] = TIMER_NIL;
+    for (i = 0; i < WHEEL_LEVELS * WHEELN_SIZE; i++)
+        wheelN[i / WHEELN_SIZE][i % WHEELN_SIZE] = TIMER_NIL;
+    for (i = 0; i < MAX_TIMERS; i++)
+    {
+        timers[i].callback = NULL;
+        timers[i].list = NULL;
+        timers[i].generation = 0;
+        timers[i].next = i + 1;
+    }
+    timers[MAX_TIMERS-1].next = TIMER_NIL;
+    timerFree = 0;
+    wheelTime = getUptimeMs();
+    eventSubscribe(EVENT_TICK, EVENT_HIGH, timerTick);
+}
+
+// Calls callback(context) once, ms from now
+// Returns TIMER_NONE if all timers are in use
+timerHandle startOneshotTimer(_timerCallback callback, void* context, uint32_t ms)
+{
+    return timerStart(callback, context, ms, 0);
+}
+
+// Calls callback(context) every ms, the first time ms from now
+timerHandle startPeriodicTimer(_timerCallback callback, void* context, uint32_t ms)
 {
-    uint8_t i;
+    return timerStart(callback, context, ms, ms == 0 ? 1 : ms);
+}
+
+// Returns false if the timer already expired or was stopped
+bool stopTimer(timerHandle handle)
+{
+    uint8_t t = timerFind(handle);
+    if (t == TIMER_NIL)
+        return false;
+    timerRelease(t);
+    return true;
+}
 
-    // Enable clocks
-    SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R4;
-    _delay_cycles(3);
-    // Configure Timer 4 for 1 sec tick
-    TIMER4_CTL_R &= ~TIMER_CTL_TAEN;                 // turn-off timer before reconfiguring
-    TIMER4_CFG_R = TIMER_CFG_32_BIT_TIMER;           // configure as 32-bit timer (A+B)
-    TIMER4_TAMR_R = TIMER_TAMR_TAMR_PERIOD;          // configure for periodic mode (count down)
-    TIMER4_TAILR_R = 40000000;                       // set load value (1 Hz rate)
-    TIMER4_CTL_R |= TIMER_CTL_TAEN;                  // turn-on timer
-    TIMER4_IMR_R |= TIMER_IMR_TATOIM;                // turn-on interrupt
-    NVIC_EN2_R |= 1 << (INT_TIMER4A-80);             // turn-on interrupt 86 (TIMER4A)
+// Starts the delay over from now, e.g. an idle timer on activity
+bool restartTimer(timerHandle handle)
+{
+    uint8_t t = timerFind(handle);
+    if (t == TIMER_NIL)
+        return false;
+    if (timers[t].list != NULL)
+        timerUnlink(t);
+    timers[t].expires = getUptimeMs() + timers[t].delay;
+    timerLink(t);
+    return true;
+}
+
+bool isTimerRunning(timerHandle handle)
+{
+    return timerFind(handle) != TIMER_NIL;
+}
 
-    for (i = 0; i < NUM_TIMERS; i++)
+// Moves every timer of a slot of level n down the wheel
+static void timerCascade(uint8_t level, uint8_t slot)
+{
+    uint8_t t = wheelN[level][slot];
+    uint8_t next;
+    wheelN[level][slot] = TIMER_NIL;
+    while (t != TIMER_NIL)
     {
-        period[i] = 0;
-        ticks[i] = 0;
-        fn[i] = NULL;
-        reload[i] = false;
+        next = timers[t].next;
+        timerLink(t);
+        t = next;
     }
 }
 
-bool startOneshotTimer(_callback callback, uint32_t seconds)
+// Runs the callbacks of the timers due by now
+void timerService()
 {
-    uint8_t i = 0;
-    bool found = false;
-    while (i < NUM_TIMERS && !found)
+    uint32_t now = getUptimeMs();
+    uint8_t t, level;
+    uint32_t index;
+
+    while (wheelTime != now)
     {
-        found = fn[i] == NULL;
-        if (found)
+        wheelTime++;
+        index = wheelTime;
+        for (level = 0; level < WHEEL_LEVELS; level++)
         {
-            period[i] = seconds;
-            ticks[i] = seconds;
-            fn[i] = callback;
-            reload[i] = false;
+            // a lower level wrapped, bring the next slot of this one down
+            if ((index & ((level == 0 ? WHEEL0_SIZE : WHEELN_SIZE) - 1)) != 0)
+                break;
+            index >>= (level == 0 ? WHEEL0_BITS : WHEELN_BITS);
+            timerCascade(level, index & (WHEELN_SIZE - 1));
+        }
+
+        t = wheel0[wheelTime & (WHEEL0_SIZE - 1)];
+        while (t != TIMER_NIL)
+        {
+            timerUnlink(t);
+            if (timers[t].expires != wheelTime)
+            {
+                // filed at the far end of the wheel, not due yet
+                timerLink(t);
+            }
+            else
+            {
+                if (timers[t].period != 0)
+                {
+                    timers[t].expires += timers[t].period;
+                    timerLink(t);
+                    TRACE(TRACE_TIMER, t);
+                    (*timers[t].callback)(timers[t].context);
+                }
+                else
+                {
+                    _timerCallback callback = timers[t].callback;
+                    void* context = timers[t].context;
+                    timerRelease(t);
+                    TRACE(TRACE_TIMER, t);
+                    (*callback)(context);
+                }
+            }
+            t = wheel0[wheelTime & (WHEEL0_SIZE - 1)];
         }
-        i++;
     }
-    return found;
 }
 
-bool startPeriodicTimer(_callback callback, uint32_t seconds)
+// Returns the ms until the wheel next has work (an expiry or a cascade that
+// may bring one down), at most limit
+// Only valid when timerService() is up to date, i.e. with no EVENT_TICK waiting
+uint32_t timerNextExpiry(uint32_t limit)
 {
-    uint8_t i = 0;
-    bool found = false;
-    while (i < NUM_TIMERS && !found)
+    uint32_t d, t;
+    for (d = 1; d < limit; d++)
     {
-        found = fn[i] == NULL;
-        if (found)
+        t = wheelTime + d;
+        if (wheel0[t & (WHEEL0_SIZE - 1)] != TIMER_NIL)
+            return d;
+        // level 0 wraps: wake for the cascade if it has timers to bring down,
+        // and always when level 1 wraps as well (every 16 s)
+        if ((t & (WHEEL0_SIZE - 1)) == 0)
         {
-            period[i] = seconds;
-            ticks[i] = seconds;
-            fn[i] = callback;
-            reload[i] = true;
+            t >>= WHEEL0_BITS;
+            if (wheelN[0][t & (WHEELN_SIZE - 1)] != TIMER_NIL || (t & (WHEELN_SIZE - 1)) == 0)
+                return d;
         }
-        i++;
     }
-    return found;
+    return limit;
 }
 
-bool stopTimer(_callback callback)
+// Starts SysTick as a 1 ms uptime counter
+void initUptime()
 {
-     uint8_t i = 0;
-     bool found = false;
-     while (i < NUM_TIMERS && !found)
-     {
-         found = fn[i] == callback;
-         if (found)
-             ticks[i] = 0;
-         i++;
-     }
-     return found;
+    NVIC_ST_CTRL_R = 0;                              // turn-off SysTick before reconfiguring
+    NVIC_ST_RELOAD_R = 40000 - 1;                    // 1 kHz rate at 40 MHz
+    NVIC_ST_CURRENT_R = 0;
+    NVIC_ST_CTRL_R = NVIC_ST_CTRL_CLK_SRC | NVIC_ST_CTRL_INTEN | NVIC_ST_CTRL_ENABLE;
 }
 
-bool restartTimer(_callback callback)
+void sysTickIsr()
 {
-     uint8_t i = 0;
-     bool found = false;
-     while (i < NUM_TIMERS && !found)
-     {
-         found = fn[i] == callback;
-         if (found)
-             ticks[i] = period[i];
-         i++;
-     }
-     return found;
+    TRACE(TRACE_ISR_BEGIN, TRACE_VECTOR_SYSTICK);
+    uptimeMs++;
+    eventPostFromIsr(EVENT_TICK, 0);
+    TRACE(TRACE_ISR_END, 0);
 }
 
-void tickIsr()
+// Next SysTick interrupt in ticks, 1 ms periods after it
+static void tickReload(uint32_t ticks)
 {
-    uint8_t i;
-    for (i = 0; i < NUM_TIMERS; i++)
+    if (ticks < 2)
+        ticks = 2;
+    NVIC_ST_RELOAD_R = ticks - 1;
+    NVIC_ST_CURRENT_R = 0;                           // loads RELOAD on the next clock
+    NVIC_ST_CTRL_R = NVIC_ST_CTRL_CLK_SRC | NVIC_ST_CTRL_INTEN | NVIC_ST_CTRL_ENABLE;
+    while (NVIC_ST_CURRENT_R == 0);
+    NVIC_ST_RELOAD_R = 40000 - 1;                    // used from the next reload on
+}
+
+// Stretches the current SysTick period so that the next interrupt comes
+// ms boundaries from now, at most TICKLESS_MAX_MS
+// Call with interrupts disabled and no SysTick pending
+// Returns false if the current ms is about to end, then just wait for it
+bool startTickless(uint32_t ms)
+{
+    uint32_t current;
+    if (ms > TICKLESS_MAX_MS)
+        ms = TICKLESS_MAX_MS;
+    NVIC_ST_CTRL_R = NVIC_ST_CTRL_CLK_SRC;           // hold the count
+    current = NVIC_ST_CURRENT_R;
+    if (ms <= 1 || current < TICKLESS_MIN_TICKS)
     {
-        if (ticks[i] != 0)
-        {
-            ticks[i]--;
-            if (ticks[i] == 0)
-            {
-                if (reload[i])
-                    ticks[i] = period[i];
-                (*fn[i])();
-            }
-        }
+        NVIC_ST_CTRL_R = NVIC_ST_CTRL_CLK_SRC | NVIC_ST_CTRL_INTEN | NVIC_ST_CTRL_ENABLE;
+        return false;
+    }
+    // the rest of this ms, then ms-1 whole ones; a few cycles are lost
+    // while the counter is held, against a 40 MHz crystal that is noise
+    ticklessMs = ms;
+    ticklessLoad = current + (ms - 1) * 40000;
+    tickReload(ticklessLoad);
+    return true;
+}
+
+// Called on wake-up, interrupts still disabled: back to 1 ms ticks
+// Returns the microseconds slept
+uint32_t stopTickless()
+{
+    uint32_t current, left, elapsed;
+    if (NVIC_INT_CTRL_R & NVIC_INT_CTRL_PENDSTSET)
+    {
+        // slept through: already back to 1 ms periods in phase, the
+        // pending interrupt counts the last ms and posts EVENT_TICK
+        elapsed = ticklessLoad + (40000 - 1 - NVIC_ST_CURRENT_R);
+        uptimeMs += ticklessMs - 1;
+        return elapsed / 40;
     }
-    TIMER4_ICR_R = TIMER_ICR_TATOCINT;
+    // woken early by another interrupt
+    NVIC_ST_CTRL_R = NVIC_ST_CTRL_CLK_SRC;
+    current = NVIC_ST_CURRENT_R;
+    if (current == 0)
+        current = 1;
+    elapsed = ticklessLoad - current;
+    left = (current - 1) / 40000;                    // whole ms after the next boundary
+    if (left < ticklessMs - 1)
+    {
+        uptimeMs += ticklessMs - 1 - left;
+        eventPostFromIsr(EVENT_TICK, 0);             // nothing can preempt, interrupts are off
+    }
+    tickReload(current - left * 40000);             // rest of the current ms
+    return elapsed / 40;
 }
 
-// Placeholder random number function
-uint32_t random32()
+// Milliseconds since initUptime(), wraps after 49 days
+// Compare times by subtraction so the wrap is harmless
+uint32_t getUptimeMs()
 {
-    return TIMER4_TAV_R;
+    return uptimeMs;
 }
 
+// Microseconds since initUptime(), wraps after 71 minutes
+uint32_t getUptimeUs()
+{
+    uint32_t ms, ticks;
+    do
+    {
+        ms = uptimeMs;
+        ticks = NVIC_ST_CURRENT_R;
+    } while (ms != uptimeMs);
+    // the counter reloaded but the SysTick interrupt has not run yet
+    if ((NVIC_INT_CTRL_R & NVIC_INT_CTRL_PENDSTSET) && ticks > 20000)
+        ms++;
+    return ms * 1000 + (40000 - 1 - ticks) / 40;
+}
@@ -11,18 +11,35 @@
 #include<stdint.h>
 #include<stdbool.h>
 
-typedef void(*_callback)();
+#define MAX_TIMERS      16              // timers running at once
+#define TIMER_NONE      0               // never a valid handle
+#define TICKLESS_MAX_MS     400         // SysTick is 24 bits, 419 ms at 40 MHz
+#define TICKLESS_MIN_TICKS  400         // not worth stretching the last 10 us of a ms
+
+// Runs from timerService() in the main loop, not in an interrupt
+typedef void(*_timerCallback)(void* context);
+
+// Generation in the upper byte, so a handle kept after its timer expired
+// or was cancelled cannot touch the timer that reuses the slot
+typedef uint16_t timerHandle;
 
-//uint8_t count = 0;
 //............................................................................................................................................
 //Subroutines
 //............................................................................................................................................
 
-void initimer();
-bool startOneshotTimer(_callback callback,uint32_t seconds);
-bool startPeriodicTimer(_callback callback,uint32_t seconds);
-bool stopTimer(_callback callback);
-bool restartTimer(_callback callback);
-void tickIsr();
+void initTimers();
+timerHandle startOneshotTimer(_timerCallback callback, void* context, uint32_t ms);
+timerHandle startPeriodicTimer(_timerCallback callback, void* context, uint32_t ms);
+bool stopTimer(timerHandle handle);
+bool restartTimer(timerHandle handle);
+bool isTimerRunning(timerHandle handle);
+void timerService();
+void initUptime();
+void sysTickIsr();
+uint32_t getUptimeMs();
+uint32_t getUptimeUs();
+uint32_t timerNextExpiry(uint32_t limit);
+bool startTickless(uint32_t ms);
+uint32_t stopTickless();
 
 #endif /* TIMER_H_ */
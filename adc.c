@@ -0,0 +1,214 @@
+// ADC Sampling Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Hardware configuration:
+// ADC0 sample sequencer 0, up to 8 inputs per burst
+// Timer 2A (ADC trigger)
+// uDMA channel 14 (ADC0 SS0)
+
+// Timer 2A triggers SS0 ADC_SAMPLE_RATE times a second. Each trigger is a
+// burst converting every started input once, each result averaged over 64
+// conversions by the ADC (SAC), and uDMA moves the results into one half of
+// a ping-pong buffer. When a half holds ADC_BLOCK_SIZE bursts the SS0
+// interrupt posts EVENT_SAMPLE and re-arms it, while the controller
+// fills the other half. A block is interleaved: result i of burst b is at
+// block[b * count + i]. SS0 has 8 steps, enough for every input a board
+// uses, so SS1-SS2 stay free and one uDMA channel and interrupt serve all
+// inputs. Sampling instants depend only on the timer, and the CPU does no
+// work per sample.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "tm4c123gh6pm.h"
+#include "adc.h"
+#include "event.h"
+#include "gpio.h"
+#include "trace.h"
+#include "udma.h"
+
+#define ADC_DMA_CHANNEL     14
+#define ADC_PINS            12      // AIN0-AIN11
+
+// 16-bit reads of the FIFO into consecutive halfwords, one per request
+#define ADC_DMA_CONTROL     (UDMA_CHCTL_DSTINC_16 | UDMA_CHCTL_DSTSIZE_16 | UDMA_CHCTL_SRCINC_NONE \
+                             | UDMA_CHCTL_SRCSIZE_16 | UDMA_CHCTL_ARBSIZE_1 | UDMA_CHCTL_XFERMODE_PINGPONG)
+
+// SSCTL0 bits of one step, shifted by 4 per step
+#define ADC_STEP_END        0x2
+#define ADC_STEP_IE         0x4
+#define ADC_STEP_TS         0x8
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _adcPin
+{
+    PORT port;
+    uint8_t pin;
+} adcPin;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+// AIN0-AIN11
+const adcPin adcPins[ADC_PINS] =
+{
+    {PORTE, 3}, {PORTE, 2}, {PORTE, 1}, {PORTE, 0}, {PORTD, 3}, {PORTD, 2},
+    {PORTD, 1}, {PORTD, 0}, {PORTE, 5}, {PORTE, 4}, {PORTB, 4}, {PORTB, 5}
+};
+
+uint16_t adcBlocks[2][ADC_MAX_INPUTS * ADC_BLOCK_SIZE];
+uint8_t adcCount = 0;
+volatile int8_t adcFull = -1;           // half ready for the main loop, -1 if none
+volatile uint32_t adcOverrun = 0;       // halves completed before the last was taken
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static void adcArm(udmaControl* entry, uint8_t half)
+{
+    uint16_t size = adcCount * ADC_BLOCK_SIZE;
+    entry->srcEnd = &ADC0_SSFIFO0_R;
+    entry->dstEnd = &adcBlocks[half][size - 1];
+    entry->control = ADC_DMA_CONTROL | ((size - 1) << UDMA_CHCTL_XFERSIZE_S);
+}
+
+// Sets up the ADC, its trigger timer and uDMA channel; nothing is sampled
+// until adcStart() gives the inputs
+void initAdc()
+{
+    // uDMA channel 14: ADC0 SS0, ping-pong between the two blocks
+    initUdma();
+    UDMA_CHMAP1_R &= ~UDMA_CHMAP1_CH14SEL_M;         // channel 14 encoding 0 is ADC0 SS0
+    UDMA_ALTCLR_R = 1 << ADC_DMA_CHANNEL;            // start with the primary structure
+    UDMA_USEBURSTCLR_R = 1 << ADC_DMA_CHANNEL;       // honor single requests
+    UDMA_REQMASKCLR_R = 1 << ADC_DMA_CHANNEL;
+
+    // Configure ADC
+    SYSCTL_RCGCADC_R |= SYSCTL_RCGCADC_R0;
+    _delay_cycles(3);
+    ADC0_CC_R = ADC_CC_CS_SYSPLL;                    // select PLL as the time base
+    ADC0_ACTSS_R &= ~(ADC_ACTSS_ASEN0 | ADC_ACTSS_ASEN1 | ADC_ACTSS_ASEN2 | ADC_ACTSS_ASEN3);
+    ADC0_EMUX_R = (ADC0_EMUX_R & ~ADC_EMUX_EM0_M) | ADC_EMUX_EM0_TIMER; // timer triggers SS0
+    ADC0_SAC_R = ADC_SAC_AVG_64X;                    // each result is the average of 64 conversions
+    ADC0_ISC_R = ADC_ISC_IN0;
+    ADC0_IM_R |= ADC_IM_MASK0;
+    NVIC_EN0_R |= 1 << (INT_ADC0SS0-16);             // turn-on interrupt 30 (ADC0SS0)
+
+    // Configure Timer 2 as the ADC trigger
+    SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R2;
+    _delay_cycles(3);
+    TIMER2_CTL_R &= ~TIMER_CTL_TAEN;                 // turn-off timer before reconfiguring
+    TIMER2_CFG_R = TIMER_CFG_32_BIT_TIMER;           // configure as 32-bit timer (A+B)
+    TIMER2_TAMR_R = TIMER_TAMR_TAMR_PERIOD;          // configure for periodic mode (count down)
+    TIMER2_TAILR_R = 40000000 / ADC_SAMPLE_RATE - 1; // set load value
+    TIMER2_IMR_R = 0;                                // no timer interrupt, the ADC is triggered directly
+}
+
+// Programs one SS0 step per input (AINn or ADC_INPUT_TEMP) and starts sampling
+// Returns false if there are no inputs or more than SS0 can hold
+bool adcStart(uint8_t inputs[], uint8_t count)
+{
+    uint32_t mux = 0;
+    uint32_t ctl = 0;
+    uint8_t i;
+
+    if (count == 0 || count > ADC_MAX_INPUTS)
+        return false;
+    for (i = 0; i < count; i++)
+    {
+        if (inputs[i] != ADC_INPUT_TEMP && inputs[i] >= ADC_PINS)
+            return false;
+    }
+
+    TIMER2_CTL_R &= ~TIMER_CTL_TAEN;
+    ADC0_ACTSS_R &= ~(ADC_ACTSS_ASEN0 | ADC_ACTSS_ADEN0); // disable SS0 for programming
+    UDMA_ENACLR_R = 1 << ADC_DMA_CHANNEL;
+    for (i = 0; i < count; i++)
+    {
+        if (inputs[i] == ADC_INPUT_TEMP)
+            ctl |= ADC_STEP_TS << (i * 4);
+        else
+        {
+            enablePort(adcPins[inputs[i]].port);
+            selectPinAnalogInput(adcPins[inputs[i]].port, adcPins[inputs[i]].pin);
+            mux |= (uint32_t)inputs[i] << (i * 4);
+        }
+    }
+    ctl |= (ADC_STEP_END | ADC_STEP_IE) << ((count - 1) * 4); // interrupt once per burst
+    ADC0_SSMUX0_R = mux;
+    ADC0_SSCTL0_R = ctl;
+
+    adcCount = count;
+    adcFull = -1;
+    UDMA_ALTCLR_R = 1 << ADC_DMA_CHANNEL;
+    adcArm(udmaPrimary(ADC_DMA_CHANNEL), 0);
+    adcArm(udmaAlternate(ADC_DMA_CHANNEL), 1);
+    UDMA_ENASET_R = 1 << ADC_DMA_CHANNEL;
+
+    ADC0_ACTSS_R |= ADC_ACTSS_ADEN0 | ADC_ACTSS_ASEN0; // uDMA and sequencer on
+    TIMER2_CTL_R |= TIMER_CTL_TAOTE | TIMER_CTL_TAEN; // turn-on ADC trigger and timer
+    return true;
+}
+
+// Called when a uDMA half completes
+void adc0Ss0Isr()
+{
+    udmaControl* primary = udmaPrimary(ADC_DMA_CHANNEL);
+    udmaControl* alternate = udmaAlternate(ADC_DMA_CHANNEL);
+    TRACE(TRACE_ISR_BEGIN, TRACE_VECTOR_ADC0);
+    ADC0_ISC_R = ADC_ISC_IN0;
+    if (udmaIsStopped(primary))
+    {
+        if (adcFull >= 0)
+            adcOverrun++;
+        adcFull = 0;
+        adcArm(primary, 0);
+    }
+    if (udmaIsStopped(alternate))
+    {
+        if (adcFull >= 0)
+            adcOverrun++;
+        adcFull = 1;
+        adcArm(alternate, 1);
+    }
+    eventPostFromIsr(EVENT_SAMPLE, 0);
+    TRACE(TRACE_ISR_END, 0);
+}
+
+// Returns ADC_BLOCK_SIZE interleaved bursts of adcInputCount() results, or
+// NULL if none is ready
+// The block is valid until the uDMA comes back to it (one block time)
+uint16_t* adcGetBlock()
+{
+    int8_t half = adcFull;
+    if (half < 0)
+        return NULL;
+    adcFull = -1;
+    return adcBlocks[half];
+}
+
+uint8_t adcInputCount()
+{
+    return adcCount;
+}
+
+uint32_t adcOverruns()
+{
+    return adcOverrun;
+}
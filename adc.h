@@ -0,0 +1,42 @@
+// ADC Sampling Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Hardware configuration:
+// ADC0 sample sequencer 0, up to 8 inputs per burst
+// Timer 2A (ADC trigger)
+// uDMA channel 14 (ADC0 SS0)
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef ADC_H_
+#define ADC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define ADC_SAMPLE_RATE     16      // bursts per second
+#define ADC_BLOCK_SIZE      16      // bursts per ping-pong half (1 s)
+#define ADC_MAX_INPUTS      8       // SS0 steps
+#define ADC_INPUT_TEMP      0xFF    // internal temperature sensor instead of AINn
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initAdc();
+bool adcStart(uint8_t inputs[], uint8_t count);
+uint16_t* adcGetBlock();
+uint8_t adcInputCount();
+uint32_t adcOverruns();
+void adc0Ss0Isr();
+
+#endif
@@ -0,0 +1,138 @@
+// MQTT v5 Topic Alias Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Outbound: the first PUBLISH on a topic carries the topic and a new alias,
+// later ones carry an empty topic and only the 2-byte alias. The number of
+// aliases is capped by the Topic Alias Maximum of the broker's CONNACK; when
+// the table is full the least recently used alias is re-mapped.
+// Inbound: the broker may assign up to MAX_IN_ALIASES aliases, which are
+// resolved back to topics before dispatch.
+// Both tables only live as long as the network connection.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "alias.h"
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+char outAliasTopic[MAX_OUT_ALIASES][MAX_ALIAS_TOPIC];
+uint32_t outAliasUsed[MAX_OUT_ALIASES];         // last use, for replacement
+uint16_t outAliasMax = 0;
+uint32_t outAliasClock = 0;
+char inAliasTopic[MAX_IN_ALIASES][MAX_ALIAS_TOPIC];
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static bool aliasTopicEquals(char* str1, char* str2)
+{
+    uint8_t i = 0;
+    while (str1[i] == str2[i])
+    {
+        if (str1[i] == '\0')
+            return true;
+        i++;
+    }
+    return false;
+}
+
+// Clears both tables; called for every new connection with the broker's
+// Topic Alias Maximum (0 disables outbound aliases)
+void initTopicAliases(uint16_t brokerMaximum)
+{
+    uint8_t i;
+    outAliasMax = brokerMaximum < MAX_OUT_ALIASES ? brokerMaximum : MAX_OUT_ALIASES;
+    outAliasClock = 0;
+    for (i = 0; i < MAX_OUT_ALIASES; i++)
+    {
+        outAliasTopic[i][0] = '\0';
+        outAliasUsed[i] = 0;
+    }
+    for (i = 0; i < MAX_IN_ALIASES; i++)
+        inAliasTopic[i][0] = '\0';
+}
+
+// Returns the alias to send with topic, or 0 if it cannot be aliased
+// known is set when the broker already has the mapping, so the topic may be
+// sent empty
+// The table is not changed until aliasOutboundSent(), a PUBLISH that is
+// never sent must not leave a mapping the broker does not have
+uint16_t aliasOutbound(char* topic, bool* known)
+{
+    uint8_t i, victim = 0;
+    uint8_t len = 0;
+    *known = false;
+    if (outAliasMax == 0)
+        return 0;
+    for (i = 0; i < outAliasMax; i++)
+    {
+        if (aliasTopicEquals(outAliasTopic[i], topic))
+        {
+            *known = true;
+            return i + 1;
+        }
+        if (outAliasUsed[i] < outAliasUsed[victim])
+            victim = i;
+    }
+    while (topic[len] != '\0')
+        len++;
+    if (len >= MAX_ALIAS_TOPIC)
+        return 0;
+    return victim + 1;
+}
+
+// Records the mapping once the PUBLISH carrying alias and topic went out
+void aliasOutboundSent(uint16_t alias, char* topic)
+{
+    uint8_t i = 0;
+    if (alias == 0 || alias > outAliasMax)
+        return;
+    do
+    {
+        outAliasTopic[alias-1][i] = topic[i];
+    }
+    while (topic[i++] != '\0');
+    outAliasUsed[alias-1] = ++outAliasClock;
+}
+
+// Records an alias assigned by the broker
+// Returns false if the alias is out of range
+bool aliasInboundSet(uint16_t alias, char* topic, uint16_t length)
+{
+    uint16_t i;
+    if (alias == 0 || alias > MAX_IN_ALIASES)
+        return false;
+    if (length >= MAX_ALIAS_TOPIC)
+    {
+        // too long to keep, later uses of this alias will not resolve
+        inAliasTopic[alias-1][0] = '\0';
+        return true;
+    }
+    for (i = 0; i < length; i++)
+        inAliasTopic[alias-1][i] = topic[i];
+    inAliasTopic[alias-1][length] = '\0';
+    return true;
+}
+
+// Returns the topic of an alias assigned by the broker, or NULL if unknown
+char* aliasInboundGet(uint16_t alias)
+{
+    if (alias == 0 || alias > MAX_IN_ALIASES || inAliasTopic[alias-1][0] == '\0')
+        return NULL;
+    return inAliasTopic[alias-1];
+}
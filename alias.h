@@ -0,0 +1,35 @@
+// MQTT v5 Topic Alias Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef ALIAS_H_
+#define ALIAS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_OUT_ALIASES      8      // aliases we assign to our publishes
+#define MAX_IN_ALIASES       8      // Topic Alias Maximum announced in CONNECT
+#define MAX_ALIAS_TOPIC      32     // longest aliased topic including '\0'
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initTopicAliases(uint16_t brokerMaximum);
+uint16_t aliasOutbound(char* topic, bool* known);
+void aliasOutboundSent(uint16_t alias, char* topic);
+bool aliasInboundSet(uint16_t alias, char* topic, uint16_t length);
+char* aliasInboundGet(uint16_t alias);
+
+#endif
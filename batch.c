@@ -0,0 +1,141 @@
+// Sample Batching Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Collects sensor samples between the sampling tick and the publish path so
+// that one PUBLISH carries many readings. A batch is ready after
+// maxSamples samples, maxAgeMs after its first sample, or at once when a
+// sample crosses the threshold. Samples are filled into one bank while the
+// other is being published, so sampling never waits for the network.
+//
+// Payload (CBOR, decode with tools/cbor_decode.py):
+//   {"seq": n, "u": unit, "e": exponent, "t": first sample uptime ms,
+//    "r": [dt0, v0, dt1, v1, ...]}
+// dt is the time since the previous sample (dt0 = 0) and each reading is
+// v * 10^e. At 1 Hz a reading costs 5 bytes, 120 readings fit in 622.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "batch.h"
+#include "cbor.h"
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+batchConfig batchSettings = {BATCH_MAX_SAMPLES, 120000, false, 0, true};
+batchBank batchBanks[2];
+uint8_t batchFill = 0;                  // bank receiving samples
+uint16_t batchSeq = 0;
+uint32_t batchLost = 0;                 // samples dropped while both banks were busy
+bool batchCrossed = false;
+char* batchUnit;
+int8_t batchExponent;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initBatch(char* unit, int8_t exponent)
+{
+    batchUnit = unit;
+    batchExponent = exponent;
+    batchBanks[0].count = 0;
+    batchBanks[1].count = 0;
+    batchFill = 0;
+    batchCrossed = false;
+}
+
+batchConfig* batchGetConfig()
+{
+    return &batchSettings;
+}
+
+void batchAdd(uint32_t time, int16_t value)
+{
+    batchBank* bank = &batchBanks[batchFill];
+    int16_t last;
+    if (bank->count >= BATCH_MAX_SAMPLES)
+    {
+        batchLost++;
+        return;
+    }
+    if (batchSettings.thresholdEnabled && bank->count > 0)
+    {
+        last = bank->value[bank->count - 1];
+        if ((last < batchSettings.threshold) != (value < batchSettings.threshold))
+            batchCrossed = true;
+    }
+    bank->time[bank->count] = time;
+    bank->value[bank->count] = value;
+    bank->count++;
+}
+
+uint8_t batchCount()
+{
+    return batchBanks[batchFill].count;
+}
+
+uint32_t batchDropped()
+{
+    return batchLost;
+}
+
+// Returns true when the filling bank should be published
+bool batchReady(uint32_t now)
+{
+    batchBank* bank = &batchBanks[batchFill];
+    if (bank->count == 0)
+        return false;
+    return batchCrossed || bank->count >= batchSettings.maxSamples
+           || now - bank->time[0] >= batchSettings.maxAgeMs;
+}
+
+// Hands the filling bank to the publisher and starts filling the other one
+// The returned bank stays valid until the next batchTake()
+batchBank* batchTake()
+{
+    batchBank* bank = &batchBanks[batchFill];
+    bank->seq = batchSeq++;
+    batchFill ^= 1;
+    batchBanks[batchFill].count = 0;
+    batchCrossed = false;
+    return bank;
+}
+
+// _payloadWriter for a bank returned by batchTake()
+uint16_t batchPayload(uint8_t buffer[], uint16_t size, void* context)
+{
+    batchBank* bank = (batchBank*)context;
+    cborWriter w;
+    uint8_t i;
+    cborBegin(&w, buffer, size);
+    cborMap(&w, 5);
+    cborText(&w, "seq");
+    cborUint(&w, bank->seq);
+    cborText(&w, "u");
+    cborText(&w, batchUnit);
+    cborText(&w, "e");
+    cborInt(&w, batchExponent);
+    cborText(&w, "t");
+    cborUint(&w, bank->count > 0 ? bank->time[0] : 0);
+    cborText(&w, "r");
+    cborArray(&w, 2 * bank->count);
+    for (i = 0; i < bank->count; i++)
+    {
+        cborUint(&w, (i == 0) ? 0 : bank->time[i] - bank->time[i-1]);
+        cborInt(&w, bank->value[i]);
+    }
+    return cborEnd(&w);
+}
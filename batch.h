@@ -0,0 +1,53 @@
+// Sample Batching Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef BATCH_H_
+#define BATCH_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define BATCH_MAX_SAMPLES   120     // per bank, two banks
+
+typedef struct _batchConfig
+{
+    uint8_t maxSamples;             // flush after N samples
+    uint32_t maxAgeMs;              // or T ms after the first sample
+    bool thresholdEnabled;          // flush at once when the value crosses threshold
+    int16_t threshold;
+    bool flushOnShutdown;           // publish what is left before disconnect/reboot
+} batchConfig;
+
+typedef struct _batchBank
+{
+    uint16_t seq;
+    uint8_t count;
+    uint32_t time[BATCH_MAX_SAMPLES];   // uptime in ms
+    int16_t value[BATCH_MAX_SAMPLES];
+} batchBank;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initBatch(char* unit, int8_t exponent);
+batchConfig* batchGetConfig();
+void batchAdd(uint32_t time, int16_t value);
+uint8_t batchCount();
+uint32_t batchDropped();
+bool batchReady(uint32_t now);
+batchBank* batchTake();
+uint16_t batchPayload(uint8_t buffer[], uint16_t size, void* context);
+
+#endif
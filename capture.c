@@ -0,0 +1,296 @@
+// Packet Capture Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// A sniffer that stays on the board. etherGetPacket() and etherPutPacket()
+// offer every frame to captureFrame(), which tests it against the filter
+// (ethertype, IPv4 protocol, TCP or UDP port at either end) and copies its
+// first CAPTURE_SNAPLEN bytes with the uptime into a ring that overwrites
+// the oldest frame: a few compares and one bounded copy per frame.
+// capture dump writes the ring as a pcap file (microsecond timestamps from
+// boot, Ethernet link type) in hex lines between BEGIN and END markers,
+// a few lines at a time as the UART0 TX ring has room, so the console
+// keeps working and nothing is dropped. Capture pauses during the dump.
+// tools/pcap_extract.py turns the lines back into a .pcap for Wireshark.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "capture.h"
+#include "cli.h"
+#include "stats.h"
+#include "Timer.h"
+#include "uart0.h"
+
+#define CAPTURE_LINE        32      // stream bytes per hex line
+#define CAPTURE_FILE_HEADER 24
+#define CAPTURE_REC_HEADER  16
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _captureSlot
+{
+    uint32_t timeUs;
+    uint16_t size;                  // on the wire
+    uint8_t length;                 // kept, up to CAPTURE_SNAPLEN
+    uint8_t direction;
+    uint8_t data[CAPTURE_SNAPLEN];
+} captureSlot;
+
+typedef struct _captureFilter
+{
+    char* name;
+    uint16_t etherType;             // 0 for any
+    uint8_t protocol;               // IPv4 protocol, 0 for any
+} captureFilter;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+captureSlot captureRing[CAPTURE_SLOTS];
+uint8_t captureHead = 0;            // next slot written
+uint8_t captureCount = 0;           // slots holding a frame
+bool captureOn = false;
+bool captureDumping = false;
+captureStats captureCounters;
+const char* const captureStatNames[] = {"seen", "kept", "overwritten"};
+
+const captureFilter captureFilters[] =
+{
+    {"any", 0, 0},
+    {"arp", 0x0806, 0},
+    {"ip", 0x0800, 0},
+    {"icmp", 0x0800, 1},
+    {"tcp", 0x0800, 6},
+    {"udp", 0x0800, 17},
+};
+const captureFilter* captureMatch = &captureFilters[0];
+uint16_t capturePort = 0;           // TCP or UDP, 0 for any
+
+// Dump position: item 0 is the file header, item n the (n-1)th oldest frame
+uint8_t captureDumpItem = 0;
+uint8_t captureDumpBuffer[CAPTURE_REC_HEADER + CAPTURE_SNAPLEN];
+uint16_t captureDumpSize = 0;
+uint16_t captureDumpOffset = 0;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static bool captureMatches(uint8_t frame[], uint16_t size)
+{
+    uint16_t etherType, source, dest;
+    uint8_t header;
+
+    if (size < 14)
+        return false;
+    etherType = (frame[12] << 8) | frame[13];
+    if (captureMatch->etherType != 0 && etherType != captureMatch->etherType)
+        return false;
+    if (captureMatch->protocol == 0 && capturePort == 0)
+        return true;
+    if (etherType != 0x0800 || size < 34)
+        return false;
+    if (captureMatch->protocol != 0 && frame[23] != captureMatch->protocol)
+        return false;
+    if (capturePort == 0)
+        return true;
+    if (frame[23] != 6 && frame[23] != 17)
+        return false;
+    header = 14 + (frame[14] & 0xF) * 4;
+    if (size < header + 4)
+        return false;
+    source = (frame[header] << 8) | frame[header + 1];
+    dest = (frame[header + 2] << 8) | frame[header + 3];
+    return source == capturePort || dest == capturePort;
+}
+
+void captureFrame(uint8_t direction, uint8_t frame[], uint16_t size)
+{
+    captureSlot* slot;
+    uint8_t i;
+
+    if (!captureOn || captureDumping)
+        return;
+    captureCounters.seen++;
+    if (!captureMatches(frame, size))
+        return;
+    slot = &captureRing[captureHead];
+    slot->timeUs = getUptimeUs();
+    slot->size = size;
+    slot->length = size < CAPTURE_SNAPLEN ? size : CAPTURE_SNAPLEN;
+    slot->direction = direction;
+    for (i = 0; i < slot->length; i++)
+        slot->data[i] = frame[i];
+    captureHead = (captureHead + 1) % CAPTURE_SLOTS;
+    if (captureCount < CAPTURE_SLOTS)
+        captureCount++;
+    else
+        captureCounters.overwritten++;
+    captureCounters.kept++;
+}
+
+captureStats* captureGetStats()
+{
+    return &captureCounters;
+}
+
+static void capturePut32(uint8_t buffer[], uint32_t value)
+{
+    buffer[0] = value;
+    buffer[1] = value >> 8;
+    buffer[2] = value >> 16;
+    buffer[3] = value >> 24;
+}
+
+// Fills the dump buffer with a pcap item, headers little endian
+static void captureStage(uint8_t item)
+{
+    captureSlot* slot;
+    uint8_t i;
+    captureDumpOffset = 0;
+    if (item == 0)
+    {
+        capturePut32(&captureDumpBuffer[0], 0xA1B2C3D4);    // microseconds
+        capturePut32(&captureDumpBuffer[4], 0x00040002);    // version 2.4
+        capturePut32(&captureDumpBuffer[8], 0);             // UTC
+        capturePut32(&captureDumpBuffer[12], 0);            // accuracy
+        capturePut32(&captureDumpBuffer[16], CAPTURE_SNAPLEN);
+        capturePut32(&captureDumpBuffer[20], 1);            // Ethernet
+        captureDumpSize = CAPTURE_FILE_HEADER;
+        return;
+    }
+    slot = &captureRing[(captureHead + CAPTURE_SLOTS - captureCount + item - 1) % CAPTURE_SLOTS];
+    capturePut32(&captureDumpBuffer[0], slot->timeUs / 1000000);
+    capturePut32(&captureDumpBuffer[4], slot->timeUs % 1000000);
+    capturePut32(&captureDumpBuffer[8], slot->length);
+    capturePut32(&captureDumpBuffer[12], slot->size);
+    for (i = 0; i < slot->length; i++)
+        captureDumpBuffer[CAPTURE_REC_HEADER + i] = slot->data[i];
+    captureDumpSize = CAPTURE_REC_HEADER + slot->length;
+}
+
+// Returns false at the end of the pcap stream
+static bool captureNextByte(uint8_t* b)
+{
+    while (captureDumpOffset >= captureDumpSize)
+    {
+        if (captureDumpItem > captureCount)
+            return false;
+        captureStage(captureDumpItem++);
+    }
+    *b = captureDumpBuffer[captureDumpOffset++];
+    return true;
+}
+
+// Writes as many lines as the TX ring takes, then comes back later
+static void captureDumpStep(void* context)
+{
+    static const char hex[] = "0123456789abcdef";
+    uint8_t b, n;
+    while (uart0TxSpace() >= 2 * CAPTURE_LINE + 32)
+    {
+        for (n = 0; n < CAPTURE_LINE && captureNextByte(&b); n++)
+        {
+            putcUart0(hex[b >> 4]);
+            putcUart0(hex[b & 15]);
+        }
+        if (n > 0)
+            putsUart0("\n\r");
+        if (n < CAPTURE_LINE)
+        {
+            putsUart0("-----END PCAP-----\n\r");
+            captureDumping = false;
+            return;
+        }
+    }
+    startOneshotTimer(captureDumpStep, NULL, CAPTURE_DUMP_MS);
+}
+
+static void captureShow()
+{
+    putsUart0(captureOn ? "Capture on" : "Capture off");
+    putsUart0(", filter ");
+    putsUart0(captureMatch->name);
+    if (capturePort != 0)
+    {
+        putsUart0(" port ");
+        putsUart0(itostring(capturePort));
+    }
+    putsUart0("\n\rFrames: ");
+    putsUart0(itostring(captureCount));
+    putsUart0(" of ");
+    putsUart0(itostring(CAPTURE_SLOTS));
+    putsUart0(", seen ");
+    putsUart0(itostring(captureCounters.seen));
+    putsUart0(", kept ");
+    putsUart0(itostring(captureCounters.kept));
+    putsUart0(", overwritten ");
+    putsUart0(itostring(captureCounters.overwritten));
+    putsUart0("\n\r");
+}
+
+// capture on|off|clear|dump, capture filter <name> [port]
+static void captureCommand(USER_DATA* data)
+{
+    char* arg = data->fieldcount >= 2 ? getFieldString(data, 2) : "";
+    uint8_t i;
+
+    if (captureDumping)
+        return;
+    if (stringcmp("on", arg))
+        captureOn = true;
+    else if (stringcmp("off", arg))
+        captureOn = false;
+    else if (stringcmp("clear", arg))
+    {
+        captureHead = 0;
+        captureCount = 0;
+        captureCounters.seen = 0;
+        captureCounters.kept = 0;
+        captureCounters.overwritten = 0;
+    }
+    else if (stringcmp("dump", arg))
+    {
+        captureDumping = true;
+        captureDumpItem = 0;
+        captureDumpSize = 0;
+        captureDumpOffset = 0;
+        putsUart0("-----BEGIN PCAP-----\n\r");
+        captureDumpStep(NULL);
+    }
+    else if (stringcmp("filter", arg) && data->fieldcount >= 3)
+    {
+        for (i = 0; i < sizeof(captureFilters) / sizeof(captureFilters[0]); i++)
+        {
+            if (stringcmp(captureFilters[i].name, getFieldString(data, 3)))
+            {
+                captureMatch = &captureFilters[i];
+                capturePort = data->fieldcount >= 4 ? getFieldInteger(data, 4) : 0;
+            }
+        }
+        captureShow();
+    }
+    else
+        captureShow();
+}
+
+// After initCli() and initStats(), registers the capture command and counters
+void initCapture()
+{
+    statsRegister("capture", captureStatNames, (uint32_t*)&captureCounters, STATS_COUNT(captureCounters), NULL);
+    cliRegister("capture", 1, captureCommand, "on|off|clear|dump, filter any|arp|ip|icmp|tcp|udp [port]");
+}
@@ -0,0 +1,44 @@
+// Packet Capture Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef CAPTURE_H_
+#define CAPTURE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CAPTURE_SLOTS       16      // frames kept, the oldest is overwritten
+#define CAPTURE_SNAPLEN     128     // bytes kept of each frame
+#define CAPTURE_DUMP_MS     5       // between dump lines while the TX ring is full
+
+// Directions
+#define CAPTURE_RX          0
+#define CAPTURE_TX          1
+
+typedef struct _captureStats
+{
+    uint32_t seen;                  // frames offered while on
+    uint32_t kept;                  // passed the filter
+    uint32_t overwritten;           // kept, then lost to newer frames
+} captureStats;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initCapture();
+void captureFrame(uint8_t direction, uint8_t frame[], uint16_t size);
+captureStats* captureGetStats();
+
+#endif
@@ -0,0 +1,198 @@
+// CBOR Encoder Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Minimal RFC 8949 encoder for telemetry payloads. Items are written in
+// order with the shortest head encoding; arrays and maps are definite
+// length, so the caller gives the item count up front. Nothing is
+// buffered: the writer points into the PUBLISH payload area of the frame.
+// Decode on the host with tools/cbor_decode.py.
+//
+// Size of one temperature reading, 23.4 C at t = 123456 ms, seq 12:
+//   text publish today        "23"                                      2 bytes
+//   same fields as JSON       {"seq":12,"u":"Cel","r":[[123456,23.4]]} 40 bytes
+//   CBOR                      {"seq":12,"u":"Cel","r":[[123456,4([-1,234])]]}
+//                                                                      26 bytes
+// Each further reading adds 11 bytes in CBOR against 14 in JSON.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cbor.h"
+
+// Major types (upper 3 bits of the initial byte)
+#define CBOR_UINT           0x00
+#define CBOR_NEGINT         0x20
+#define CBOR_BYTES          0x40
+#define CBOR_TEXT           0x60
+#define CBOR_ARRAY          0x80
+#define CBOR_MAP            0xA0
+#define CBOR_TAG            0xC0
+#define CBOR_SIMPLE         0xE0
+
+#define CBOR_FALSE          0xF4
+#define CBOR_TRUE           0xF5
+#define CBOR_NULL           0xF6
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Reserves n bytes, returns where to write them or NULL
+static uint8_t* cborReserve(cborWriter* w, uint16_t n)
+{
+    uint8_t* p = NULL;
+    if (w->buffer != NULL)
+    {
+        if (!w->ok || w->length + n > w->size)
+        {
+            w->ok = false;
+            return NULL;
+        }
+        p = &w->buffer[w->length];
+    }
+    w->length += n;
+    return p;
+}
+
+// Writes an initial byte with its argument in the shortest form
+static void cborHead(cborWriter* w, uint8_t major, uint32_t value)
+{
+    uint8_t* p;
+    if (value < 24)
+    {
+        if ((p = cborReserve(w, 1)) != NULL)
+            p[0] = major | value;
+    }
+    else if (value <= 0xFF)
+    {
+        if ((p = cborReserve(w, 2)) != NULL)
+        {
+            p[0] = major | 24;
+            p[1] = value;
+        }
+    }
+    else if (value <= 0xFFFF)
+    {
+        if ((p = cborReserve(w, 3)) != NULL)
+        {
+            p[0] = major | 25;
+            p[1] = value >> 8;
+            p[2] = value & 0xFF;
+        }
+    }
+    else
+    {
+        if ((p = cborReserve(w, 5)) != NULL)
+        {
+            p[0] = major | 26;
+            p[1] = value >> 24;
+            p[2] = (value >> 16) & 0xFF;
+            p[3] = (value >> 8) & 0xFF;
+            p[4] = value & 0xFF;
+        }
+    }
+}
+
+void cborBegin(cborWriter* w, uint8_t buffer[], uint16_t size)
+{
+    w->buffer = buffer;
+    w->size = size;
+    w->length = 0;
+    w->ok = true;
+}
+
+void cborUint(cborWriter* w, uint32_t value)
+{
+    cborHead(w, CBOR_UINT, value);
+}
+
+void cborInt(cborWriter* w, int32_t value)
+{
+    if (value >= 0)
+        cborHead(w, CBOR_UINT, value);
+    else
+        cborHead(w, CBOR_NEGINT, (uint32_t)(-(value + 1)));
+}
+
+void cborText(cborWriter* w, char* str)
+{
+    uint8_t* p;
+    uint16_t i, length = 0;
+    while (str[length] != '\0')
+        length++;
+    cborHead(w, CBOR_TEXT, length);
+    if ((p = cborReserve(w, length)) != NULL)
+    {
+        for (i = 0; i < length; i++)
+            p[i] = (uint8_t)str[i];
+    }
+}
+
+void cborBytes(cborWriter* w, uint8_t data[], uint16_t length)
+{
+    uint8_t* p;
+    uint16_t i;
+    cborHead(w, CBOR_BYTES, length);
+    if ((p = cborReserve(w, length)) != NULL)
+    {
+        for (i = 0; i < length; i++)
+            p[i] = data[i];
+    }
+}
+
+void cborArray(cborWriter* w, uint16_t count)
+{
+    cborHead(w, CBOR_ARRAY, count);
+}
+
+void cborMap(cborWriter* w, uint16_t count)
+{
+    cborHead(w, CBOR_MAP, count);
+}
+
+void cborTag(cborWriter* w, uint32_t tag)
+{
+    cborHead(w, CBOR_TAG, tag);
+}
+
+void cborBool(cborWriter* w, bool value)
+{
+    uint8_t* p;
+    if ((p = cborReserve(w, 1)) != NULL)
+        p[0] = value ? CBOR_TRUE : CBOR_FALSE;
+}
+
+void cborNull(cborWriter* w)
+{
+    uint8_t* p;
+    if ((p = cborReserve(w, 1)) != NULL)
+        p[0] = CBOR_NULL;
+}
+
+// Fixed-point value mantissa * 10^exponent, e.g. 234, -1 for 23.4
+void cborDecimal(cborWriter* w, int32_t mantissa, int8_t exponent)
+{
+    cborTag(w, CBOR_TAG_DECIMAL);
+    cborArray(w, 2);
+    cborInt(w, exponent);
+    cborInt(w, mantissa);
+}
+
+// Returns the encoded size, 0 if the items did not fit
+uint16_t cborEnd(cborWriter* w)
+{
+    if (!w->ok)
+        return 0;
+    return w->length;
+}
@@ -0,0 +1,50 @@
+// CBOR Encoder Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef CBOR_H_
+#define CBOR_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define CBOR_TAG_DECIMAL    4       // [exponent, mantissa] decimal fraction (RFC 8949 3.4.4)
+
+// Writes CBOR items straight into a TX buffer
+// A NULL buffer only measures, so a PUBLISH can be sized before it is built
+typedef struct _cborWriter
+{
+    uint8_t* buffer;            // next item position base, or NULL
+    uint16_t size;              // room in buffer
+    uint16_t length;            // bytes written (or measured)
+    bool ok;                    // false once an item did not fit
+} cborWriter;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void cborBegin(cborWriter* w, uint8_t buffer[], uint16_t size);
+void cborUint(cborWriter* w, uint32_t value);
+void cborInt(cborWriter* w, int32_t value);
+void cborText(cborWriter* w, char* str);
+void cborBytes(cborWriter* w, uint8_t data[], uint16_t length);
+void cborArray(cborWriter* w, uint16_t count);
+void cborMap(cborWriter* w, uint16_t count);
+void cborTag(cborWriter* w, uint32_t tag);
+void cborBool(cborWriter* w, bool value);
+void cborNull(cborWriter* w);
+void cborDecimal(cborWriter* w, int32_t mantissa, int8_t exponent);
+uint16_t cborEnd(cborWriter* w);
+
+#endif
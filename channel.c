@@ -0,0 +1,318 @@
+// Sensor Channel Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Registry of the inputs a board publishes. Each channel has a topic, a
+// conversion (the dspFilter calibration and filter) and a report policy;
+// analog channels also have an ADC input and a sample rate. channelStart()
+// gives every analog input a step (slot) of the SS0 burst, so all of them
+// are sampled together by the one ADC trigger timer. channelService() is
+// called on EVENT_SAMPLE: for each ADC block (one second) an analog
+// channel averages the bursts down to its rate (16 bursts at 4 Hz: 4 means
+// of 4) and feeds them to its filter, and a digital channel is read once.
+// The filter output then goes through the report policy, and channels whose
+// report fired are returned one at a time by channelNextDue() so that the
+// caller can publish them as its connection allows.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "adc.h"
+#include "channel.h"
+#include "dsp.h"
+#include "event.h"
+#include "report.h"
+#include "stats.h"
+#include "Timer.h"
+#include "uart0.h"
+
+#define CHANNEL_DIGITAL_MS  1000    // digital period when no analog channel runs the ADC
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _channel
+{
+    char* topic;
+    uint8_t type;
+    uint8_t input;                  // AINn or ADC_INPUT_TEMP
+    uint8_t slot;                   // SS0 step, index in an ADC burst
+    uint8_t rate;                   // filter samples per second, divides ADC_SAMPLE_RATE
+    int8_t exponent;                // value = reported integer * 10^exponent
+    _channelRead read;
+    dspFilter filter;
+    uint8_t report;
+    uint16_t lastRaw;
+} channel;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+channel channels[MAX_CHANNELS];
+uint8_t channelTotal = 0;
+uint8_t channelDue = 0;             // bit per channel with a report to publish
+bool channelDigitalDue = false;     // set by the digital timer
+channelStats channelCounters;
+const char* const channelStatNames[] = {"blocks", "samples", "reports"};
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static uint8_t channelAdd(char* topic, uint8_t type)
+{
+    channel* c;
+    uint8_t report;
+    if (channelTotal >= MAX_CHANNELS)
+        return CHANNEL_NONE;
+    report = reportAdd(topic, 0, 0, 0, 0);
+    if (report == REPORT_NONE)
+        return CHANNEL_NONE;
+    c = &channels[channelTotal];
+    c->topic = topic;
+    c->type = type;
+    c->input = 0;
+    c->slot = 0;
+    c->rate = 1;
+    c->exponent = 0;
+    c->read = NULL;
+    c->report = report;
+    c->lastRaw = 0;
+    // raw counts until the caller sets a calibration
+    dspInit(&c->filter, 1, 0, 0);
+    return channelTotal++;
+}
+
+// Registers an analog input (AINn or ADC_INPUT_TEMP) sampled rate times a
+// second, rounded down to a divisor of ADC_SAMPLE_RATE
+// Returns the channel or CHANNEL_NONE if the registry or ADC is full
+uint8_t channelAddAnalog(char* topic, uint8_t input, uint8_t rate, int8_t exponent)
+{
+    uint8_t i, ch, analog = 0;
+    for (i = 0; i < channelTotal; i++)
+    {
+        if (channels[i].type == CHANNEL_ANALOG)
+            analog++;
+    }
+    if (analog >= ADC_MAX_INPUTS)
+        return CHANNEL_NONE;
+    ch = channelAdd(topic, CHANNEL_ANALOG);
+    if (ch == CHANNEL_NONE)
+        return CHANNEL_NONE;
+    if (rate == 0)
+        rate = 1;
+    if (rate > ADC_SAMPLE_RATE)
+        rate = ADC_SAMPLE_RATE;
+    while (ADC_SAMPLE_RATE % rate != 0)
+        rate--;
+    channels[ch].input = input;
+    channels[ch].rate = rate;
+    channels[ch].exponent = exponent;
+    return ch;
+}
+
+// Registers a digital input read once per second by read()
+uint8_t channelAddDigital(char* topic, _channelRead read)
+{
+    uint8_t ch = channelAdd(topic, CHANNEL_DIGITAL);
+    if (ch != CHANNEL_NONE)
+        channels[ch].read = read;
+    return ch;
+}
+
+void channelSetReport(uint8_t ch, int32_t absDeadband, uint16_t relDeadband, uint32_t minIntervalMs, uint32_t maxIntervalMs)
+{
+    reportPolicy* policy = reportGetPolicy(channels[ch].report);
+    policy->absDeadband = absDeadband;
+    policy->relDeadband = relDeadband;
+    policy->minIntervalMs = minIntervalMs;
+    policy->maxIntervalMs = maxIntervalMs;
+}
+
+static void channelDigitalTick(void* context)
+{
+    channelDigitalDue = true;
+    eventPost(EVENT_SAMPLE, 0);
+}
+
+// Assigns SS0 steps to the analog channels and starts the ADC
+// Returns false if there is no analog channel
+bool channelStart()
+{
+    uint8_t inputs[ADC_MAX_INPUTS];
+    uint8_t i, count = 0;
+    statsRegister("sensor", channelStatNames, (uint32_t*)&channelCounters, STATS_COUNT(channelCounters), NULL);
+    for (i = 0; i < channelTotal; i++)
+    {
+        if (channels[i].type == CHANNEL_ANALOG)
+        {
+            channels[i].slot = count;
+            inputs[count++] = channels[i].input;
+        }
+    }
+    if (adcStart(inputs, count))
+        return true;
+    // without analog channels the ADC never delivers a block
+    startPeriodicTimer(channelDigitalTick, NULL, CHANNEL_DIGITAL_MS);
+    return false;
+}
+
+static void channelSample(uint8_t ch, uint16_t block[], uint32_t now)
+{
+    channel* c = &channels[ch];
+    uint16_t samples[ADC_BLOCK_SIZE];
+    uint8_t stride = adcInputCount();
+    uint8_t group = ADC_SAMPLE_RATE / c->rate;
+    uint8_t i;
+
+    if (c->type == CHANNEL_ANALOG)
+    {
+        for (i = 0; i < ADC_BLOCK_SIZE; i++)
+            samples[i] = block[i * stride + c->slot];
+        for (i = 0; i + group <= ADC_BLOCK_SIZE; i += group)
+        {
+            c->lastRaw = dspMean(&samples[i], group);
+            dspProcess(&c->filter, c->lastRaw);
+            channelCounters.samples++;
+        }
+    }
+    else
+    {
+        c->lastRaw = (*c->read)();
+        dspProcess(&c->filter, c->lastRaw);
+        channelCounters.samples++;
+    }
+
+    if (reportSample(c->report, dspOutput(&c->filter), now))
+    {
+        channelDue |= 1 << ch;
+        channelCounters.reports++;
+    }
+}
+
+// Samples every channel once a block is ready
+// Returns true if the channels were sampled
+bool channelService(uint32_t now)
+{
+    uint16_t* block = adcGetBlock();
+    uint8_t i;
+
+    if (block == NULL && !channelDigitalDue)
+        return false;
+    channelDigitalDue = false;
+    channelCounters.blocks++;
+    for (i = 0; i < channelTotal; i++)
+    {
+        if (block != NULL || channels[i].type == CHANNEL_DIGITAL)
+            channelSample(i, block, now);
+    }
+    return true;
+}
+
+// Returns the next channel whose report fired, or CHANNEL_NONE
+// The value to publish is channelValue()
+uint8_t channelNextDue()
+{
+    uint8_t ch;
+    for (ch = 0; ch < channelTotal; ch++)
+    {
+        if (channelDue & (1 << ch))
+        {
+            channelDue &= ~(1 << ch);
+            return ch;
+        }
+    }
+    return CHANNEL_NONE;
+}
+
+channelStats* channelGetStats()
+{
+    return &channelCounters;
+}
+
+uint8_t channelCount()
+{
+    return channelTotal;
+}
+
+uint8_t channelFind(char* topic)
+{
+    uint8_t ch, i;
+    for (ch = 0; ch < channelTotal; ch++)
+    {
+        for (i = 0; topic[i] != '\0' && topic[i] == channels[ch].topic[i]; i++);
+        if (topic[i] == channels[ch].topic[i])
+            return ch;
+    }
+    return CHANNEL_NONE;
+}
+
+char* channelTopic(uint8_t ch)
+{
+    return channels[ch].topic;
+}
+
+uint8_t channelType(uint8_t ch)
+{
+    return channels[ch].type;
+}
+
+uint8_t channelInput(uint8_t ch)
+{
+    return channels[ch].input;
+}
+
+uint8_t channelRate(uint8_t ch)
+{
+    return channels[ch].rate;
+}
+
+int8_t channelExponent(uint8_t ch)
+{
+    return channels[ch].exponent;
+}
+
+dspFilter* channelGetFilter(uint8_t ch)
+{
+    return &channels[ch].filter;
+}
+
+uint8_t channelReport(uint8_t ch)
+{
+    return channels[ch].report;
+}
+
+uint16_t channelLastRaw(uint8_t ch)
+{
+    return channels[ch].lastRaw;
+}
+
+// Last reported value, in units of 10^exponent
+int32_t channelValue(uint8_t ch)
+{
+    return reportValue(channels[ch].report);
+}
+
+// Last reported value in whole units, as the text payload
+char* channelText(uint8_t ch)
+{
+    int32_t value = channelValue(ch);
+    int8_t e;
+    for (e = channels[ch].exponent; e < 0; e++)
+        value /= 10;
+    for (; e > 0; e--)
+        value *= 10;
+    return itostring(value);
+}
@@ -0,0 +1,65 @@
+// Sensor Channel Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef CHANNEL_H_
+#define CHANNEL_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dsp.h"
+
+#define MAX_CHANNELS        8
+#define CHANNEL_NONE        0xFF
+
+// Channel types
+#define CHANNEL_ANALOG      0
+#define CHANNEL_DIGITAL     1
+
+// Reads a digital input, the result goes through the channel filter
+typedef uint16_t(*_channelRead)();
+
+// Counters registered with the stats library as "sensor"
+typedef struct _channelStats
+{
+    uint32_t blocks;                    // ADC blocks or digital ticks serviced
+    uint32_t samples;                   // values fed to the filters
+    uint32_t reports;                   // report policies that fired
+} channelStats;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint8_t channelAddAnalog(char* topic, uint8_t input, uint8_t rate, int8_t exponent);
+uint8_t channelAddDigital(char* topic, _channelRead read);
+void channelSetReport(uint8_t ch, int32_t absDeadband, uint16_t relDeadband, uint32_t minIntervalMs, uint32_t maxIntervalMs);
+bool channelStart();
+bool channelService(uint32_t now);
+uint8_t channelNextDue();
+channelStats* channelGetStats();
+
+uint8_t channelCount();
+uint8_t channelFind(char* topic);
+char* channelTopic(uint8_t ch);
+uint8_t channelType(uint8_t ch);
+uint8_t channelInput(uint8_t ch);
+uint8_t channelRate(uint8_t ch);
+int8_t channelExponent(uint8_t ch);
+dspFilter* channelGetFilter(uint8_t ch);
+uint8_t channelReport(uint8_t ch);
+uint16_t channelLastRaw(uint8_t ch);
+int32_t channelValue(uint8_t ch);
+char* channelText(uint8_t ch);
+
+#endif
@@ -0,0 +1,206 @@
+// Command Line Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Registry of the console commands. Each subsystem registers its commands
+// (name, minimum field count, handler, help text) at startup, and
+// cliDispatch() finds the handler of a parsed line with one hash of the
+// first field instead of comparing it with every name in turn. Names are
+// hashed (FNV-1a) when registered and kept in an open addressing table at
+// most half full, so a lookup is one hash, usually one probe and one
+// string compare to confirm. help lists the table in registration order,
+// a few lines at a time as the TX ring empties since the whole listing is
+// larger than the ring; help <command> shows one entry and any other help
+// topic goes to the handler set by cliSetHelpTopics().
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cli.h"
+#include "Timer.h"
+#include "uart0.h"
+
+#define CLI_NAME_WIDTH      12      // help column of the descriptions
+#define CLI_EMPTY           0       // table slot, else command index + 1
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _cliCommand
+{
+    const char* name;
+    uint32_t hash;
+    uint8_t minFields;              // including the command name
+    _cliHandler handler;
+    const char* help;
+} cliCommand;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+cliCommand cliCommands[MAX_COMMANDS];
+uint8_t cliCount = 0;
+uint8_t cliTable[CLI_TABLE_SIZE];
+_cliHandler cliHelpTopics = NULL;
+bool cliListing = false;            // help is writing the command list
+uint8_t cliListNext;                // next command it writes
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static uint32_t cliHash(const char* name)
+{
+    uint32_t hash = 2166136261;
+    while (*name != '\0')
+    {
+        hash ^= (uint8_t)*name++;
+        hash *= 16777619;
+    }
+    return hash;
+}
+
+// Returns the command called name, or NULL
+static cliCommand* cliFind(const char* name)
+{
+    uint32_t hash = cliHash(name);
+    uint8_t slot = hash & (CLI_TABLE_SIZE - 1);
+    cliCommand* command;
+    while (cliTable[slot] != CLI_EMPTY)
+    {
+        command = &cliCommands[cliTable[slot] - 1];
+        if (command->hash == hash && stringcmp(command->name, (char*)name))
+            return command;
+        slot = (slot + 1) & (CLI_TABLE_SIZE - 1);
+    }
+    return NULL;
+}
+
+static void cliShow(cliCommand* command)
+{
+    uint8_t i;
+    putsUart0((char*)command->name);
+    for (i = 0; command->name[i] != '\0'; i++);
+    for (; i < CLI_NAME_WIDTH; i++)
+        putcUart0(' ');
+    putsUart0((char*)command->help);
+    putsUart0("\n\r");
+}
+
+// Bytes cliShow() writes for command
+static uint16_t cliShowSize(cliCommand* command)
+{
+    uint16_t i, j;
+    for (i = 0; command->name[i] != '\0'; i++);
+    if (i < CLI_NAME_WIDTH)
+        i = CLI_NAME_WIDTH;
+    for (j = 0; command->help[j] != '\0'; j++);
+    return i + j + 2;
+}
+
+// Writes as many lines as the TX ring takes, then comes back later
+static void cliListStep(void* context)
+{
+    while (cliListNext < cliCount)
+    {
+        if (uart0TxSpace() < cliShowSize(&cliCommands[cliListNext]))
+        {
+            startOneshotTimer(cliListStep, NULL, CLI_HELP_MS);
+            return;
+        }
+        cliShow(&cliCommands[cliListNext++]);
+    }
+    cliListing = false;
+}
+
+static void cliHelp(USER_DATA* data)
+{
+    cliCommand* command;
+    if (cliListing)
+        return;
+    if (data->fieldcount < 2)
+    {
+        cliListing = true;
+        cliListNext = 0;
+        cliListStep(NULL);
+        return;
+    }
+    command = cliFind(getFieldString(data, 2));
+    if (command != NULL)
+        cliShow(command);
+    else if (cliHelpTopics != NULL)
+        (*cliHelpTopics)(data);
+}
+
+void initCli()
+{
+    uint8_t i;
+    for (i = 0; i < CLI_TABLE_SIZE; i++)
+        cliTable[i] = CLI_EMPTY;
+    cliCount = 0;
+    cliHelpTopics = NULL;
+    cliRegister("help", 1, cliHelp, "[command|inputs|outputs|subs]  this list, or one topic");
+}
+
+// name, handler and help must stay valid, they are not copied
+// minFields counts the command name, so 1 takes no arguments
+// Returns false if the table is full or the name is taken
+bool cliRegister(const char* name, uint8_t minFields, _cliHandler handler, const char* help)
+{
+    cliCommand* command;
+    uint8_t slot;
+    if (cliCount >= MAX_COMMANDS || cliFind(name) != NULL)
+        return false;
+    command = &cliCommands[cliCount];
+    command->name = name;
+    command->hash = cliHash(name);
+    command->minFields = minFields;
+    command->handler = handler;
+    command->help = help;
+    slot = command->hash & (CLI_TABLE_SIZE - 1);
+    while (cliTable[slot] != CLI_EMPTY)
+        slot = (slot + 1) & (CLI_TABLE_SIZE - 1);
+    cliTable[slot] = ++cliCount;
+    return true;
+}
+
+// help <topic> for a topic that is not a command
+void cliSetHelpTopics(_cliHandler handler)
+{
+    cliHelpTopics = handler;
+}
+
+// Runs the command of a line already split by parseFields()
+// Returns false if there is no such command or it lacks arguments
+bool cliDispatch(USER_DATA* data)
+{
+    cliCommand* command;
+    if (data->fieldcount == 0)
+        return false;
+    command = cliFind(getFieldString(data, 1));
+    if (command == NULL)
+    {
+        putsUart0("Unknown command, try help\n\r");
+        return false;
+    }
+    if (data->fieldcount < command->minFields)
+    {
+        putsUart0("Usage: ");
+        cliShow(command);
+        return false;
+    }
+    (*command->handler)(data);
+    return true;
+}
@@ -0,0 +1,38 @@
+// Command Line Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef CLI_H_
+#define CLI_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "uart0.h"
+
+#define MAX_COMMANDS        32
+#define CLI_TABLE_SIZE      64      // hash slots, power of 2, at least twice MAX_COMMANDS
+#define CLI_HELP_MS         5       // between help lines while the TX ring is full
+
+// Runs a command, fields 2 and up are its arguments
+typedef void(*_cliHandler)(USER_DATA* data);
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initCli();
+bool cliRegister(const char* name, uint8_t minFields, _cliHandler handler, const char* help);
+void cliSetHelpTopics(_cliHandler handler);
+bool cliDispatch(USER_DATA* data);
+
+#endif
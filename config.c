@@ -0,0 +1,416 @@
+// Configuration Store Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// One typed record holds what differs between boards: addresses, broker,
+// client id, keep-alive, subscribe QoS and the temperature report policy.
+// It lives in CONFIG_SLOTS EEPROM slots that are written in turn, each copy
+// with a sequence number, the record version and a CRC-32. A commit goes to
+// the slot after the newest one and only counts once it reads back with a
+// good CRC, so the previous copy stays valid until then and a reset halfway
+// through loses nothing; turning through the slots spreads the wear.
+// initConfig() loads the newest valid copy once at boot (defaults, with the
+// broker address of older firmware, if there is none). config set edits a
+// second copy, config commit saves it, and it takes effect on the next boot.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cli.h"
+#include "config.h"
+#include "EEPROM.h"
+#include "mqtt.h"
+#include "uart0.h"
+
+// Field types
+#define CONFIG_IP           0       // 4 octets, dotted decimal
+#define CONFIG_MAC          1       // 6 octets, hex with colons
+#define CONFIG_TEXT         2
+#define CONFIG_U8           3
+#define CONFIG_U16          4
+#define CONFIG_I16          5
+#define CONFIG_U32          6
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _configField
+{
+    char* name;
+    uint8_t type;
+    uint8_t offset;
+    int32_t min;                    // numbers only
+    int32_t max;
+} configField;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+const configField configFields[] =
+{
+    {"ip", CONFIG_IP, offsetof(configRecord, ip), 0, 0},
+    {"mask", CONFIG_IP, offsetof(configRecord, mask), 0, 0},
+    {"gateway", CONFIG_IP, offsetof(configRecord, gateway), 0, 0},
+    {"dns", CONFIG_IP, offsetof(configRecord, dns), 0, 0},
+    {"mac", CONFIG_MAC, offsetof(configRecord, mac), 0, 0},
+    {"broker", CONFIG_IP, offsetof(configRecord, brokerIp), 0, 0},
+    {"brokermac", CONFIG_MAC, offsetof(configRecord, brokerMac), 0, 0},
+    {"port", CONFIG_U16, offsetof(configRecord, brokerPort), 1, 65535},
+    {"client", CONFIG_TEXT, offsetof(configRecord, clientId), 0, 0},
+    {"keepalive", CONFIG_U16, offsetof(configRecord, keepAlive), 0, 65535},
+    {"version", CONFIG_U8, offsetof(configRecord, protocolLevel), 4, 5},
+    {"qos", CONFIG_U8, offsetof(configRecord, subscribeQos), 0, 2},
+    {"deadband", CONFIG_I16, offsetof(configRecord, reportDeadband), 0, 32767},
+    {"relative", CONFIG_U16, offsetof(configRecord, reportRelative), 0, 1000},
+    {"reportmin", CONFIG_U32, offsetof(configRecord, reportMinMs), 0, 86400000},
+    {"reportmax", CONFIG_U32, offsetof(configRecord, reportMaxMs), 0, 86400000},
+};
+#define CONFIG_FIELDS (sizeof(configFields) / sizeof(configFields[0]))
+
+configRecord config;                // loaded at boot, what the firmware runs with
+configRecord configNext;            // edited by config set, saved by config commit
+int8_t configSlot = -1;             // newest valid slot, -1 if none
+uint32_t configSequence = 0;        // of the newest valid slot
+bool configChanged = false;         // edited since the last commit
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// CRC-32 (IEEE), bitwise, a commit is rare
+static uint32_t configCrc(uint8_t data[], uint16_t size)
+{
+    uint32_t crc = 0xFFFFFFFF;
+    uint16_t i;
+    uint8_t bit;
+    for (i = 0; i < size; i++)
+    {
+        crc ^= data[i];
+        for (bit = 0; bit < 8; bit++)
+            crc = (crc >> 1) ^ (0xEDB88320 & -(crc & 1));
+    }
+    return ~crc;
+}
+
+static bool configValid(configRecord* record)
+{
+    return record->version == CONFIG_VERSION && record->size == sizeof(configRecord)
+        && record->crc == configCrc((uint8_t*)record, offsetof(configRecord, crc));
+}
+
+static uint16_t configAddress(uint8_t slot)
+{
+    return EEPROM_CONFIG + slot * CONFIG_SLOT_WORDS;
+}
+
+// Reads the newest valid slot into record, returns the slot or -1
+static int8_t configLoad(configRecord* record)
+{
+    configRecord copy;
+    int8_t newest = -1;
+    uint8_t i;
+    for (i = 0; i < CONFIG_SLOTS; i++)
+    {
+        readEepromBlock(configAddress(i), (uint8_t*)&copy, sizeof(copy));
+        if (configValid(&copy) && (newest < 0 || (int32_t)(copy.sequence - record->sequence) > 0))
+        {
+            *record = copy;
+            newest = i;
+        }
+    }
+    return newest;
+}
+
+// What a board without a saved record runs with
+static void configDefaults(configRecord* record)
+{
+    mqttConnectOptions* options = mqttGetConnectOptions();
+    uint32_t word;
+    uint8_t i;
+    for (i = 0; i < sizeof(configRecord); i++)
+        ((uint8_t*)record)[i] = 0;
+    record->ip[0] = 192;
+    record->ip[1] = 168;
+    record->ip[2] = 1;
+    record->ip[3] = 141;
+    for (i = 0; i < 3; i++)
+        record->mask[i] = 255;
+    for (i = 0; i < 6; i++)
+        record->mac[i] = i + 2;
+    record->mac[5] = 141;
+    // older firmware kept only the broker address, one octet per word
+    for (i = 0; i < 4; i++)
+    {
+        word = readEeprom(EEPROM_MQTT_BROKER_IP + i);
+        record->brokerIp[i] = word <= 255 ? word : 0;
+    }
+    record->brokerPort = 1883;
+    // the router of the bench network
+    record->brokerMac[0] = 0x8c;
+    record->brokerMac[1] = 0x16;
+    record->brokerMac[2] = 0x45;
+    record->brokerMac[3] = 0xd7;
+    record->brokerMac[4] = 0x51;
+    record->brokerMac[5] = 0x2f;
+    for (i = 0; i < MQTT_MAX_CLIENT_ID - 1 && options->clientId[i] != '\0'; i++)
+        record->clientId[i] = options->clientId[i];
+    record->keepAlive = options->keepAlive;
+    record->protocolLevel = options->protocolLevel;
+    record->subscribeQos = 0;
+    // report a 0.5 C change, at most every 10 s, at least every 50 s
+    record->reportDeadband = 5;
+    record->reportRelative = 0;
+    record->reportMinMs = 10000;
+    record->reportMaxMs = 50000;
+}
+
+// The record the firmware booted with
+configRecord* configGet()
+{
+    return &config;
+}
+
+// The copy the next configCommit() saves
+configRecord* configEdit()
+{
+    configChanged = true;
+    return &configNext;
+}
+
+// Saves the edited copy in the slot after the newest one
+// Returns false if it did not read back intact, the newest slot is unchanged
+bool configCommit()
+{
+    configRecord check;
+    uint8_t slot = configSlot < 0 ? 0 : (configSlot + 1) % CONFIG_SLOTS;
+    configNext.sequence = configSequence + 1;
+    configNext.version = CONFIG_VERSION;
+    configNext.size = sizeof(configRecord);
+    configNext.crc = configCrc((uint8_t*)&configNext, offsetof(configRecord, crc));
+    writeEepromBlock(configAddress(slot), (uint8_t*)&configNext, sizeof(configNext));
+    readEepromBlock(configAddress(slot), (uint8_t*)&check, sizeof(check));
+    if (!configValid(&check) || check.sequence != configNext.sequence)
+        return false;
+    configSlot = slot;
+    configSequence = configNext.sequence;
+    configChanged = false;
+    return true;
+}
+
+static const configField* configFind(char* name)
+{
+    uint8_t i;
+    for (i = 0; i < CONFIG_FIELDS; i++)
+    {
+        if (stringcmp(configFields[i].name, name))
+            return &configFields[i];
+    }
+    return NULL;
+}
+
+static void configPutHex(uint8_t value)
+{
+    static const char hex[] = "0123456789abcdef";
+    putcUart0(hex[value >> 4]);
+    putcUart0(hex[value & 15]);
+}
+
+// Two hex digits at most, -1 if not hex
+static int16_t configHex(char* s)
+{
+    int16_t value = 0;
+    uint8_t i;
+    for (i = 0; s[i] != '\0'; i++)
+    {
+        if (i == 2)
+            return -1;
+        if (s[i] >= '0' && s[i] <= '9')
+            value = value * 16 + s[i] - '0';
+        else if (s[i] >= 'a' && s[i] <= 'f')
+            value = value * 16 + s[i] - 'a' + 10;
+        else
+            return -1;
+    }
+    return i == 0 ? -1 : value;
+}
+
+static void configShow(const configField* field)
+{
+    uint8_t* p = (uint8_t*)&configNext + field->offset;
+    uint8_t i;
+    putsUart0(field->name);
+    putsUart0(" ");
+    switch (field->type)
+    {
+    case CONFIG_IP:
+        for (i = 0; i < 4; i++)
+        {
+            if (i > 0)
+                putcUart0('.');
+            putsUart0(itostring(p[i]));
+        }
+        break;
+    case CONFIG_MAC:
+        for (i = 0; i < 6; i++)
+        {
+            if (i > 0)
+                putcUart0(':');
+            configPutHex(p[i]);
+        }
+        break;
+    case CONFIG_TEXT:
+        putsUart0((char*)p);
+        break;
+    case CONFIG_U8:
+        putsUart0(itostring(*p));
+        break;
+    case CONFIG_U16:
+        putsUart0(itostring(*(uint16_t*)p));
+        break;
+    case CONFIG_I16:
+        putsUart0(itostring(*(int16_t*)p));
+        break;
+    case CONFIG_U32:
+        putsUart0(itostring(*(uint32_t*)p));
+        break;
+    }
+    putsUart0("\n\r");
+}
+
+// config set <name> <value>, the value starts at field 4
+static bool configSet(const configField* field, USER_DATA* data)
+{
+    uint8_t* p = (uint8_t*)&configNext + field->offset;
+    uint8_t octets[6];
+    int32_t value;
+    int16_t hex;
+    uint8_t i;
+
+    switch (field->type)
+    {
+    case CONFIG_IP:
+        if (data->fieldcount < 7)
+            return false;
+        for (i = 0; i < 4; i++)
+        {
+            value = getFieldInteger(data, 4 + i);
+            if (data->fieldType[3 + i] != 'n' || value > 255)
+                return false;
+            octets[i] = value;
+        }
+        for (i = 0; i < 4; i++)
+            p[i] = octets[i];
+        break;
+    case CONFIG_MAC:
+        if (data->fieldcount < 9)
+            return false;
+        for (i = 0; i < 6; i++)
+        {
+            hex = configHex(getFieldString(data, 4 + i));
+            if (hex < 0)
+                return false;
+            octets[i] = hex;
+        }
+        for (i = 0; i < 6; i++)
+            p[i] = octets[i];
+        break;
+    case CONFIG_TEXT:
+        if (data->fieldcount < 4)
+            return false;
+        for (i = 0; i < MQTT_MAX_CLIENT_ID - 1 && getFieldString(data, 4)[i] != '\0'; i++)
+            p[i] = getFieldString(data, 4)[i];
+        for (; i < MQTT_MAX_CLIENT_ID; i++)
+            p[i] = '\0';
+        break;
+    default:
+        if (data->fieldcount < 4 || data->fieldType[3] != 'n')
+            return false;
+        value = getFieldInteger(data, 4);
+        if (value < field->min || value > field->max)
+            return false;
+        if (field->type == CONFIG_U8)
+            *p = value;
+        else if (field->type == CONFIG_U16)
+            *(uint16_t*)p = value;
+        else if (field->type == CONFIG_I16)
+            *(int16_t*)p = value;
+        else
+            *(uint32_t*)p = value;
+        break;
+    }
+    return true;
+}
+
+// config [get <name>|set <name> <value>|commit|revert|defaults]
+static void configCommand(USER_DATA* data)
+{
+    char* arg = data->fieldcount >= 2 ? getFieldString(data, 2) : "";
+    const configField* field = data->fieldcount >= 3 ? configFind(getFieldString(data, 3)) : NULL;
+    uint8_t i;
+
+    if (stringcmp("get", arg) && field != NULL)
+        configShow(field);
+    else if (stringcmp("set", arg) && field != NULL)
+    {
+        if (configSet(field, data))
+            configChanged = true;
+        else
+            putsUart0("Bad value\n\r");
+    }
+    else if (stringcmp("commit", arg))
+        putsUart0(configCommit() ? "Saved, reboot to apply\n\r" : "EEPROM write failed, nothing saved\n\r");
+    else if (stringcmp("revert", arg))
+    {
+        if (configLoad(&configNext) < 0)
+            configDefaults(&configNext);
+        configChanged = false;
+    }
+    else if (stringcmp("defaults", arg))
+    {
+        configDefaults(&configNext);
+        configChanged = true;
+    }
+    else
+    {
+        putsUart0("Config v");
+        putsUart0(itostring(CONFIG_VERSION));
+        if (configSlot < 0)
+            putsUart0(", not saved");
+        else
+        {
+            putsUart0(", slot ");
+            putsUart0(itostring(configSlot));
+            putsUart0(" sequence ");
+            putsUart0(itostring(configSequence));
+        }
+        if (configChanged)
+            putsUart0(", uncommitted changes");
+        putsUart0("\n\r");
+        for (i = 0; i < CONFIG_FIELDS; i++)
+            configShow(&configFields[i]);
+    }
+}
+
+// After initEeprom() and initCli(), loads the record and registers the config command
+void initConfig()
+{
+    configSlot = configLoad(&config);
+    if (configSlot < 0)
+        configDefaults(&config);
+    else
+        configSequence = config.sequence;
+    configNext = config;
+    cliRegister("config", 1, configCommand, "[get <name>|set <name> <value>|commit|revert|defaults]");
+}
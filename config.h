@@ -0,0 +1,61 @@
+// Configuration Store Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef CONFIG_H_
+#define CONFIG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "mqtt.h"
+
+#define CONFIG_VERSION      2       // bump when configRecord changes
+#define CONFIG_SLOTS        4       // written in turn, the newest valid one is loaded
+#define CONFIG_SLOT_WORDS   32      // EEPROM words per slot
+
+// Laid out without padding, the CRC covers every byte before it
+typedef struct _configRecord
+{
+    uint32_t sequence;                  // commits, the highest valid slot wins
+    uint16_t version;                   // CONFIG_VERSION
+    uint16_t size;                      // sizeof(configRecord)
+    uint8_t ip[4];
+    uint8_t mask[4];
+    uint8_t gateway[4];
+    uint8_t dns[4];
+    uint8_t mac[6];
+    uint16_t brokerPort;
+    uint8_t brokerIp[4];
+    uint8_t brokerMac[6];               // broker, or the gateway to it
+    uint8_t spare[2];                   // keeps the fields below aligned
+    char clientId[MQTT_MAX_CLIENT_ID];
+    uint16_t keepAlive;                 // seconds
+    uint8_t protocolLevel;              // 4 = MQTT 3.1.1, 5 = MQTT 5.0
+    uint8_t subscribeQos;               // granted QoS asked for by subscribe
+    int16_t reportDeadband;             // temperature, tenths of a degree
+    uint16_t reportRelative;            // temperature, tenths of a percent
+    uint32_t reportMinMs;
+    uint32_t reportMaxMs;
+    uint32_t crc;                       // CRC-32 of the fields above
+} configRecord;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initConfig();
+configRecord* configGet();
+configRecord* configEdit();
+bool configCommit();
+
+#endif
@@ -0,0 +1,214 @@
+// Fixed-Point Sensor DSP Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Calibrates and filters raw ADC counts without floating point. The M4F FPU
+// is single precision only, so the old double formula ran in software
+// emulation on every sample. Here a sample costs one multiply, one shift and
+// a saturating add: value = offset + raw * gain / 2^shift, then one of
+//   moving average   running Q31 sum of the last N values (QADD)
+//   IIR              Q15 weight alpha, state kept with 15 fraction bits
+//   median           sorted copy of the last N values, rejects spikes
+// Results saturate to 16 bits (SSAT) instead of wrapping. Block means add
+// two samples per instruction (SMLAD). With the TI compiler the Cortex-M4
+// DSP instructions are used through intrinsics; other compilers get C
+// equivalents with the same results, which is what tools/dsp_ref.py models.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "dsp.h"
+
+#if defined(__TI_ARM__)
+#define DSP_SMLAD(x, y, acc)    _smlad(x, y, acc)
+#define DSP_QADD(a, b)          _sadd(a, b)
+#define DSP_SSAT16(x)           _ssata(x, 0, 16)
+#else
+#define DSP_SMLAD(x, y, acc)    dspSmlad(x, y, acc)
+#define DSP_QADD(a, b)          dspQadd(a, b)
+#define DSP_SSAT16(x)           dspSsat16(x)
+
+// acc + x.lo * y.lo + x.hi * y.hi, halves signed
+static int32_t dspSmlad(uint32_t x, uint32_t y, int32_t acc)
+{
+    return acc + (int16_t)x * (int16_t)y + (int16_t)(x >> 16) * (int16_t)(y >> 16);
+}
+
+static int32_t dspQadd(int32_t a, int32_t b)
+{
+    int64_t sum = (int64_t)a + b;
+    if (sum > INT32_MAX)
+        return INT32_MAX;
+    if (sum < INT32_MIN)
+        return INT32_MIN;
+    return sum;
+}
+
+static int32_t dspSsat16(int32_t x)
+{
+    if (x > INT16_MAX)
+        return INT16_MAX;
+    if (x < INT16_MIN)
+        return INT16_MIN;
+    return x;
+}
+#endif
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// gain is a Q15 fraction scaled by 2^(shift-15); the temperature sensor is
+// tenths = 1475 - raw * 750 * 3.3 / 4096, i.e. dspInit(f, -19800, 15, 1475)
+void dspInit(dspFilter* filter, q15_t gain, uint8_t shift, int16_t offset)
+{
+    filter->gain = gain;
+    filter->shift = shift;
+    filter->offset = offset;
+    filter->type = DSP_NONE;
+    filter->length = 1;
+    filter->alpha = 0x7FFF;
+    filter->output = 0;
+    dspReset(filter);
+}
+
+void dspSetAverage(dspFilter* filter, uint8_t length)
+{
+    filter->type = DSP_AVERAGE;
+    filter->length = (length == 0 || length > DSP_MAX_WINDOW) ? DSP_MAX_WINDOW : length;
+    dspReset(filter);
+}
+
+// alpha is the Q15 weight of a new sample, 0x7FFF follows the input
+void dspSetIir(dspFilter* filter, q15_t alpha)
+{
+    filter->type = DSP_IIR;
+    filter->alpha = alpha > 0 ? alpha : 1;
+    dspReset(filter);
+}
+
+void dspSetMedian(dspFilter* filter, uint8_t length)
+{
+    filter->type = DSP_MEDIAN;
+    filter->length = (length == 0 || length > DSP_MAX_WINDOW) ? DSP_MAX_WINDOW : length;
+    dspReset(filter);
+}
+
+void dspSetNone(dspFilter* filter)
+{
+    filter->type = DSP_NONE;
+    dspReset(filter);
+}
+
+// Forgets the history, the next sample restarts the filter
+void dspReset(dspFilter* filter)
+{
+    filter->index = 0;
+    filter->count = 0;
+    filter->sum = 0;
+    filter->state = 0;
+}
+
+q15_t dspCalibrate(dspFilter* filter, uint16_t raw)
+{
+    int32_t scaled = (int32_t)raw * filter->gain;
+    if (filter->shift > 0)
+        scaled = (scaled + (1 << (filter->shift - 1))) >> filter->shift;
+    return DSP_SSAT16(DSP_QADD(scaled, filter->offset));
+}
+
+// Rounded quotient, halves away from zero
+static q15_t dspDivide(q31_t sum, uint8_t count)
+{
+    if (sum < 0)
+        return DSP_SSAT16((sum - count / 2) / count);
+    return DSP_SSAT16((sum + count / 2) / count);
+}
+
+static q15_t dspMedian(dspFilter* filter)
+{
+    q15_t sorted[DSP_MAX_WINDOW];
+    q15_t v;
+    uint8_t i, j;
+    // insertion sort, the window is at most 16 values
+    for (i = 0; i < filter->count; i++)
+    {
+        v = filter->window[i];
+        for (j = i; j > 0 && sorted[j-1] > v; j--)
+            sorted[j] = sorted[j-1];
+        sorted[j] = v;
+    }
+    if (filter->count & 1)
+        return sorted[filter->count / 2];
+    return ((int32_t)sorted[filter->count / 2 - 1] + sorted[filter->count / 2]) / 2;
+}
+
+// Runs one raw sample through calibration and the filter
+q15_t dspProcess(dspFilter* filter, uint16_t raw)
+{
+    q15_t x = dspCalibrate(filter, raw);
+    q15_t old;
+
+    switch (filter->type)
+    {
+    case DSP_AVERAGE:
+        old = filter->count == filter->length ? filter->window[filter->index] : 0;
+        if (filter->count < filter->length)
+            filter->count++;
+        filter->window[filter->index] = x;
+        filter->index = (filter->index + 1) % filter->length;
+        filter->sum = DSP_QADD(filter->sum, (int32_t)x - old);
+        filter->output = dspDivide(filter->sum, filter->count);
+        break;
+    case DSP_IIR:
+        if (filter->count == 0)
+        {
+            filter->state = (q31_t)x << 15;
+            filter->count = 1;
+        }
+        else
+            filter->state = DSP_QADD(filter->state, ((int32_t)x - filter->output) * filter->alpha);
+        filter->output = DSP_SSAT16((filter->state + (1 << 14)) >> 15);
+        break;
+    case DSP_MEDIAN:
+        if (filter->count < filter->length)
+            filter->count++;
+        filter->window[filter->index] = x;
+        filter->index = (filter->index + 1) % filter->length;
+        filter->output = dspMedian(filter);
+        break;
+    default:
+        filter->output = x;
+        break;
+    }
+    return filter->output;
+}
+
+// Last value returned by dspProcess()
+q15_t dspOutput(dspFilter* filter)
+{
+    return filter->output;
+}
+
+// Rounded mean of raw counts below 0x8000, two samples per SMLAD
+uint16_t dspMean(uint16_t x[], uint8_t count)
+{
+    int32_t sum = 0;
+    uint8_t i;
+    if (count == 0)
+        return 0;
+    for (i = 0; i + 1 < count; i += 2)
+        sum = DSP_SMLAD(x[i] | ((uint32_t)x[i+1] << 16), 0x00010001, sum);
+    if (i < count)
+        sum += x[i];
+    return (sum + count / 2) / count;
+}
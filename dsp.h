@@ -0,0 +1,64 @@
+// Fixed-Point Sensor DSP Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef DSP_H_
+#define DSP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define DSP_MAX_WINDOW      16      // samples kept by the average and median filters
+
+// Filter types
+#define DSP_NONE            0       // calibration only
+#define DSP_AVERAGE         1       // moving average of the last N samples
+#define DSP_IIR             2       // y += alpha * (x - y)
+#define DSP_MEDIAN          3       // median of the last N samples
+
+typedef int16_t q15_t;
+typedef int32_t q31_t;
+
+// One per channel: raw ADC counts in, calibrated and filtered value out
+typedef struct _dspFilter
+{
+    q15_t gain;                     // value = offset + raw * gain / 2^shift
+    uint8_t shift;
+    int16_t offset;
+    uint8_t type;
+    uint8_t length;                 // window of DSP_AVERAGE and DSP_MEDIAN
+    q15_t alpha;                    // DSP_IIR weight of a new sample
+    q15_t window[DSP_MAX_WINDOW];
+    uint8_t index;
+    uint8_t count;
+    q31_t sum;                      // DSP_AVERAGE running sum of the window
+    q31_t state;                    // DSP_IIR output in Q15 fraction bits
+    q15_t output;
+} dspFilter;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void dspInit(dspFilter* filter, q15_t gain, uint8_t shift, int16_t offset);
+void dspSetAverage(dspFilter* filter, uint8_t length);
+void dspSetIir(dspFilter* filter, q15_t alpha);
+void dspSetMedian(dspFilter* filter, uint8_t length);
+void dspSetNone(dspFilter* filter);
+void dspReset(dspFilter* filter);
+q15_t dspCalibrate(dspFilter* filter, uint16_t raw);
+q15_t dspProcess(dspFilter* filter, uint16_t raw);
+q15_t dspOutput(dspFilter* filter);
+uint16_t dspMean(uint16_t x[], uint8_t count);
+
+#endif
@@ -31,6 +31,15 @@
 #include "gpio.h"
 #include "spi0.h"
 #include "EEPROM.h"
+#include "mqtt.h"
+#include "alias.h"
+#include "prop.h"
+#include "keepalive.h"
+#include "capture.h"
+#include "event.h"
+#include "prof.h"
+#include "stats.h"
+#include "trace.h"
 
 // Pins
 #define CS PORTA,3
@@ -55,6 +64,8 @@
 #define ERXWRPTL    0x0E
 #define ERXWRPTH    0x0F
 #define EIE         0x1B
+#define PKTIE   0x40
+#define INTIE   0x80
 #define EIR         0x1C
 #define RXERIF  0x01
 #define TXERIF  0x02
@@ -133,6 +144,8 @@ uint8_t ipSubnetMask[IP_ADD_LENGTH] = {255,255,255,0};
 uint8_t ipGwAddress[IP_ADD_LENGTH] = {0,0,0,0};
 uint8_t DNSAddress[IP_ADD_LENGTH] = {0,0,0,0};
 uint8_t MqttBrkipAddress[IP_ADD_LENGTH] = {0,0,0,0};
+uint8_t MqttBrkMacAddress[HW_ADD_LENGTH] = {0x8c,0x16,0x45,0xd7,0x51,0x2f}; // broker, or the gateway to it
+uint16_t MqttBrkPort = 1883;
 uint16_t src_prt;
 bool    mqttEnabled = false;
 bool EtherDhcp = false;
@@ -141,6 +154,11 @@ bool AvdSYN = true;
 uint8_t DhcpIpaddress[4];
 uint8_t DhcpipGwAddress[4];
 
+etherStats etherCounters;
+tcpStats tcpCounters;
+const char* const etherStatNames[] = {"rx", "tx", "rx_overflows", "tx_aborts", "tx_errors", "ip_checksum_errors"};
+const char* const tcpStatNames[] = {"syns", "segments", "acks", "fins"};
+
 // ------------------------------------------------------------------------------
 //  Structures
 // ------------------------------------------------------------------------------
@@ -472,6 +490,9 @@ void etherInit(uint16_t mode)
     etherWritePhy(PHLCON, 0x0472);
     // enable reception
     etherSetReg(ECON1, RXEN);
+
+    statsRegister("ether", etherStatNames, (uint32_t*)&etherCounters, STATS_COUNT(etherCounters), NULL);
+    statsRegister("tcp", tcpStatNames, (uint32_t*)&tcpCounters, STATS_COUNT(tcpCounters), NULL);
 }
 
 // Returns true if link is up
@@ -480,19 +501,58 @@ bool etherIsLinkUp()
     return (etherReadPhy(PHSTAT1) & LSTAT) != 0;
 }
 
+etherStats* etherGetStats()
+{
+    return &etherCounters;
+}
+
+tcpStats* tcpGetStats()
+{
+    return &tcpCounters;
+}
+
 // Returns TRUE if packet received
 bool etherIsDataAvailable()
 {
     return ((etherReadReg(EIR) & PKTIF) != 0);
 }
 
+// Lets the ENC28J60 INT pin (PC6) raise EVENT_ETHER_RX for received packets
+void etherEnableInterrupt()
+{
+    etherSetReg(EIE, INTIE | PKTIE);
+    // INT stays low while packets are waiting, so a level interrupt never
+    // misses one that arrives while the previous ones are being read
+    selectPinInterruptLowLevel(INT);
+    enablePinInterrupt(INT);
+    NVIC_EN0_R |= 1 << (INT_GPIOC-16);
+}
+
+// Called once the EVENT_ETHER_RX handler has read every waiting packet
+void etherAckInterrupt()
+{
+    enablePinInterrupt(INT);
+}
+
+// GPIO port C interrupt, masked until etherAckInterrupt()
+void etherIsr()
+{
+    TRACE(TRACE_ISR_BEGIN, TRACE_VECTOR_ETHER);
+    disablePinInterrupt(INT);
+    eventPostFromIsr(EVENT_ETHER_RX, 0);
+    TRACE(TRACE_ISR_END, 0);
+}
+
 // Returns true if rx buffer overflowed after correcting the problem
 bool etherIsOverflow()
 {
     bool err;
     err = (etherReadReg(EIR) & RXERIF) != 0;
     if (err)
+    {
         etherClearReg(EIR, RXERIF);
+        etherCounters.rxOverflows++;
+    }
     return err;
 }
 
@@ -539,6 +599,9 @@ uint16_t etherGetPacket(uint8_t packet[], uint16_t maxSize)
 
     // decrement packet counter so that PKTIF is maintained correctly
     etherSetReg(ECON2, PKTDEC);
+    etherCounters.rxFrames++;
+    captureFrame(CAPTURE_RX, packet, size);
+    TRACE(TRACE_ETHER_RX, size);
 
     return size;
 }
@@ -547,6 +610,9 @@ uint16_t etherGetPacket(uint8_t packet[], uint16_t maxSize)
 bool etherPutPacket(uint8_t packet[], uint16_t size)
 {
     uint16_t i;
+    captureFrame(CAPTURE_TX, packet, size);
+    TRACE(TRACE_ETHER_TX, size);
+    PROF_BEGIN(PROF_TX_PUT);
 
     // clear out any tx errors
     if ((etherReadReg(EIR) & TXERIF) != 0)
@@ -554,6 +620,7 @@ bool etherPutPacket(uint8_t packet[], uint16_t size)
         etherClearReg(EIR, TXERIF);
         etherSetReg(ECON1, TXRTS);
         etherClearReg(ECON1, TXRTS);
+        etherCounters.txErrors++;
     }
 
     // set DMA start address
@@ -584,9 +651,16 @@ bool etherPutPacket(uint8_t packet[], uint16_t size)
 
     // wait for completion
     while ((etherReadReg(ECON1) & TXRTS) != 0);
+    PROF_END(PROF_TX_PUT);
 
     // determine success
-    return ((etherReadReg(ESTAT) & TXABORT) == 0);
+    etherCounters.txFrames++;
+    if ((etherReadReg(ESTAT) & TXABORT) != 0)
+    {
+        etherCounters.txAborts++;
+        return false;
+    }
+    return true;
 }
 
 // Calculate sum of words
@@ -657,6 +731,8 @@ bool etherIsIp(uint8_t packet[])
         sum = 0;
         etherSumWords(&ip->revSize, (ip->revSize & 0xF) * 4);
         ok = (getEtherChecksum() == 0);
+        if (!ok)
+            etherCounters.ipChecksumErrors++;
     }
     return ok;
 }
@@ -842,6 +918,17 @@ bool etherIsUdp(uint8_t packet[])
     return ok;
 }
 
+// Returns true if a frame is addressed to our MAC, all six bytes compared
+static bool etherIsOurMac(uint8_t address[])
+{
+    uint8_t i;
+    for(i = 0; i < HW_ADD_LENGTH; i++)
+    {
+        if(address[i] != macAddress[i])
+            return false;
+    }
+    return true;
+}
 
 bool TcpListen(uint8_t packet[])
 {
@@ -862,12 +949,7 @@ bool TcpListen(uint8_t packet[])
 
     if(ok)
     {
-        ok = (ether->destAddress[0] == 2);
-        ok &= (ether->destAddress[1] == 3);
-        ok &= (ether->destAddress[2] == 4);
-        ok &= (ether->destAddress[3] == 5);
-        ok &= (ether->destAddress[4] == 6);
-        ok &= (ether->destAddress[5] == 141);
+        ok = etherIsOurMac(ether->destAddress);
 
         //ok &= (tcp->destPort == htons(23));
 
@@ -896,12 +978,7 @@ bool IsTcpSynAck(uint8_t packet[])
 
     if(ok)
     {
-        ok = (ether->destAddress[0] == 2);
-        ok &= (ether->destAddress[1] == 3);
-        ok &= (ether->destAddress[2] == 4);
-        ok &= (ether->destAddress[3] == 5);
-        ok &= (ether->destAddress[4] == 6);
-        ok &= (ether->destAddress[5] == 141);
+        ok = etherIsOurMac(ether->destAddress);
 
         //ok &= (tcp->destPort == htons(23));
 
@@ -920,12 +997,7 @@ bool IsTcpAck(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t x;
 
@@ -954,12 +1026,7 @@ bool IsTcpTelnet(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
 
     uint32_t x;
@@ -987,12 +1054,7 @@ bool IsTcpFin(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
 
     uint32_t x;
@@ -1016,12 +1078,7 @@ bool ISTcpFinAck(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
 
     uint32_t x;
@@ -1031,6 +1088,7 @@ bool ISTcpFinAck(uint8_t packet[])
         tcp->DoRF = htons(tcp->DoRF);
         x = (tcp->DoRF & 0xFF); //choose flags
         ok &= (x == 0x11);  // if it is FIN ACK
+        ok &= (tcp->destPort == src_prt); // on the current connection
     }
 
     return ok;
@@ -1045,19 +1103,16 @@ bool IsMqttConnectAck(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
     PayloadSize = 0;
     if(ok)
     {
+        uint8_t bytes;
+        mqttDecodeLength(&copydata[1], &bytes);
         ok = (copydata[0] == 0x20); // conforming connect Ack
-        ok &= (copydata[2] == 0);   // return code
+        ok &= (copydata[2 + bytes] == 0);   // return code
 
         PayloadSize = htons(ip->length) - 20 - 20;
     }
@@ -1065,6 +1120,15 @@ bool IsMqttConnectAck(uint8_t packet[])
     return ok;
 }
 
+// Returns the session present flag of a CONNACK
+bool IsMqttSessionPresent(uint8_t packet[])
+{
+    uint8_t* copydata = etherGetTcpData(packet);
+    uint8_t bytes;
+    mqttDecodeLength(&copydata[1], &bytes);
+    return (copydata[1 + bytes] & 0x01) != 0;
+}
+
 bool IsMqttpublishServer(uint8_t packet[])
 {
     etherFrame* ether = (etherFrame*)packet;
@@ -1074,12 +1138,7 @@ bool IsMqttpublishServer(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
     //tcp->sourcePort = htons(tcp->sourcePort);
@@ -1104,12 +1163,7 @@ bool IsPubAck(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
 
@@ -1132,12 +1186,7 @@ bool IsPubRec(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
 
@@ -1161,12 +1210,7 @@ bool IsPubCom(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
 
@@ -1191,19 +1235,14 @@ bool IsSubAck(uint8_t packet[])
 
     bool ok;
 //
-//    ok = (ether->destAddress[0] == 2);
-//    ok &= (ether->destAddress[1] == 3);
-//    ok &= (ether->destAddress[2] == 4);
-//    ok &= (ether->destAddress[3] == 5);
-//    ok &= (ether->destAddress[4] == 6);
-//    ok &= (ether->destAddress[5] == 141);
+//    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
     ok = (copydata[0] == 0x90);
     if(ok)
     {
         //ok = (copydata[0] == 0x90); // compare with Subscribe Ack
-        PayloadSize = 5;
+        PayloadSize = htons(ip->length) - 20 - 20;
     }
 
     return ok;
@@ -1218,19 +1257,14 @@ bool IsUnsubAck(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
 
     if(ok)
     {
-        ok = (copydata[0] == 0xB0); // compare with Subscribe Ack
-       // PayloadSize = htons(ip->length) - 20 - 20;
+        ok = (copydata[0] == 0xB0); // compare with Unsubscribe Ack
+        PayloadSize = htons(ip->length) - 20 - 20;
     }
 
     return ok;
@@ -1246,12 +1280,7 @@ bool IsMqttPingResponse(uint8_t packet[])
 
     bool ok;
 
-    ok = (ether->destAddress[0] == 2);
-    ok &= (ether->destAddress[1] == 3);
-    ok &= (ether->destAddress[2] == 4);
-    ok &= (ether->destAddress[3] == 5);
-    ok &= (ether->destAddress[4] == 6);
-    ok &= (ether->destAddress[5] == 141);
+    ok = etherIsOurMac(ether->destAddress);
 
     uint8_t* copydata = &tcp->data;
 
@@ -1267,6 +1296,23 @@ bool IsMqttPingResponse(uint8_t packet[])
     return ok;
 }
 
+// Gets pointer to TCP payload of frame
+uint8_t* etherGetTcpData(uint8_t packet[])
+{
+    etherFrame* ether = (etherFrame*)packet;
+    ipFrame* ip = (ipFrame*)&ether->data;
+    tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
+    return &tcp->data;
+}
+
+// Gets size of TCP payload of frame
+uint16_t etherGetTcpDataSize(uint8_t packet[])
+{
+    etherFrame* ether = (etherFrame*)packet;
+    ipFrame* ip = (ipFrame*)&ether->data;
+    return htons(ip->length) - ((ip->revSize & 0xF) * 4) - 20;
+}
+
 // Gets pointer to UDP payload of frame
 char* etherGetUdpData(uint8_t packet[])
 {
@@ -1416,19 +1462,9 @@ void SendTcpSynmessage(uint8_t packet[])
     //uint8_t* tcpoptions;
 
     // populating ether frame
-    ether->destAddress[0] = 0x8c;
-    ether->destAddress[1] = 0x16;
-    ether->destAddress[2] = 0x45;
-    ether->destAddress[3] = 0xd7;
-    ether->destAddress[4] = 0x51;
-    ether->destAddress[5] = 0x2f;
-
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
+    etherGetMqttBrkMacAddress(ether->destAddress);
+
+    etherGetMacAddress(ether->sourceAddress);
 
     ether->frameType = htons(0x0800);
 
@@ -1439,10 +1475,7 @@ void SendTcpSynmessage(uint8_t packet[])
     ip->id = 0;
     ip->flagsAndOffset = htons(0x4000); //don't fragment
 
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
+    etherGetIpAddress(ip->sourceIp);
 
     ip->destIp[0] = MqttBrkipAddress[0];
     ip->destIp[1] = MqttBrkipAddress[1];
@@ -1452,7 +1485,7 @@ void SendTcpSynmessage(uint8_t packet[])
     src_prt = htons(MyRand(1000,3000));
 
     //populating TCP
-    tcp->destPort = htons(1883);
+    tcp->destPort = htons(MqttBrkPort);
     tcp->sourcePort = src_prt;
 
     tcp->AckNum = 0;
@@ -1497,6 +1530,7 @@ void SendTcpSynmessage(uint8_t packet[])
     // etherSumWords(&tcp->data, 0);
     tcp->CheckSum = getEtherChecksum();
 
+    tcpCounters.syns++;
     etherPutPacket((uint8_t*)ether, 14 + ((ip->revSize & 0xF) * 4) +  20 + 4);
 }
 
@@ -1512,19 +1546,9 @@ void SendTcpAck(uint8_t packet[])
     uint16_t a;
 
     // populating ether frame
-    ether->destAddress[0] = 0x8c;
-    ether->destAddress[1] = 0x16;
-    ether->destAddress[2] = 0x45;
-    ether->destAddress[3] = 0xd7;
-    ether->destAddress[4] = 0x51;
-    ether->destAddress[5] = 0x2f;
-
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
+    etherGetMqttBrkMacAddress(ether->destAddress);
+
+    etherGetMacAddress(ether->sourceAddress);
 
     ether->frameType = htons(0x0800);
 
@@ -1592,34 +1616,31 @@ void SendTcpAck(uint8_t packet[])
     // etherSumWords(&tcp->data, 0);
     tcp->CheckSum = getEtherChecksum();
 
+    tcpCounters.acks++;
     etherPutPacket((uint8_t*)ether, 14 + ((ip->revSize & 0xF) * 4) +  20);
 }
 
-void SendTcpPushAck(uint8_t packet[])
+// Sends the MQTT packet already written at the TCP payload to the broker
+// Ports, sequence and ack numbers are kept from the last segment in the buffer
+// The sequence number is advanced afterwards, so several packets can be sent
+// back-to-back before the broker acknowledges them
+void etherSendMqttData(uint8_t packet[], uint16_t mqttSize)
 {
     etherFrame* ether = (etherFrame*)packet;
     ipFrame* ip = (ipFrame*)&ether->data;
     ip->revSize = 0x45;
     tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    uint8_t flags,Offset;
+    uint8_t i,flags,Offset;
     uint16_t x = 20;
     uint16_t a;
+    PROF_BEGIN(PROF_BUILD);
 
-    uint8_t *copyData ;
-    ether->destAddress[0] = 0x8c;
-    ether->destAddress[1] = 0x16;
-    ether->destAddress[2] = 0x45;
-    ether->destAddress[3] = 0xd7;
-    ether->destAddress[4] = 0x51;
-    ether->destAddress[5] = 0x2f;
-
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
+    //populating ether field
+    for(i = 0; i < HW_ADD_LENGTH; i++)
+    {
+        ether->sourceAddress[i] = macAddress[i];
+    }
 
     ether->frameType = htons(0x0800);
 
@@ -1628,14 +1649,15 @@ void SendTcpPushAck(uint8_t packet[])
     ip->ttl = 128;
     ip->protocol = 6; // TCP
     ip->id = 0;
+    ip->flagsAndOffset = htons(0x4000); //don't fragment
 
-    //populating TCP
-    tcp->destPort = tcp->destPort;
-    //tcp->sourcePort = htons(23);
-
-    tcp->SeqNum = tcp->SeqNum;
-    tcp->AckNum = tcp->AckNum;
+    for(i = 0; i < IP_ADD_LENGTH; i++)
+    {
+        ip->sourceIp[i] = ipAddress[i];
+        ip->destIp[i] = MqttBrkipAddress[i];
+    }
 
+    //populating TCP
     Offset = x >> 2;
     flags = 0x18; // for PSH and ACK
     a = (Offset << 12) + flags;
@@ -1644,8 +1666,7 @@ void SendTcpPushAck(uint8_t packet[])
     tcp->CheckSum = 0;
     tcp->UrgentPtr = 0;
 
-
-    ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + 18);
+    ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + mqttSize);
 
     // 32-bit sum over ip header
     sum = 0;
@@ -1653,30 +1674,9 @@ void SendTcpPushAck(uint8_t packet[])
     etherSumWords(ip->sourceIp, ((ip->revSize & 0xF) * 4) - 12);
     ip->headerChecksum = getEtherChecksum();
 
-    copyData = &tcp->data;
-
-    copyData[0] = 0x10;
-    copyData[1] = 16;
-    copyData[2] = 0x00;
-    copyData[3] = 4;
-    copyData[4] = (uint8_t)'M';
-    copyData[5] = (uint8_t)'Q';
-    copyData[6] = (uint8_t)'T';
-    copyData[7] = (uint8_t)'T';
-    copyData[8] = 4;
-    copyData[9] = 2;
-    copyData[10] = 0;
-    copyData[11] = 0x3C;
-    copyData[12] = 0;
-    copyData[13] = 4;
-    copyData[14] = (uint8_t)'P';
-    copyData[15] = (uint8_t)'Q';
-    copyData[16] = (uint8_t)'R';
-    copyData[17] = (uint8_t)'T';
-
     uint16_t tmp16;
 
-    uint16_t tcpLen = htons(20 + 18);
+    uint16_t tcpLen = htons(20 + mqttSize);
     // 32-bit sum over pseudo-header
     sum = 0;
 
@@ -1684,172 +1684,191 @@ void SendTcpPushAck(uint8_t packet[])
     tmp16 = ip->protocol;
     sum += (tmp16 & 0xff) << 8;
     etherSumWords(&tcpLen, 2);
-    // add udp header except crc
 
-
-    etherSumWords(tcp,20+18);
-    //etherSumWords(&tcp->data, tcpSize);
+    etherSumWords(tcp, 20 + mqttSize);
 
     tcp->CheckSum = getEtherChecksum();
 
-    // send packet with size = ether + tcp hdr + ip header + tcp_size
-    etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + 18 );
+    PROF_END(PROF_BUILD);
+    tcpCounters.segments++;
+    // send packet with size = ether + tcp hdr + ip header + mqtt_size
+    etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + mqttSize);
+
+    tcp->SeqNum = htons32(htons32(tcp->SeqNum) + mqttSize);
+    keepAliveSent();
 }
 
-void SendMqttPublishClient(uint8_t packet[], char* Topic, char* Data)
+// Adds the v5 CONNECT properties; called once to measure and once to write
+static void addConnectProperties(propWriter* w, mqttConnectOptions* options)
+{
+    if(!options->cleanSession)
+        propAddInt32(w, PROP_SESSION_EXPIRY_INTERVAL, options->sessionExpiry);
+    propAddInt16(w, PROP_RECEIVE_MAXIMUM, MQTT_RECEIVE_MAXIMUM);
+    propAddInt32(w, PROP_MAXIMUM_PACKET_SIZE, MQTT_MAX_PACKET);
+    propAddInt16(w, PROP_TOPIC_ALIAS_MAXIMUM, MAX_IN_ALIASES);
+}
+
+// Adds the v5 PUBLISH properties; called once to measure and once to write
+static void addPublishProperties(propWriter* w, uint16_t alias)
+{
+    mqttPublishOptions* options = mqttGetPublishOptions();
+    if(alias != 0)
+        propAddInt16(w, PROP_TOPIC_ALIAS, alias);
+    if(options->messageExpiry != 0)
+        propAddInt32(w, PROP_MESSAGE_EXPIRY_INTERVAL, options->messageExpiry);
+    if(options->correlationLength != 0)
+        propAddBinary(w, PROP_CORRELATION_DATA, options->correlationData, options->correlationLength);
+    if(options->userName[0] != '\0')
+        propAddStringPair(w, PROP_USER_PROPERTY, options->userName, options->userValue);
+}
+
+// Sends CONNECT built from the session options, right after the handshake ACK
+void SendMqttConnect(uint8_t packet[], mqttConnectOptions* options)
 {
     etherFrame* ether = (etherFrame*)packet;
     ipFrame* ip = (ipFrame*)&ether->data;
     ip->revSize = 0x45;
     tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    uint8_t i,flags,Offset;
-    uint16_t x = 20;
-    uint16_t a;
-
-    uint8_t *copyData ;
+    uint8_t *copyData = &tcp->data;
+    uint8_t i, Id_Len = stringLen(options->clientId);
+    uint16_t k, length = 10 + 2 + Id_Len;
+    propWriter w;
 
-
-    //populating ether field
-    for(i = 0; i < HW_ADD_LENGTH; i++)
+    if(options->protocolLevel == 5)
     {
-        ether->destAddress[i] = ether->destAddress[i];
+        propBegin(&w, NULL, 0, MQTT_CONNECT);
+        addConnectProperties(&w, options);
+        length += propEnd(&w);
     }
 
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
-
-    ether->frameType = htons(0x0800);
-
-    //populating IP field
-    ip->typeOfService = 0;
-    ip->ttl = 128;
-    ip->protocol = 6; // TCP
-    ip->id = 0;
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
-
-    ip->destIp[0] = MqttBrkipAddress[0];
-    ip->destIp[1] = MqttBrkipAddress[1];
-    ip->destIp[2] = MqttBrkipAddress[2];
-    ip->destIp[3] = MqttBrkipAddress[3];
-
-    //populating TCP
-    tcp->destPort = tcp->destPort;
-    //tcp->sourcePort = htons(23);
-
-    tcp->SeqNum = tcp->SeqNum;
-    tcp->AckNum = tcp->AckNum;
-
-    Offset = x >> 2;
-    flags = 0x18; // for PSH and ACK
-    a = (Offset << 12) + flags;
-    tcp->DoRF = htons(a);
-    tcp->WindowSize = htons(1280);
-    tcp->CheckSum = 0;
-    tcp->UrgentPtr = 0;
-
-    uint8_t Top_Len = stringLen(Topic);
-    uint8_t Data_Len = stringLen(Data);
+    //MQTT begins
+    copyData[0] = 0x10; // connect
+    k = 1 + mqttEncodeLength(&copyData[1], length);
 
+    // variable header: protocol name, level, flags and keep alive
+    copyData[k++] = 0x00;
+    copyData[k++] = 4;
+    copyData[k++] = (uint8_t)'M';
+    copyData[k++] = (uint8_t)'Q';
+    copyData[k++] = (uint8_t)'T';
+    copyData[k++] = (uint8_t)'T';
+    copyData[k++] = options->protocolLevel;
+    copyData[k++] = options->cleanSession ? 0x02 : 0x00;
+    copyData[k++] = HIBYTE(options->keepAlive);
+    copyData[k++] = LOBYTE(options->keepAlive);
 
-    //MQTT begains
-    copyData = &tcp->data;
-    copyData[0] = 0x33; // for publish
-    if(copyData[0] == 0x35 || copyData[0] == 0x33 || copyData[0] == 0x34 || copyData[0] == 0x32) // when QoS is non zero
+    if(options->protocolLevel == 5)
     {
-        AvdSYN = false;
-        copyData[1] = Top_Len + Data_Len + 2 + 2;
-    }else
-    {
-        AvdSYN = true;
-        copyData[1] = Top_Len + Data_Len + 2;
+        propBegin(&w, &copyData[k], MQTT_MAX_PACKET - k, MQTT_CONNECT);
+        addConnectProperties(&w, options);
+        k += propEnd(&w);
     }
-    uint16_t *ptr = (uint16_t*)&copyData[2]; // Topic length
 
-    *ptr = htons(Top_Len);
-    for(i = 4; i < (Top_Len + 4); i++)
+    // payload: client identifier
+    copyData[k++] = 0x00;
+    copyData[k++] = Id_Len;
+    for(i = 0; i < Id_Len; i++)
     {
-        copyData[i] = (uint8_t)Topic[i-4];
+        copyData[k++] = (uint8_t)options->clientId[i];
     }
-    if(copyData[0] == 0x35 || copyData[0] == 0x33 || copyData[0] == 0x34 || copyData[0] == 0x32)
-    {
-        uint16_t *ptr_ID = (uint16_t*)&copyData[i]; // support message ID
-        *ptr_ID = MyRand(300,400);
-        for(i = (Top_Len+4+2) ; i < (Data_Len+Top_Len+4+2) ; i++)
-        {
-                copyData[i] = (uint8_t)Data[i-Top_Len-4-2];
-        }
 
-    }else
-    {
-        for(i = (Top_Len+4) ; i < (Data_Len+Top_Len+4) ; i++)
-        {
-                copyData[i] = (uint8_t)Data[i-Top_Len-4];
-        }
-    }
+    etherSendMqttData(packet, k);
+}
 
-    //IP checksum
-    if(copyData[0] == 0x35 || copyData[0] == 0x33 || copyData[0] == 0x34 || copyData[0] == 0x32)
-    {
-        ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + Top_Len + Data_Len + 4 + 2);
-    }else
+// Payload writer for text publishes, context is the '\0' terminated string
+static uint16_t textPayload(uint8_t buffer[], uint16_t size, void* context)
+{
+    char* Data = (char*)context;
+    uint16_t i, Data_Len = stringLen(Data);
+    if(buffer == NULL)
+        return Data_Len;
+    for(i = 0; i < Data_Len && i < size; i++)
     {
-        ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + Top_Len + Data_Len + 4);
+        buffer[i] = (uint8_t)Data[i];
     }
+    return i;
+}
 
-    // 32-bit sum over ip header
-    sum = 0;
+bool SendMqttPublishClient(uint8_t packet[], char* Topic, char* Data)
+{
+    return SendMqttPublishWriter(packet, Topic, textPayload, Data);
+}
 
-    etherSumWords(&ip->revSize, 10);
-    etherSumWords(ip->sourceIp, ((ip->revSize & 0xF) * 4) - 12);
-    ip->headerChecksum = getEtherChecksum();
+// Sends PUBLISH with QoS 1 and retain set
+// The payload is written in place by the writer, which is called once with a
+// NULL buffer to size the packet and once to fill the frame
+// With MQTT v5 the topic is replaced by a topic alias once the broker knows it
+// Returns false, with nothing sent, if the packet is too large or the writer
+// does not produce what it measured
+bool SendMqttPublishWriter(uint8_t packet[], char* Topic, _payloadWriter writer, void* context)
+{
+    etherFrame* ether = (etherFrame*)packet;
+    ipFrame* ip = (ipFrame*)&ether->data;
+    ip->revSize = 0x45;
+    tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    uint16_t tmp16, tcpLen;
+    uint8_t *copyData = &tcp->data;
+    uint8_t Top_Len = stringLen(Topic);
+    uint16_t Data_Len = writer(NULL, 0, context);
+    uint16_t alias = 0, id, k, length;
+    uint8_t i;
+    bool known = false;
+    propWriter w;
 
-    if(copyData[0] == 0x35 || copyData[0] == 0x33 || copyData[0] == 0x34 || copyData[0] == 0x32)
+    if(mqttIsV5())
     {
-         tcpLen = htons(20 + Top_Len + Data_Len + 4 + 2);
-    }else
+        alias = aliasOutbound(Topic, &known);
+        if(known)
+            Top_Len = 0; // broker resolves the topic from the alias
+    }
+
+    length = 2 + Top_Len + 2 + Data_Len; // topic, message ID and data
+    if(mqttIsV5())
     {
-         tcpLen = htons(20 + Top_Len + Data_Len + 4);
+        propBegin(&w, NULL, 0, MQTT_PUBLISH);
+        addPublishProperties(&w, alias);
+        length += propEnd(&w);
+
+        // the broker drops the connection on packets above its maximum
+        if(mqttGetBrokerMaximumPacket() != 0 && 1 + 4 + length > mqttGetBrokerMaximumPacket())
+            return false;
     }
 
-    // 32-bit sum over pseudo-header
-    sum = 0;
+    if(1 + 4 + length > MQTT_MAX_PACKET)
+        return false;
 
-    etherSumWords(ip->sourceIp, 8);
-    tmp16 = ip->protocol;
-    sum += (tmp16 & 0xff) << 8;
-    etherSumWords(&tcpLen, 2);
+    //MQTT begins
+    copyData[0] = 0x33; // for publish, QoS 1 and retain
+    AvdSYN = false;     // QoS is non zero, a PUBACK will follow
+    k = 1 + mqttEncodeLength(&copyData[1], length);
 
-    if(copyData[0] == 0x35 || copyData[0] == 0x33 || copyData[0] == 0x34 || copyData[0] == 0x32)
-    {
-        etherSumWords(tcp,20 + Top_Len + Data_Len + 4 + 2);
-    }else
+    copyData[k++] = 0; // Topic length
+    copyData[k++] = Top_Len;
+    for(i = 0; i < Top_Len; i++)
     {
-        etherSumWords(tcp,20 + Top_Len + Data_Len + 4);
+        copyData[k++] = (uint8_t)Topic[i];
     }
-    //etherSumWords(&tcp->data, tcpSize);
-
-    tcp->CheckSum = getEtherChecksum();
 
+    id = mqttNextPacketId(); // support message ID
+    copyData[k++] = HIBYTE(id);
+    copyData[k++] = LOBYTE(id);
 
-    if(copyData[0] == 0x35 || copyData[0] == 0x33 || copyData[0] == 0x34 || copyData[0] == 0x32)
+    if(mqttIsV5())
     {
-        // send packet with size = ether + tcp hdr + ip header + tcp_size
-        etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + Top_Len + Data_Len + 4 + 2);
-    }else
-    {
-        // send packet with size = ether + tcp hdr + ip header + tcp_size
-        etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + Top_Len + Data_Len + 4);
+        propBegin(&w, &copyData[k], MQTT_MAX_PACKET - k, MQTT_PUBLISH);
+        addPublishProperties(&w, alias);
+        k += propEnd(&w);
     }
+
+    // the writer must produce what it measured
+    if(writer(&copyData[k], Data_Len, context) != Data_Len)
+        return false;
+    k += Data_Len;
+
+    etherSendMqttData(packet, k);
+    aliasOutboundSent(alias, Topic);
+    return true;
 }
 
 
@@ -1863,6 +1882,7 @@ void SendTcpAck1(uint8_t packet[])
     uint8_t i,flags,Offset;
     uint16_t x = 20; // total header length
     uint16_t a;
+    PROF_BEGIN(PROF_BUILD);
 
     // populating ether frame
     for(i = 0; i < HW_ADD_LENGTH; i++)
@@ -1870,12 +1890,7 @@ void SendTcpAck1(uint8_t packet[])
         ether->destAddress[i] = ether->sourceAddress[i];
     }
 
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
+    etherGetMacAddress(ether->sourceAddress);
 
     ether->frameType = htons(0x0800);
 
@@ -1886,10 +1901,7 @@ void SendTcpAck1(uint8_t packet[])
     ip->id = 0;
     ip->flagsAndOffset = htons(0x4000); //don't fragment
 
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
+    etherGetIpAddress(ip->sourceIp);
 
     ip->destIp[0] = MqttBrkipAddress[0];
     ip->destIp[1] = MqttBrkipAddress[1];
@@ -1903,7 +1915,7 @@ void SendTcpAck1(uint8_t packet[])
     temp16 = tcp->destPort;
     tcp->destPort = tcp->sourcePort;
     tcp->sourcePort = temp16;
-    tcp->destPort = htons(1883);
+    tcp->destPort = htons(MqttBrkPort);
 
     temp32 = tcp->AckNum;
     tcp->AckNum = tcp->SeqNum;
@@ -1942,301 +1954,104 @@ void SendTcpAck1(uint8_t packet[])
     // etherSumWords(&tcp->data, 0);
     tcp->CheckSum = getEtherChecksum();
 
+    PROF_END(PROF_BUILD);
+    tcpCounters.acks++;
     etherPutPacket((uint8_t*)ether, 14 + ((ip->revSize & 0xF) * 4) +  20);
 }
 
-void SendMqttSubscribeClient(uint8_t packet[], char* Topic)
+// Sends one SUBSCRIBE carrying count topic filters
+void SendMqttSubscribeClient(uint8_t packet[], uint16_t packetId, char* Topics[], uint8_t Qos[], uint8_t count)
 {
     etherFrame* ether = (etherFrame*)packet;
     ipFrame* ip = (ipFrame*)&ether->data;
     ip->revSize = 0x45;
     tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    uint8_t i,flags,Offset;
-    uint16_t x = 20;
-    uint16_t a;
-
-    uint8_t *copyData ;
-
-    //populating ether field
-    for(i = 0; i < HW_ADD_LENGTH; i++)
-    {
-        ether->destAddress[i] = ether->destAddress[i];
-    }
-
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
-
-    ether->frameType = htons(0x0800);
-
-    //populating IP field
-    ip->typeOfService = 0;
-    ip->ttl = 128;
-    ip->protocol = 6; // TCP
-    ip->id = 0;
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
-
-    ip->destIp[0] = MqttBrkipAddress[0];
-    ip->destIp[1] = MqttBrkipAddress[1];
-    ip->destIp[2] = MqttBrkipAddress[2];
-    ip->destIp[3] = MqttBrkipAddress[3];
-
-    //populating TCP
-    tcp->destPort = tcp->destPort;
-    //tcp->sourcePort = htons(23);
-
-
-    tcp->SeqNum = tcp->SeqNum;
-    tcp->AckNum = tcp->AckNum;
-
-    Offset = x >> 2;
-    flags = 0x18; // for PSH and ACK
-    a = (Offset << 12) + flags;
-    tcp->DoRF = htons(a);
-    tcp->WindowSize = htons(1280);
-    tcp->CheckSum = 0;
-    tcp->UrgentPtr = 0;
-
-    uint8_t Top_Len = stringLen(Topic);
-    uint8_t j = 1;
-    bool Idflag = false;
-
-    //bool Idflag = false;
-    copyData = &tcp->data;
+    uint8_t *copyData = &tcp->data;
+    uint16_t length = 2; // Message ID
+    uint16_t k;
+    propWriter w;
+    uint8_t i, j, Top_Len;
 
-    if(SubTopicFrame.Topic_names == 0)
+    for(i = 0; i < count; i++)
     {
-        stringCopy(SubTopicFrame.SubTopicArr[SubTopicFrame.Topic_names], Topic);
-        SubTopicFrame.times[SubTopicFrame.Topic_names] = 1;
-        j = 1;
-        SubTopicFrame.Topic_names++;
-    }else
-    {
-        Idflag = false;
-        for(i = 0 ; i < SubTopicFrame.Topic_names; i++)
-        {
-            if(strngcomp(SubTopicFrame.SubTopicArr[i],Topic))
-            {
-                Idflag = true;
-                SubTopicFrame.times[i]++;
-                j = SubTopicFrame.times[i];
-                break;
-
-            }
-        }
-
-            if(Idflag == false)
-            {
-                stringCopy(SubTopicFrame.SubTopicArr[SubTopicFrame.Topic_names], Topic);
-                SubTopicFrame.times[SubTopicFrame.Topic_names] = 1;
-                j = 1;
-                SubTopicFrame.Topic_names++;
-            }
-
+        length += 2 + stringLen(Topics[i]) + 1; // Topic length, topic and QoS
     }
 
-
-    ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + Top_Len + 2 + 2 + 2 + 1);
-
-    // 32-bit sum over ip header
-    sum = 0;
-
-
-    etherSumWords(&ip->revSize, 10);
-    etherSumWords(ip->sourceIp, ((ip->revSize & 0xF) * 4) - 12);
-    ip->headerChecksum = getEtherChecksum();
-
     //MQTT begins
-
+    if(mqttIsV5())
+        length++; // properties length
 
     copyData[0] = 0x82; // Subscribe request with reserved bit set
-    copyData[1] = Top_Len + 2 + 2 + 1; // Message length
-    uint16_t *ptr = (uint16_t*)&copyData[2]; // Message ID
-    *ptr = htons(j);
-
-    uint16_t *ptr1 = (uint16_t*)&copyData[4]; // Topic Length
-    *ptr1 = htons(Top_Len);
-
-    for(i = 6; i < (Top_Len + 6); i++)
+    k = 1 + mqttEncodeLength(&copyData[1], length); // Message length
+    copyData[k++] = HIBYTE(packetId);
+    copyData[k++] = LOBYTE(packetId);
+    if(mqttIsV5())
     {
-        copyData[i] = (uint8_t)Topic[i-6]; // copying the topic name
+        propBegin(&w, &copyData[k], MQTT_MAX_PACKET - k, MQTT_SUBSCRIBE);
+        k += propEnd(&w); // no properties
     }
-    copyData[i] = 0; // QoS 0
-
-    uint16_t tmp16;
-
-    uint16_t tcpLen = htons(20 + Top_Len + 2 + 2 + 2 + 1);
-    // 32-bit sum over pseudo-header
-    sum = 0;
-
-    etherSumWords(ip->sourceIp, 8);
-    tmp16 = ip->protocol;
-    sum += (tmp16 & 0xff) << 8;
-    etherSumWords(&tcpLen, 2);
-
-
-    etherSumWords(tcp,20 + Top_Len + 2 + 2 + 2 + 1);
-    //etherSumWords(&tcp->data, tcpSize);
 
-    tcp->CheckSum = getEtherChecksum();
-
-    // send packet with size = ether + tcp hdr + ip header + topic_length + Message length + Message ID
-    etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + Top_Len + 2 + 2 + 2 + 1);
+    for(i = 0; i < count; i++)
+    {
+        Top_Len = stringLen(Topics[i]);
+        copyData[k++] = 0;
+        copyData[k++] = Top_Len;
+        for(j = 0; j < Top_Len; j++)
+        {
+            copyData[k++] = (uint8_t)Topics[i][j]; // copying the topic name
+        }
+        copyData[k++] = Qos[i];
+    }
 
+    etherSendMqttData(packet, k);
 }
 
-void SendMqttUnSubscribeClient(uint8_t packet[], char* Topic)
+// Sends one UNSUBSCRIBE carrying count topic filters
+void SendMqttUnSubscribeClient(uint8_t packet[], uint16_t packetId, char* Topics[], uint8_t count)
 {
     etherFrame* ether = (etherFrame*)packet;
     ipFrame* ip = (ipFrame*)&ether->data;
     ip->revSize = 0x45;
     tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    uint8_t i,flags,Offset;
-    uint16_t x = 20;
-    uint16_t a;
-
-    uint8_t *copyData ;
+    uint8_t *copyData = &tcp->data;
+    uint16_t length = 2; // Message ID
+    uint16_t k;
+    propWriter w;
+    uint8_t i, j, Top_Len;
 
-    //populating ether field
-    for(i = 0; i < HW_ADD_LENGTH; i++)
+    for(i = 0; i < count; i++)
     {
-        ether->destAddress[i] = ether->destAddress[i];
+        length += 2 + stringLen(Topics[i]); // Topic length and topic
     }
 
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
-
-    ether->frameType = htons(0x0800);
-
-    //populating IP field
-    ip->typeOfService = 0;
-    ip->ttl = 128;
-    ip->protocol = 6; // TCP
-    ip->id = 0;
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
-
-    ip->destIp[0] = MqttBrkipAddress[0];
-    ip->destIp[1] = MqttBrkipAddress[1];
-    ip->destIp[2] = MqttBrkipAddress[2];
-    ip->destIp[3] = MqttBrkipAddress[3];
-
-    //populating TCP
-    tcp->destPort = tcp->destPort;
-    //tcp->sourcePort = htons(23);
-
-
-    tcp->SeqNum = tcp->SeqNum;
-    tcp->AckNum = tcp->AckNum;
-
-    Offset = x >> 2;
-    flags = 0x18; // for PSH and ACK
-    a = (Offset << 12) + flags;
-    tcp->DoRF = htons(a);
-    tcp->WindowSize = htons(1280);
-    tcp->CheckSum = 0;
-    tcp->UrgentPtr = 0;
-
-    uint8_t Top_Len = stringLen(Topic);
-    uint8_t j;
-    //bool Idflag = false;
-
-    bool Idflag = false;
-    copyData = &tcp->data;
-
-
-
-    if(SubTopicFrame.Topic_names == 0)
-    {
-        stringCopy(SubTopicFrame.SubTopicArr[SubTopicFrame.Topic_names], Topic);
-        SubTopicFrame.times[SubTopicFrame.Topic_names] = 1;
-        j = 1;
-        SubTopicFrame.Topic_names++;
-    }else
-    {
-        Idflag = false;
-        for(i = 0 ; i < SubTopicFrame.Topic_names; i++)
-        {
-            if(strngcomp(SubTopicFrame.SubTopicArr[i],Topic))
-            {
-                Idflag = true;
-                SubTopicFrame.times[i]++;
-                j = SubTopicFrame.times[i];
-                break;
-
-            }
-        }
-
-            if(Idflag == false)
-            {
-                stringCopy(SubTopicFrame.SubTopicArr[SubTopicFrame.Topic_names], Topic);
-                SubTopicFrame.times[SubTopicFrame.Topic_names] = 1;
-                j = 1;
-                SubTopicFrame.Topic_names++;
-            }
-    }
-
-
-    ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + Top_Len + 2 + 2 + 2);
-
-    // 32-bit sum over ip header
-    sum = 0;
-
-
-    etherSumWords(&ip->revSize, 10);
-    etherSumWords(ip->sourceIp, ((ip->revSize & 0xF) * 4) - 12);
-    ip->headerChecksum = getEtherChecksum();
-
     //MQTT begins
-
+    if(mqttIsV5())
+        length++; // properties length
 
     copyData[0] = 0xA2;// unsubscribe request
-    copyData[1] = Top_Len + 2 + 2;
-
-    uint16_t *ptr = (uint16_t*)&copyData[2]; // Message ID
-    *ptr = htons(j);
-
-    uint16_t *ptr1 = (uint16_t*)&copyData[4]; // Topic Length
-    *ptr1 = htons(Top_Len);
-
-    for(i = 6; i < (Top_Len + 6); i++)
+    k = 1 + mqttEncodeLength(&copyData[1], length);
+    copyData[k++] = HIBYTE(packetId);
+    copyData[k++] = LOBYTE(packetId);
+    if(mqttIsV5())
     {
-        copyData[i] = (uint8_t)Topic[i-6]; // copying the topic name
+        propBegin(&w, &copyData[k], MQTT_MAX_PACKET - k, MQTT_UNSUBSCRIBE);
+        k += propEnd(&w); // no properties
     }
 
-    uint16_t tmp16;
-
-    uint16_t tcpLen = htons(20 + Top_Len + 2 + 2 + 2);
-    // 32-bit sum over pseudo-header
-    sum = 0;
-
-    etherSumWords(ip->sourceIp, 8);
-    tmp16 = ip->protocol;
-    sum += (tmp16 & 0xff) << 8;
-    etherSumWords(&tcpLen, 2);
-
-
-    etherSumWords(tcp,20 + Top_Len + 2 + 2 + 2);
-    //etherSumWords(&tcp->data, tcpSize);
-
-    tcp->CheckSum = getEtherChecksum();
+    for(i = 0; i < count; i++)
+    {
+        Top_Len = stringLen(Topics[i]);
+        copyData[k++] = 0;
+        copyData[k++] = Top_Len;
+        for(j = 0; j < Top_Len; j++)
+        {
+            copyData[k++] = (uint8_t)Topics[i][j]; // copying the topic name
+        }
+    }
 
-    // send packet with size = ether + tcp hdr + ip header + tcp_size
-    etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + Top_Len + 2 + 2 + 2);
+    etherSendMqttData(packet, k);
 }
 
 void SendMqttPublishRel(uint8_t packet[])
@@ -2258,12 +2073,7 @@ void SendMqttPublishRel(uint8_t packet[])
         ether->destAddress[i] = ether->destAddress[i];
     }
 
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
+    etherGetMacAddress(ether->sourceAddress);
 
     ether->frameType = htons(0x0800);
 
@@ -2272,10 +2082,7 @@ void SendMqttPublishRel(uint8_t packet[])
     ip->ttl = 128;
     ip->protocol = 6; // TCP
     ip->id = 0;
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
+    etherGetIpAddress(ip->sourceIp);
 
     ip->destIp[0] = MqttBrkipAddress[0];
     ip->destIp[1] = MqttBrkipAddress[1];
@@ -2347,97 +2154,24 @@ void SendMqttPublishRel(uint8_t packet[])
 
 }
 
+// Sends PINGREQ on the connection whose headers are in packet
 void SendMqttPingRequest(uint8_t packet[])
 {
-
     etherFrame* ether = (etherFrame*)packet;
     ipFrame* ip = (ipFrame*)&ether->data;
     ip->revSize = 0x45;
     tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    uint8_t flags,Offset;
-    uint16_t x = 20;
-    uint16_t a;
+    uint8_t *copyData = &tcp->data;
 
-    // populating ether frame
-    ether->destAddress[0] = 0x8c;
-    ether->destAddress[1] = 0x16;
-    ether->destAddress[2] = 0x45;
-    ether->destAddress[3] = 0xd7;
-    ether->destAddress[4] = 0x51;
-    ether->destAddress[5] = 0x2f;
-
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
-
-    ether->frameType = htons(0x0800);
+    copyData[0] = 0xC0;
+    copyData[1] = 0;
 
-    //populating IP field
-    ip->typeOfService = 0;
-    ip->ttl = 128;
-    ip->protocol = 6; // TCP
-    ip->id = 0;
-
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
-
-    ip->destIp[0] = MqttBrkipAddress[0];
-    ip->destIp[1] = MqttBrkipAddress[1];
-    ip->destIp[2] = MqttBrkipAddress[2];
-    ip->destIp[3] = MqttBrkipAddress[3];
-
-    tcp->destPort =  tcp->destPort;
-    tcp->sourcePort = tcp->sourcePort;
-
-    tcp->SeqNum = tcp->SeqNum;;
-
-    tcp->AckNum = tcp->AckNum ;
-
-    Offset = x >> 2;
-    flags = 0x18; // PUSH ACK
-    a = (Offset << 12) + flags;
-    tcp->DoRF = htons(a);
-    tcp->WindowSize = htons(1280);
-    tcp->CheckSum = 0;
-    tcp->UrgentPtr = 0;
-
-    ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + 2);
-    //Ip checksum
-    sum=0;
-    etherSumWords(&ip->revSize, 10);
-    etherSumWords(ip->sourceIp, ((ip->revSize & 0xF) * 4) - 12);
-    ip->headerChecksum = getEtherChecksum();
-
-    uint8_t *copydata = &tcp->data;
-
-    copydata[0] = 0xC0;
-    copydata[1] = 0;
-
-    //TCP checksum
-
-    uint16_t tmp16;
-
-    uint16_t tcpLen = htons(20 + 2);
-    sum = 0;
-    etherSumWords(ip->sourceIp, 8);
-
-    tmp16 = ip->protocol;
-    sum += (tmp16 & 0xff) << 8;
-    etherSumWords(&tcpLen,2);
-
-    etherSumWords(tcp, 20 + 2);
-    // etherSumWords(&tcp->data, 0);
-    tcp->CheckSum = getEtherChecksum();
-
-    etherPutPacket((uint8_t*)ether, 14 + ((ip->revSize & 0xF) * 4) +  20 + 2);
+    etherSendMqttData(packet, 2);
 }
 
+// Collects topic and data of a PUBLISH sent by the broker
+// v5 topic aliases are resolved, topic and data are truncated to fit
 Elements CollectPubData(uint8_t packet[])
 {
     etherFrame* ether = (etherFrame*)packet;
@@ -2445,61 +2179,63 @@ Elements CollectPubData(uint8_t packet[])
     ip->revSize = 0x45;
     tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    tcp->sourcePort = htons(1883);
+    tcp->sourcePort = htons(MqttBrkPort);
     tcp->destPort   = src_prt;
 
     Elements e;
     uint8_t* copydata = &tcp->data;
-    uint8_t i,j;
-
-
-    //uint8_t Mask = copydata[0]&0x0F;
-
-    //QoS = Mask;
-
-    uint8_t Msg_len = copydata[1];
-
-    uint16_t Top_len, data_len;
-
-    uint8_t temp8 = copydata[2];
-
-    Top_len = temp8 << 8;
-
-    temp8 = copydata[3];
-
-    Top_len = Top_len + temp8;
-
-    for(i = 4; i < (Top_len + 4); i++)
-    {
-        e.topic[i-4] = (char)copydata[i];
-    }
-
-    uint8_t k = 0;
-
-    for(k = Top_len; k < 9 ; k++)
-    {
-        e.topic[k] = 0;
+    uint8_t QoS = (copydata[0] >> 1) & 0x03;
+    uint8_t bytes;
+    uint16_t i, k, end, Top_len, alias = 0;
+    uint32_t Msg_len;
+    uint8_t* prop;
+    char* topic;
+
+    Msg_len = mqttDecodeLength(&copydata[1], &bytes);
+    k = 1 + bytes;
+    end = k + Msg_len;
+
+    Top_len = (copydata[k] << 8) | copydata[k+1];
+    topic = (char*)&copydata[k+2];
+    k += 2 + Top_len;
+
+    if(QoS != 0)
+        k += 2; // message ID
+
+    if(mqttIsV5() && k < end && propCheck(&copydata[k], end - k, MQTT_PUBLISH))
+    {
+        prop = propFind(&copydata[k], PROP_TOPIC_ALIAS, NULL);
+        if(prop != NULL)
+            alias = propGetInt(prop);
+        k += propBlockSize(&copydata[k]);
+        if(alias != 0)
+        {
+            if(Top_len != 0)
+                aliasInboundSet(alias, topic, Top_len);
+            else if(aliasInboundGet(alias) != NULL)
+            {
+                topic = aliasInboundGet(alias);
+                Top_len = stringLen(topic);
+            }
+        }
     }
 
-    data_len = (uint16_t)Msg_len - Top_len - 2;
-    uint8_t uo = data_len;
-    j = 0;
-    while(data_len != 0)
+    for(i = 0; i < Top_len && i < MAX_PUB_TOPIC - 1; i++)
     {
-        e.Data[j] = (char)copydata[i];
-        i++;
-        j++;
-        data_len--;
+        e.topic[i] = topic[i];
     }
+    e.topic[i] = 0;
 
-    for(i = uo ; i < 9 ; i++)
+    for(i = 0; k < end && i < MAX_PUB_DATA - 1; i++)
     {
-        e.Data[j] = 0;
+        e.Data[i] = (char)copydata[k++];
     }
+    e.Data[i] = 0;
 
     return e;
 }
 
+// Sends DISCONNECT on the connection whose headers are in packet
 void sendMqttDisconnectRequest(uint8_t packet[])
 {
     etherFrame* ether = (etherFrame*)packet;
@@ -2507,95 +2243,12 @@ void sendMqttDisconnectRequest(uint8_t packet[])
     ip->revSize = 0x45;
     tcpFrame* tcp = (tcpFrame*)((uint8_t*)ip + ((ip->revSize & 0xF) * 4));
 
-    uint8_t i,flags,Offset;
-    uint16_t x = 20;
-    uint16_t a;
-
-    uint8_t *copyData ;
-
-    //populating ether field
-    for(i = 0; i < HW_ADD_LENGTH; i++)
-    {
-        ether->destAddress[i] = ether->destAddress[i];
-    }
-
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
-
-    ether->frameType = htons(0x0800);
-
-    //populating IP field
-    ip->typeOfService = 0;
-    ip->ttl = 128;
-    ip->protocol = 6; // TCP
-    ip->id = 0;
-    ip->flagsAndOffset = htons(0x4000); //don't fragment
-
-    ip->sourceIp[0] = 192;
-    ip->sourceIp[1] = 168;
-    ip->sourceIp[2] = 1;
-    ip->sourceIp[3] = 141;
-
-    ip->destIp[0] = MqttBrkipAddress[0];
-    ip->destIp[1] = MqttBrkipAddress[1];
-    ip->destIp[2] = MqttBrkipAddress[2];
-    ip->destIp[3] = MqttBrkipAddress[3];
-
-    //uint32_t temp32;
-
-    tcp->sourcePort = src_prt;
-    tcp->destPort = htons(1883);
-
-//      temp32 = tcp->AckNum;
-//      tcp->AckNum = tcp->SeqNum;
-//      tcp->SeqNum = temp32;
-
-       Offset = x >> 2;
-       flags = 0x18; // for PSH and ACK
-       a = (Offset << 12) + flags;
-       tcp->DoRF = htons(a);
-       tcp->WindowSize = htons(1280);
-       tcp->CheckSum = 0;
-       tcp->UrgentPtr = 0;
-
-
-       ip->length = htons(((ip->revSize & 0xF) * 4) + 20 + 2);
-
-       // 32-bit sum over ip header
-       sum = 0;
-       etherSumWords(&ip->revSize, 10);
-       etherSumWords(ip->sourceIp, ((ip->revSize & 0xF) * 4) - 12);
-       ip->headerChecksum = getEtherChecksum();
-
-       copyData = &tcp->data;
-
-       copyData[0] = 0xe0;
-       copyData[1] = 00;
-
-       uint16_t tmp16;
+    uint8_t *copyData = &tcp->data;
 
-       uint16_t tcpLen = htons(20 + 2);
-       // 32-bit sum over pseudo-header
-       sum = 0;
+    copyData[0] = 0xe0;
+    copyData[1] = 0;
 
-       etherSumWords(ip->sourceIp, 8);
-       tmp16 = ip->protocol;
-       sum += (tmp16 & 0xff) << 8;
-       etherSumWords(&tcpLen, 2);
-       // add udp header except crc
-
-
-       etherSumWords(tcp,20+2);
-       //etherSumWords(&tcp->data, tcpSize);
-
-       tcp->CheckSum = getEtherChecksum();
-
-       // send packet with size = ether + tcp hdr + ip header + tcp_size
-       etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + 2 );
+    etherSendMqttData(packet, 2);
 }
 /*
 void SendTcpmessage(uint8_t packet[], uint8_t* tcpData, uint8_t tcpSize)
@@ -2612,12 +2265,7 @@ void SendTcpmessage(uint8_t packet[], uint8_t* tcpData, uint8_t tcpSize)
     {
         ether->destAddress[i] = ether->destAddress[i];
     }
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
+    etherGetMacAddress(ether->sourceAddress);
     ether->frameType = htons(0x0800);
     //populating IP field
     ip->typeOfService = 0;
@@ -2666,6 +2314,7 @@ void SendTcpmessage(uint8_t packet[], uint8_t* tcpData, uint8_t tcpSize)
     etherSumWords(tcp,20+tcpSize);
     //etherSumWords(&tcp->data, tcpSize);
     tcp->CheckSum = getEtherChecksum();
+    tcpCounters.segments++;
     // send packet with size = ether + tcp hdr + ip header + tcp_size
     etherPutPacket((uint8_t*)ether, 14 + 20 + ((ip->revSize & 0xF) * 4) + tcpSize );
 }
@@ -2687,12 +2336,7 @@ void SendTcpFin(uint8_t packet[])
         ether->destAddress[i] = ether->destAddress[i];
     }
 
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 14;
+    etherGetMacAddress(ether->sourceAddress);
 
     ether->frameType = htons(0x0800);
 
@@ -2766,6 +2410,7 @@ void SendTcpFin(uint8_t packet[])
     // etherSumWords(&tcp->data, 0);
     tcp->CheckSum = getEtherChecksum();
 
+    tcpCounters.fins++;
     etherPutPacket((uint8_t*)ether, 14 + ((ip->revSize & 0xF) * 4) +  20);
 
 
@@ -2788,12 +2433,7 @@ void SendTcpLastAck(uint8_t packet[])
         ether->destAddress[i] = ether->sourceAddress[i];
     }
 
-    ether->sourceAddress[0] = 2;
-    ether->sourceAddress[1] = 3;
-    ether->sourceAddress[2] = 4;
-    ether->sourceAddress[3] = 5;
-    ether->sourceAddress[4] = 6;
-    ether->sourceAddress[5] = 141;
+    etherGetMacAddress(ether->sourceAddress);
 
     ether->frameType = htons(0x0800);
 
@@ -2860,6 +2500,7 @@ void SendTcpLastAck(uint8_t packet[])
     // etherSumWords(&tcp->data, 0);
     tcp->CheckSum = getEtherChecksum();
 
+    tcpCounters.fins++;
     etherPutPacket((uint8_t*)ether, 14 + ((ip->revSize & 0xF) * 4) +  20);
 }
 
@@ -2940,6 +2581,26 @@ void etherGetMqttBrkIpAddress(uint8_t ip[4])
     for (i = 0; i < 4; i++)
         ip[i] = MqttBrkipAddress[i];
 }
+//Sets the MAC address frames to the broker go to, the broker's own on the
+//local network or the gateway's otherwise
+void etherSetMqttBrkMacAddress(uint8_t mac[6])
+{
+    uint8_t i;
+    for (i = 0; i < 6; i++)
+        MqttBrkMacAddress[i] = mac[i];
+}
+//Gets the MAC address frames to the broker go to
+void etherGetMqttBrkMacAddress(uint8_t mac[6])
+{
+    uint8_t i;
+    for (i = 0; i < 6; i++)
+        mac[i] = MqttBrkMacAddress[i];
+}
+// Sets the broker TCP port
+void etherSetMqttBrkPort(uint16_t port)
+{
+    MqttBrkPort = port;
+}
 // Sets IP subnet mask
 void etherSetIpSubnetMask(uint8_t mask0, uint8_t mask1, uint8_t mask2, uint8_t mask3)
 {
@@ -27,6 +27,7 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include "mqtt.h"
 
 #define ETHER_UNICAST        0x80
 #define ETHER_BROADCAST      0x01
@@ -65,27 +66,50 @@ enum _change
     DISCON
 }change;
 
-struct _SubTopicFrame
-{
-    char SubTopicArr[10][20];
-    uint8_t Topic_names;
-    uint8_t times[10];
+// Writes a PUBLISH payload into buffer and returns its size
+// Called with a NULL buffer to measure only
+typedef uint16_t(*_payloadWriter)(uint8_t buffer[], uint16_t size, void* context);
 
-}SubTopicFrame;
+#define MAX_PUB_TOPIC 32
+#define MAX_PUB_DATA  32
 
 typedef struct _Elements
 {
-    char topic[10];
-    char Data[10];
+    char topic[MAX_PUB_TOPIC];
+    char Data[MAX_PUB_DATA];
 }Elements;
+
+// Counters registered with the stats library as "ether" and "tcp"
+typedef struct _etherStats
+{
+    uint32_t rxFrames;
+    uint32_t txFrames;
+    uint32_t rxOverflows;               // receive buffer full, frames lost
+    uint32_t txAborts;                  // TXABORT after a transmit
+    uint32_t txErrors;                  // TXERIF left by an earlier transmit
+    uint32_t ipChecksumErrors;
+} etherStats;
+
+typedef struct _tcpStats
+{
+    uint32_t syns;
+    uint32_t segments;                  // carrying data
+    uint32_t acks;
+    uint32_t fins;
+} tcpStats;
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
 
 void etherInit(uint16_t mode);
 bool etherIsLinkUp();
+etherStats* etherGetStats();
+tcpStats* tcpGetStats();
 
 bool etherIsDataAvailable();
+void etherEnableInterrupt();
+void etherAckInterrupt();
+void etherIsr();
 bool etherIsOverflow();
 uint16_t etherGetPacket(uint8_t packet[], uint16_t maxSize);
 bool etherPutPacket(uint8_t packet[], uint16_t size);
@@ -103,6 +127,8 @@ void etherSendArpRequest(uint8_t packet[], uint8_t ip[]);
 bool etherIsUdp(uint8_t packet[]);
 bool IsArpResponse(uint8_t packet[]);
 char* etherGetUdpData(uint8_t packet[]);
+uint8_t* etherGetTcpData(uint8_t packet[]);
+uint16_t etherGetTcpDataSize(uint8_t packet[]);
 void etherSendUdpResponse(uint8_t packet[], uint8_t* udpData, uint8_t udpSize);
 
 void etherEnableDhcpMode();
@@ -119,6 +145,7 @@ bool IsTcpTelnet(uint8_t packet[]);
 bool IsTcpFin(uint8_t packet[]);
 bool ISTcpFinAck(uint8_t packet[]);
 bool IsMqttConnectAck(uint8_t packet[]);
+bool IsMqttSessionPresent(uint8_t packet[]);
 bool IsMqttpublishServer(uint8_t packet[]);
 bool IsPubAck(uint8_t packet[]);
 bool IsPubRec(uint8_t packet[]);
@@ -140,19 +167,24 @@ void etherSetMacAddress(uint8_t mac0, uint8_t mac1, uint8_t mac2, uint8_t mac3,
 void etherGetMacAddress(uint8_t mac[6]);
 void etherSetMqttBrkIp(uint8_t ip0, uint8_t ip1, uint8_t ip2, uint8_t ip3);
 void etherGetMqttBrkIpAddress(uint8_t ip[4]);
+void etherSetMqttBrkMacAddress(uint8_t mac[6]);
+void etherGetMqttBrkMacAddress(uint8_t mac[6]);
+void etherSetMqttBrkPort(uint16_t port);
 
 void SendTcpSynmessage(uint8_t packet[]);
 void SendTcpSynAckmessage(uint8_t packet[]);
 void SendTcpAck(uint8_t packet[]);
 void SendTcpAck1(uint8_t packet[]);
-void SendTcpPushAck(uint8_t packet[]);
 void SendTcpmessage(uint8_t packet[], uint8_t* tcpData, uint8_t tcpSize);
 void SendTcpFin(uint8_t packet[]);
 void SendTcpLastAck(uint8_t packet[]);
 
-void SendMqttPublishClient(uint8_t packet[], char* Topic, char* Data);
-void SendMqttSubscribeClient(uint8_t packet[], char* Topic);
-void SendMqttUnSubscribeClient(uint8_t packet[], char* Topic);
+void etherSendMqttData(uint8_t packet[], uint16_t mqttSize);
+void SendMqttConnect(uint8_t packet[], mqttConnectOptions* options);
+bool SendMqttPublishClient(uint8_t packet[], char* Topic, char* Data);
+bool SendMqttPublishWriter(uint8_t packet[], char* Topic, _payloadWriter writer, void* context);
+void SendMqttSubscribeClient(uint8_t packet[], uint16_t packetId, char* Topics[], uint8_t Qos[], uint8_t count);
+void SendMqttUnSubscribeClient(uint8_t packet[], uint16_t packetId, char* Topics[], uint8_t count);
 void SendMqttPublishRel(uint8_t packet[]);
 void SendMqttPingRequest(uint8_t packet[]);
 Elements CollectPubData(uint8_t packet[]);
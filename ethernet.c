@@ -41,9 +41,29 @@
 #include <stdio.h>
 #include "EEPROM.h"
 #include "tm4c123gh6pm.h"
+#include "adc.h"
+#include "batch.h"
+#include "capture.h"
+#include "channel.h"
+#include "cli.h"
+#include "config.h"
+#include "dsp.h"
 #include "eth0.h"
+#include "event.h"
 #include "gpio.h"
+#include "keepalive.h"
+#include "log.h"
+#include "mqtt.h"
+#include "prof.h"
+#include "pt.h"
+#include "reconnect.h"
+#include "sleep.h"
+#include "stats.h"
+#include "report.h"
 #include "spi0.h"
+#include "Timer.h"
+#include "topic.h"
+#include "trace.h"
 #include "uart0.h"
 #include "wait.h"
 
@@ -54,19 +74,114 @@
 #define GREEN_LED PORTF,3
 #define PUSH_BUTTON PORTF,4
 
+// Red LED on time after an ENC28J60 receive overflow
+#define OVERFLOW_BLINK_MS 100
+timerHandle overflowLedTimer = TIMER_NONE;
+
 uint8_t state;
-uint8_t tcpstate;
-uint32_t counterTimer = 0;
-uint32_t counterTimer2 = 0;
 
 bool Conflag = false;
 bool Disflag = false;
-bool pingflag = false;
 bool Pubflag = false;
 bool Subflag = false;
 bool UnSubflag  = false;
 extern bool AvdSYN;
 
+// Channels are sampled every second and reported on change; temperature
+// is published as text (default) or into a CBOR batch
+bool telemetryCbor = false;
+uint8_t tempChannel;
+
+// Samples timed by the dsp benchmark command
+#define DSP_BENCH_RUNS      10000
+
+// Work left for after the final batch is published
+#define SHUTDOWN_NONE       0
+#define SHUTDOWN_DISCONNECT 1
+#define SHUTDOWN_REBOOT     2
+uint8_t shutdownPending = SHUTDOWN_NONE;
+
+// Max packet is calculated as:
+// Ether frame header (18) + Max MTU (1500) + CRC (4)
+#define MAX_PACKET_SIZE 1522
+
+// Shared by the event handlers, which run one at a time
+uint8_t data[MAX_PACKET_SIZE];
+char* Pub_topic;
+char* Pub_data;
+_payloadWriter Pub_writer = NULL;
+void* Pub_context = NULL;
+USER_DATA info;
+
+// Topic and data of the publish command; info.buffer takes the next line
+// while the publish waits for its connection or is sent again
+char publishLine[MAX_CHARS + 1];
+
+// MQTT operations, each a protothread run by mqttRun() on every event that
+// may let it go on: a packet offered or a flag, timer or request changed
+#define SESSION_TIMEOUT_MS      5000    // SYN to CONNACK
+#define PUBLISH_TIMEOUT_MS      5000    // PUBLISH to PUBACK or PUBCOMP
+#define DISCONNECT_TIMEOUT_MS   2000    // DISCONNECT to FIN ACK
+
+// Ether (14) + IP (20), the IsXxx tests assume no IP options
+#define TCP_HEADER_OFFSET       34
+#define TCP_HEADER_SIZE         20
+
+typedef struct _mqttOp
+{
+    pt thread;
+    timerHandle timer;              // deadline of the current wait
+    bool expired;
+} mqttOp;
+
+mqttOp sessionOp;                   // SYN, CONNECT, then SUBACKs and UNSUBACKs
+mqttOp publishOp;                   // PUBACK, or PUBREC and PUBCOMP
+mqttOp pingOp;                      // PINGRESP
+mqttOp disconnectOp;                // FIN ACK
+bool publishSent = false;           // the session sent Pub_topic, publishOp awaits the ack
+bool publishWanted = false;         // Pub_topic goes out on the established connection
+bool pingWanted = false;
+
+// Set from CONNACK until sessionRestart(); later publishes reuse the
+// connection so the topic aliases the broker learnt on it stay valid
+bool sessionUp = false;
+uint8_t sessionRetries = 0;         // handshakes timed out since the last CONNACK
+uint8_t sessionHeader[TCP_HEADER_OFFSET + TCP_HEADER_SIZE];  // last frame sent on it
+
+// Packet offered to the operations, NULL once one of them has used it (or
+// sent something, every packet is built in data)
+uint8_t* rxPacket = NULL;
+uint8_t rxHeader[TCP_HEADER_SIZE];  // its TCP header as offered
+
+// Counters registered with the stats library as "mqtt" and "system"
+typedef struct _clientStats
+{
+    uint32_t connects;              // CONNACKs
+    uint32_t sessionTimeouts;       // SYN ACK or CONNACK missed, tried again
+    uint32_t publishes;
+    uint32_t publishAcks;           // PUBACK, PUBCOMP or the TCP ack of QoS 0
+    uint32_t publishRetries;        // no ack in time, published again
+    uint32_t publishDrops;          // too large to send, never published
+    uint32_t received;              // PUBLISHes from the broker
+    uint32_t pings;
+    uint32_t pingTimeouts;
+} clientStats;
+
+typedef struct _systemStats
+{
+    uint32_t eventDrops;
+    uint32_t uartTxDrops;
+    uint32_t uartRxDrops;
+    uint32_t logDrops;
+    uint32_t batchDepth;            // samples waiting in the cbor batch
+    uint32_t sleptMs;
+} systemStats;
+
+clientStats clientCounters;
+systemStats systemCounters;
+const char* const clientStatNames[] = {"connects", "session_timeouts", "publishes", "publish_acks", "publish_retries", "publish_drops", "received", "pings", "ping_timeouts"};
+const char* const systemStatNames[] = {"event_drops", "uart_tx_drops", "uart_rx_drops", "log_drops", "batch_depth", "slept_ms"};
+
 //-----------------------------------------------------------------------------
 // Subroutines                
 //-----------------------------------------------------------------------------
@@ -82,45 +197,16 @@ void initHw()
 //
 //    SYSCTL_RCGCHIB_R |= SYSCTL_RCGCHIB_R0;
 
-    SYSCTL_RCGCADC_R |= SYSCTL_RCGCADC_R0; // ENABLING AD0 and AD1
-
-    SYSCTL_RCGC2_R |= SYSCTL_RCGC2_GPIOE;
+    // Analog channels sampled in one SS0 burst triggered by Timer 2,
+    // averaged by the ADC and moved by uDMA, one block per second
+    initAdc();
 
-    GPIO_PORTE_AFSEL_R |= 0x08;                      // select alternative functions for AN0 (PE3)
-    GPIO_PORTE_DEN_R &= ~0x08;                       // turn off digital operation on pin PE3
-    GPIO_PORTE_AMSEL_R |= 0x08;                      // turn on analog operation on pin PE3
+    // 1 ms uptime and the timers running on it (EVENT_TICK)
+    initUptime();
+    initTimers();
 
-    // Configure ADC
-    ADC0_CC_R = ADC_CC_CS_SYSPLL;                    // select PLL as the time base (not needed, since default value)
-    ADC0_ACTSS_R &= ~ADC_ACTSS_ASEN3;                // disable sample sequencer 3 (SS3) for programming
-    ADC0_EMUX_R = ADC_EMUX_EM3_PROCESSOR;            // select SS0 bit in ADCPSSI as trigger
-    ADC0_SSMUX3_R = 0;                               // set first sample to AIN0
-    ADC0_SSCTL3_R = ADC_SSCTL3_END0 | ADC_SSCTL3_TS0;// mark first sample as the end and set TS0 bit get raw value of internal temperature
-    ADC0_ACTSS_R |= ADC_ACTSS_ASEN3;
-
-    //configuring timer 4 to send Ping request
-    SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R4;
-    _delay_cycles(3);
-    // Configure Timer 4 for 1 sec tick
-    TIMER4_CTL_R &= ~TIMER_CTL_TAEN;                 // turn-off timer before reconfiguring
-    TIMER4_CFG_R = TIMER_CFG_32_BIT_TIMER;           // configure as 32-bit timer (A+B)
-    TIMER4_TAMR_R = TIMER_TAMR_TACDIR;          // configure for periodic mode (count down)
-    TIMER4_IMR_R = 0;                                 // turn-off interrupt
-    TIMER4_TAV_R = 0;                                //Counter starts from zero
-    TIMER4_CTL_R |= TIMER_CTL_TAEN;                  // turn-on timer
-    NVIC_EN2_R &= ~(1 << (INT_TIMER4A-80));             // turn-off interrupt
-
-    //configuring timer 2 to publish internal temperature
-    SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R2;
-    _delay_cycles(3);
-    // Configure Timer 2 for 1 sec tick
-    TIMER2_CTL_R &= ~TIMER_CTL_TAEN;                 // turn-off timer before reconfiguring
-    TIMER2_CFG_R = TIMER_CFG_32_BIT_TIMER;           // configure as 32-bit timer (A+B)
-    TIMER2_TAMR_R = TIMER_TAMR_TACDIR;          // configure for periodic mode (count down)
-    TIMER2_IMR_R = 0;                                 // turn-off interrupt
-    TIMER2_TAV_R = 0;                                //Counter starts from zero
-    TIMER2_CTL_R |= TIMER_CTL_TAEN;                  // turn-on timer
-    NVIC_EN0_R &= ~(1 << (INT_TIMER2A-16));             // turn-off interrupt
+    // WFI between events, SysTick stretched to the next timer
+    initSleep();
 
 //    HIB_IM_R  |= HIB_IM_WC;
 //    HIB_CTL_R = 0x40;
@@ -139,29 +225,45 @@ void initHw()
 }
 
 /*
- * converts the raw value into actual value of internal temperature
+ * converts the raw value into tenths of a degree celcius in double precision,
+ * only kept as the reference for the dsp benchmark (see channelAddAnalog)
  */
-int16_t readAdc0Temp()
+int16_t readTempTenths(uint16_t T1)
 {
-    ADC0_PSSI_R |= ADC_PSSI_SS3;
-    while (ADC0_ACTSS_R & ADC_ACTSS_BUSY);           // wait until SS0 is not busy
-    return ADC0_SSFIFO3_R;                           // get single result from the FIFO
+    return 1475 - ((750*T1*3.3)/4096);
 }
 
 /*
- * Gets the internal temperature value in degree celcius
+ * Gets the internal temperature value in degree celcius (filtered)
  */
 char* Get_Temp()
 {
-    int16_t T1 = readAdc0Temp();
-
-    int16_t temp = 147.5 - ((75*T1*3.3)/4096);
+    return itostring(dspOutput(channelGetFilter(tempChannel)) / 10);
+}
 
-    return itostring(temp);
+/*
+ * IFTT for publish: drives the blue LED from the led topic
+ */
+void ledHandler(uint8_t packet[], char* topic, char* data)
+{
+    if(stringcmp("on",data))
+    {
+        setPinValue(BLUE_LED, 1);
+    }else if(stringcmp("off",data))
+    {
+        setPinValue(BLUE_LED, 0);
+    }
+}
 
+/*
+ * IFTT for publish: echoes the udp topic back as a UDP datagram
+ */
+void udpHandler(uint8_t packet[], char* topic, char* data)
+{
+    etherSendUdpResponse(packet,(uint8_t*)data, 9);
 }
 
-void displayConnectionInfo()
+void displayConnectionInfo(USER_DATA* data)
 {
     uint8_t i;
     //char str[10];
@@ -220,473 +322,1114 @@ void displayConnectionInfo()
         putsUart0("Link is down\n\r");
 }
 
+void displayReportStats(USER_DATA* data)
+{
+    uint8_t i;
+    reportStats* stats;
+    for (i = 0; i < reportCount(); i++)
+    {
+        stats = reportGetStats(i);
+        putsUart0(reportName(i));
+        putsUart0(": sent ");
+        putsUart0(itostring(stats->sent));
+        putsUart0(" (heartbeats ");
+        putsUart0(itostring(stats->heartbeats));
+        putsUart0("), suppressed ");
+        putsUart0(itostring(stats->suppressed));
+        putsUart0(", rate limited ");
+        putsUart0(itostring(stats->rateLimited));
+        putsUart0("\n\r");
+    }
+}
 
-//-----------------------------------------------------------------------------
-// Main
-//-----------------------------------------------------------------------------
+/*
+ * Lists every channel with its input, the last raw sample and the filtered
+ * value with its decimal exponent
+ */
+void displayChannels(USER_DATA* data)
+{
+    uint8_t ch;
+    for (ch = 0; ch < channelCount(); ch++)
+    {
+        putsUart0(channelTopic(ch));
+        if (channelType(ch) == CHANNEL_DIGITAL)
+            putsUart0(": digital");
+        else
+        {
+            putsUart0(": ");
+            if (channelInput(ch) == ADC_INPUT_TEMP)
+                putsUart0("TS");
+            else
+            {
+                putsUart0("AIN");
+                putsUart0(itostring(channelInput(ch)));
+            }
+            putsUart0(" at ");
+            putsUart0(itostring(channelRate(ch)));
+            putsUart0(" Hz");
+        }
+        putsUart0(", raw ");
+        putsUart0(itostring(channelLastRaw(ch)));
+        putsUart0(", value ");
+        putsUart0(itostring(dspOutput(channelGetFilter(ch))));
+        putsUart0(" e");
+        putsUart0(itostring(channelExponent(ch)));
+        putsUart0("\n\r");
+    }
+}
 
-// Max packet is calculated as:
-// Ether frame header (18) + Max MTU (1500) + CRC (4)
-#define MAX_PACKET_SIZE 1522
+/*
+ * Times the double formula against the fixed-point pipeline on the last
+ * ADC reading, in cycles per sample including the loop
+ */
+void displayDspBenchmark(USER_DATA* data)
+{
+    dspFilter bench = *channelGetFilter(tempChannel);
+    volatile int32_t sink = 0;
+    uint16_t raw = channelLastRaw(tempChannel);
+    uint32_t start;
+    uint16_t i;
+
+    start = getUptimeMs();
+    for (i = 0; i < DSP_BENCH_RUNS; i++)
+        sink += readTempTenths(raw + (i & 7));
+    putsUart0("double: ");
+    putsUart0(itostring((getUptimeMs() - start) * 40000 / DSP_BENCH_RUNS));
+    putsUart0(" cycles/sample\n\r");
+
+    start = getUptimeMs();
+    for (i = 0; i < DSP_BENCH_RUNS; i++)
+        sink += dspProcess(&bench, raw + (i & 7));
+    putsUart0("fixed point: ");
+    putsUart0(itostring((getUptimeMs() - start) * 40000 / DSP_BENCH_RUNS));
+    putsUart0(" cycles/sample\n\r");
+}
 
-int main(void)
+void displayReconnectStats(USER_DATA* data)
 {
-    uint8_t data[MAX_PACKET_SIZE];
-    char* Pub_topic;
-    char* Pub_data;
-    char* Sub_topic;
-    char* UnSub_topic;
-    SubTopicFrame.Topic_names = 0;
-    uint8_t Switchcase = 0;
+    reconnectStats* stats = reconnectGetStats();
+    putsUart0("Attempts: ");
+    putsUart0(itostring(stats->attempts));
+    putsUart0("\n\rConnected: ");
+    putsUart0(itostring(stats->successes));
+    putsUart0("\n\rHandshake timeouts: ");
+    putsUart0(itostring(stats->timeouts));
+    putsUart0("\n\rSessions lost: ");
+    putsUart0(itostring(stats->losses));
+    putsUart0("\n\rLast outage (ms): ");
+    putsUart0(itostring(stats->lastOutageMs));
+    putsUart0("\n\rMax outage (ms): ");
+    putsUart0(itostring(stats->maxOutageMs));
+    putsUart0("\n\r");
+}
 
-    USER_DATA info;
 
-    // Init controller
-    initHw();
+void displayEventStats(USER_DATA* data)
+{
+    static char* names[MAX_EVENT_TYPES] = {"tick", "ether rx", "sample", "ping", "ping timeout", "reconnect", "mqtt", "cli"};
+    eventStats* stats;
+    uint8_t i;
+    for (i = 0; i < MAX_EVENT_TYPES; i++)
+    {
+        stats = eventGetStats(i);
+        putsUart0(names[i]);
+        putsUart0(": ");
+        putsUart0(itostring(stats->count));
+        putsUart0(", latency ");
+        putsUart0(itostring(stats->lastLatencyUs));
+        putsUart0(" us (max ");
+        putsUart0(itostring(stats->maxLatencyUs));
+        putsUart0("), max run ");
+        putsUart0(itostring(stats->maxRunUs));
+        putsUart0(" us\n\r");
+    }
+    putsUart0("Dropped: ");
+    putsUart0(itostring(eventDropped()));
+    putsUart0("\n\r");
+}
 
-    // Setup UART0 and EEPROM
-    initUart0();
-    setUart0BaudRate(115200, 40e6);
-    initEeprom();
+void displaySleepStats(USER_DATA* data)
+{
+    sleepStats* stats = sleepGetStats();
+    uint32_t uptime = getUptimeMs();
+    putsUart0("Sleeps: ");
+    putsUart0(itostring(stats->sleeps));
+    putsUart0(" (skipped ");
+    putsUart0(itostring(stats->skipped));
+    putsUart0(")\n\rAsleep (ms): ");
+    putsUart0(itostring(stats->sleptMs));
+    putsUart0(" of ");
+    putsUart0(itostring(uptime));
+    putsUart0(" (");
+    putsUart0(itostring(uptime >= 100 ? stats->sleptMs / (uptime / 100) : 0));
+    putsUart0("%)\n\rLast sleep (us): ");
+    putsUart0(itostring(stats->lastSleepUs));
+    putsUart0(", max ");
+    putsUart0(itostring(stats->maxSleepUs));
+    putsUart0("\n\rWake (cycles): ");
+    putsUart0(itostring(stats->lastWakeCycles));
+    putsUart0(", max ");
+    putsUart0(itostring(stats->maxWakeCycles));
+    putsUart0(", over ");
+    putsUart0(itostring(SLEEP_WAKE_BOUND_CYCLES));
+    putsUart0(": ");
+    putsUart0(itostring(stats->overBound));
+    putsUart0("\n\rPacket dispatch latency (us): max ");
+    putsUart0(itostring(eventGetStats(EVENT_ETHER_RX)->maxLatencyUs));
+    putsUart0("\n\r");
+}
 
+/*
+ * Copies the drop counters and queue depths of the other modules into the
+ * "system" stats
+ */
+void systemStatsRefresh()
+{
+    systemCounters.eventDrops = eventDropped();
+    systemCounters.uartTxDrops = uart0TxDropped();
+    systemCounters.uartRxDrops = uart0RxDropped();
+    systemCounters.logDrops = logGetStats()->dropped;
+    systemCounters.batchDepth = batchCount();
+    systemCounters.sleptMs = sleepGetStats()->sleptMs;
+}
 
-    // Init ethernet interface (eth0)
-    putsUart0("\nStarting e0th0\n");
-    putsUart0("\n\r");
-    putsUart0("\nIt is recommended to set MQTT Broker IP before staring the project\n");
-    putsUart0("\n\r");
-    etherSetIpAddress(192,168,1,141);
-    etherSetMacAddress(2, 3, 4, 5, 6, 141);
-    etherSetMqttBrkIp(readEeprom(0x0020),readEeprom(0x0021), readEeprom(0x0022), readEeprom(0x0023));
+//-----------------------------------------------------------------------------
+// MQTT operations
+//-----------------------------------------------------------------------------
 
-    //tcp = true;
-    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+static void opExpired(void* context)
+{
+    mqttOp* op = (mqttOp*)context;
+    op->timer = TIMER_NONE;
+    op->expired = true;
+    eventPost(EVENT_MQTT, 0);
+}
 
+static void opArm(mqttOp* op, uint32_t ms)
+{
+    stopTimer(op->timer);
+    op->expired = false;
+    op->timer = startOneshotTimer(opExpired, op, ms);
+}
 
-    // Flash LED
-    setPinValue(GREEN_LED, 1);
-    waitMicrosecond(100000);
-    setPinValue(GREEN_LED, 0);
-    waitMicrosecond(100000);
+static void opDisarm(mqttOp* op)
+{
+    stopTimer(op->timer);
+    op->timer = TIMER_NONE;
+    op->expired = false;
+}
 
+static void opReset(mqttOp* op)
+{
+    opDisarm(op);
+    PT_INIT(&op->thread);
+}
 
+/*
+ * The IsXxx tests byte swap TCP header fields in place, so every operation
+ * is given the packet as it was received
+ */
+static void rxRewind()
+{
+    uint8_t i;
+    if(rxPacket != NULL)
+    {
+        for(i = 0; i < TCP_HEADER_SIZE; i++)
+            rxPacket[TCP_HEADER_OFFSET + i] = rxHeader[i];
+    }
+}
 
-    // Main Loop
-    // RTOS and interrupts would greatly improve this code,
-    // but the goal here is simplicity
-    while (true)
+/*
+ * Opens a new connection for the flags raised, as every subscribe and
+ * unsubscribe does; what was in flight on the old one is dropped
+ */
+void sessionRestart()
+{
+    opReset(&sessionOp);
+    opReset(&publishOp);
+    opReset(&pingOp);
+    publishSent = false;
+    publishWanted = false;
+    sessionUp = false;
+}
+
+/*
+ * Keeps the addresses, ports and sequence numbers of a frame just sent to
+ * the broker; the next publish on the connection is built over them since
+ * data may hold any other frame by then
+ */
+static void sessionKeep(uint8_t packet[])
+{
+    uint8_t i;
+    for(i = 0; i < sizeof(sessionHeader); i++)
+        sessionHeader[i] = packet[i];
+}
+
+// Puts the kept headers back in front of the next frame on the connection
+static void sessionFrame(uint8_t packet[])
+{
+    uint8_t i;
+    if(sessionUp)
     {
-        // Put terminal processing here
-        if (kbhitUart0())
-        {
-            getsUart0(&info);
-            parseFields(&info);
+        for(i = 0; i < sizeof(sessionHeader); i++)
+            packet[i] = sessionHeader[i];
+    }
+}
 
-            if(isCommand(&info,"temp",1))
-            {
-                putsUart0(Get_Temp());
-            }
+/*
+ * Raises Pubflag for Pub_topic: an established session sends it on its
+ * connection, otherwise (or if a publish is still unacknowledged) a new
+ * connection is opened for it
+ */
+static void publishStart()
+{
+    if(sessionUp && !Pubflag)
+        publishWanted = true;
+    else
+        sessionRestart();
+    Pubflag = true;
+}
 
-            if(isCommand(&info,"set",2))
-            {
-                if(stringcmp("mqtt",getFieldString(&info,2)))
-                {
-                    etherSetMqttBrkIp(getFieldInteger(&info,3), getFieldInteger(&info,4), getFieldInteger(&info,5), getFieldInteger(&info,6));
-                    writeEeprom(0x0020,getFieldInteger(&info,3));
-                    writeEeprom(0x0021,getFieldInteger(&info,4));
-                    writeEeprom(0x0022,getFieldInteger(&info,5));
-                    writeEeprom(0x0023,getFieldInteger(&info,6));
-                }
+/*
+ * Ends the exchange of the current publish; once the final batch is out,
+ * finishes the shutdown that waited for it
+ */
+static void publishDone()
+{
+    Pubflag = false;
+    if(shutdownPending && batchCount() == 0)
+    {
+        if(shutdownPending == SHUTDOWN_DISCONNECT)
+            Disflag = true;
+        if(shutdownPending == SHUTDOWN_REBOOT)
+            NVIC_APINT_R = 0x05FA0004;
+        shutdownPending = SHUTDOWN_NONE;
+    }
+}
 
-            }
+/*
+ * A publish that cannot be built would fail the same way on every retry,
+ * so it is dropped and the next one may go
+ */
+static void publishSend(uint8_t packet[])
+{
+    bool sent;
+    sessionFrame(packet);
+    if(Pub_writer != NULL)
+        sent = SendMqttPublishWriter(packet,Pub_topic,Pub_writer,Pub_context);
+    else
+        sent = SendMqttPublishClient(packet,Pub_topic,Pub_data);
+    publishWanted = false;
+    if(!sent)
+    {
+        LOG0(LOG_PUBLISH_DROP);
+        clientCounters.publishDrops++;
+        publishDone();
+        return;
+    }
+    sessionKeep(packet);
+    publishSent = true;
+    clientCounters.publishes++;
+}
 
-            if(isCommand(&info,"help",2))
-            {
-                if(stringcmp("inputs",getFieldString(&info,2)))
-                {
-                    putsUart0("INPUTS 1. LED : subscribe led (give this command from putty and publish with topic name led and with data on/off on another mosquitto Client)\r\n");
-                    putsUart0("       2. Internal temperature: Temperature sensor will be publishing the temperature data with the topic name temperature for every 50 seconds\r\n");
-                    putsUart0("       3. UDP: give the following command in sfk shell (for windows) ----> sfk udpsend 192.168.1.141:5000 -listen ''hello''\r\n");
-                    putsUart0("               192.168.1.141 is IP of red board and 5000 is UDP port and hello is a UDP data\r\n");
-                }
-
-                if(stringcmp("outputs",getFieldString(&info,2)))
-                {
-                    putsUart0("OUTPUTS 1. LED: when subscribed to the led topic give the following commands through another mosquitto client (for windows):\r\n");
-                    putsUart0("                mosquitto_pub -h (broker IP) -t led -m on ------> If this command is given, then BLUE LED turns on\r\n");
-                    putsUart0("                mosquitto_pub -h (broker IP) -t led -m off ------> If this command is given, then BLUE LED turns off\r\n");
-                    putsUart0("\r\n");
-                    putsUart0("        2. Internal temperature: The incoming temperature data from RED BOARD can be subscribed through another mosquitto client with the topic name temperature\r\n");
-                    putsUart0("        3. UDP: when the command is given in sfk shell as mentioned in Inputs, Red Board publishes the UDP data with the topic name udp\r\n");
-                }
-
-                if(stringcmp("subs",getFieldString(&info,2)))
-                {
-                    putsUart0("Subscribed Topics are: \r\n");
-                    uint8_t i;
-                    for(i = 0; i < 9; i++)
-                    {
-                        putsUart0(SubTopicFrame.SubTopicArr[i]);
-                        putsUart0("\n\r");
-                        i++;
-                    }
-                }
+/*
+ * SYN, SYN ACK, ACK and CONNECT, CONNACK; then the SUBACKs and UNSUBACKs
+ * of the connection until sessionRestart()
+ */
+static PT_THREAD(sessionThread(mqttOp* op))
+{
+    PT_BEGIN(&op->thread);
 
-            }
+    PT_WAIT_UNTIL(&op->thread, Pubflag || Subflag || UnSubflag || Conflag);
+    SendTcpSynmessage(data);
+    rxPacket = NULL;
+    opArm(op, SESSION_TIMEOUT_MS);
 
-            if(isCommand(&info,"publish",3))
-            {
-                Pub_topic = getFieldString(&info,2);
-                Pub_data = getFieldString(&info,3);
-                Pubflag = true;
-                tcpstate = TCPCLOSED;
-            }
+    PT_YIELD_UNTIL(&op->thread, op->expired || (rxPacket != NULL && IsTcpSynAck(rxPacket)));
+    if(!op->expired)
+    {
+        SendTcpAck(rxPacket);
+        SendMqttConnect(rxPacket, mqttGetConnectOptions());
+        rxPacket = NULL;
 
-            if(isCommand(&info,"connect",1))
-            {
-                Conflag = true;
-                tcpstate = TCPCLOSED;
-            }
+        PT_YIELD_UNTIL(&op->thread, op->expired || (rxPacket != NULL && IsMqttConnectAck(rxPacket)));
+    }
+    if(op->expired)
+    {
+        clientCounters.sessionTimeouts++;
+        if(Conflag)
+        {
+            // reconnect.c times the attempt out too and raises Conflag
+            // again after its backoff
+            Conflag = false;
+            PT_WAIT_UNTIL(&op->thread, Conflag);
+        }
+        else
+        {
+            // a publish or subscribe tries again itself, just as spaced out
+            if(sessionRetries < 255)
+                sessionRetries++;
+            opArm(op, reconnectBackoff(sessionRetries));
+            PT_WAIT_UNTIL(&op->thread, op->expired);
+        }
+        PT_RESTART(&op->thread);
+    }
+    opDisarm(op);
+    sessionRetries = 0;
+    reconnectConnected();
+    LOG0(LOG_CONNECTED);
+    clientCounters.connects++;
+
+    // CONNACK first: it resets the alias table and carries the broker's
+    // limits, which the publish below is built against
+    mqttProcessConnAck(etherGetTcpData(rxPacket), etherGetTcpDataSize(rxPacket));
+    SendTcpAck1(rxPacket);
+
+    // the publish that opened the connection goes first
+    if(Pubflag)
+        publishSend(rxPacket);
+
+    //Replay the subscription store only if the broker has not
+    //kept our session, otherwise just send what changed
+    mqttSendPending(rxPacket);
+    sessionKeep(rxPacket);
+    rxPacket = NULL;
+    Subflag = false;
+    UnSubflag = false;
+    Conflag = false;
+    sessionUp = true;
+
+    /*
+     * SUBACKs and UNSUBACKs are matched by packet ID, so any number
+     * of them may be outstanding and arrive in any order; a publish
+     * started meanwhile goes out once no packet is being offered
+     */
+    while(true)
+    {
+        PT_YIELD_UNTIL(&op->thread, rxPacket != NULL || publishWanted);
+        if(rxPacket == NULL)
+            publishSend(data);
+        else if(IsSubAck(rxPacket) || IsUnsubAck(rxPacket))
+        {
+            mqttProcessAcks(etherGetTcpData(rxPacket), etherGetTcpDataSize(rxPacket));
+            SendTcpAck1(rxPacket);
+            sessionKeep(rxPacket);
+            rxPacket = NULL;
+        }
+    }
 
-            if(isCommand(&info,"subscribe",2))
-            {
-                Sub_topic = getFieldString(&info,2);
-                Subflag = true;
-                //pingflag = false;
-                tcpstate = TCPCLOSED;
-            }
+    PT_END(&op->thread);
+}
 
-            if(isCommand(&info,"unsubscribe",2))
-            {
-                UnSub_topic = getFieldString(&info,2);
-                UnSubflag = true;
-                tcpstate = TCPCLOSED;
-            }
+static void publishAcked()
+{
+    clientCounters.publishAcks++;
+    publishDone();
+}
 
-            if(isCommand(&info,"disconnect",1))
-            {
-                setPinValue(RED_LED, 0);
-                pingflag = false;
-                Disflag = true;
-            }
+/*
+ * Waits for the ack of the publish the session sent: a TCP ACK at QoS 0,
+ * PUBACK at QoS 1, PUBREC then PUBCOMP at QoS 2; a publish that is not
+ * acknowledged in time is sent again on a new connection
+ */
+static PT_THREAD(publishThread(mqttOp* op))
+{
+    PT_BEGIN(&op->thread);
 
-            if(isCommand(&info,"ifconfig",1))
-            {
-                displayConnectionInfo();
-            }
+    PT_WAIT_UNTIL(&op->thread, publishSent);
+    publishSent = false;
+    opArm(op, PUBLISH_TIMEOUT_MS);
 
-            if(isCommand(&info,"reboot",1))
-            {
-                NVIC_APINT_R = 0x05FA0004;
-            }
+    while(true)
+    {
+        PT_YIELD_UNTIL(&op->thread, op->expired || rxPacket != NULL);
+        if(op->expired)
+        {
+            // Pubflag is still raised, the session publishes again
+            clientCounters.publishRetries++;
+            sessionRestart();
+            PT_EXIT(&op->thread);
+        }
 
+        if(AvdSYN && IsTcpAck(rxPacket))
+        {
+            publishAcked();
+            break;
         }
+        rxRewind();
 
-        /*
-         * Publishes internal temperature for every 50 seconds
-         */
-        if(TIMER2_TAV_R > 40e6)
+        if(IsPubAck(rxPacket))
         {
-            counterTimer2++;
-            TIMER2_TAV_R = 0;
+            SendTcpAck1(rxPacket);
+            sessionKeep(rxPacket);
+            rxPacket = NULL;
+            publishAcked();
+            break;
         }
+        rxRewind();
 
-        if(counterTimer2 > 50)
+        // Pubflag stays raised until PUBCOMP, so no other publish
+        // restarts the session in between
+        if(IsPubRec(rxPacket))
         {
-            tcpstate = TCPCLOSED;
-            Pubflag = true;
-            Pub_topic = "temperature";
-            Pub_data = Get_Temp();
-            TIMER2_TAV_R = 0;
-            counterTimer2 = 0;
-            Switchcase = PUB;
+            SendMqttPublishRel(rxPacket);
+            sessionKeep(rxPacket);
+            rxPacket = NULL;
         }
+        else if(IsPubCom(rxPacket))
+        {
+            SendTcpAck1(rxPacket);
+            sessionKeep(rxPacket);
+            rxPacket = NULL;
+            publishAcked();
+            break;
+        }
+    }
+    opDisarm(op);
+
+    PT_END(&op->thread);
+}
+
+/*
+ * PINGREQ and its PINGRESP; keepalive.c times the response out
+ */
+static PT_THREAD(pingThread(mqttOp* op))
+{
+    PT_BEGIN(&op->thread);
+
+    PT_WAIT_UNTIL(&op->thread, pingWanted);
+    pingWanted = false;
+    sessionFrame(data);
+    SendMqttPingRequest(data);
+    sessionKeep(data);
+    clientCounters.pings++;
+    rxPacket = NULL;
+
+    PT_YIELD_UNTIL(&op->thread, rxPacket != NULL && IsMqttPingResponse(rxPacket));
+    keepAliveReceived();
+    SendTcpAck1(rxPacket);
+    sessionKeep(rxPacket);
+    rxPacket = NULL;
+
+    PT_END(&op->thread);
+}
+
+/*
+ * DISCONNECT, then FIN once the broker closes its side
+ */
+static PT_THREAD(disconnectThread(mqttOp* op))
+{
+    PT_BEGIN(&op->thread);
+
+    PT_WAIT_UNTIL(&op->thread, Disflag);
+    Disflag = false;
+    sessionFrame(data);
+    sendMqttDisconnectRequest(data);
+    sessionKeep(data);
+    rxPacket = NULL;
+    opArm(op, DISCONNECT_TIMEOUT_MS);
+
+    PT_YIELD_UNTIL(&op->thread, op->expired || (rxPacket != NULL && ISTcpFinAck(rxPacket)));
+    keepAliveStop();
+    if(!op->expired)
+    {
+        SendTcpFin(rxPacket);
+        rxPacket = NULL;
+    }
+    opDisarm(op);
+    sessionRestart();
+
+    PT_END(&op->thread);
+}
+
+/*
+ * Runs every operation once, offering packet (NULL for none) to each
+ */
+void mqttRun(uint8_t packet[])
+{
+    uint8_t i;
+    rxPacket = packet;
+    if(packet != NULL)
+    {
+        for(i = 0; i < TCP_HEADER_SIZE; i++)
+            rxHeader[i] = packet[TCP_HEADER_OFFSET + i];
+    }
+
+    sessionThread(&sessionOp);
+    rxRewind();
+    publishThread(&publishOp);
+    rxRewind();
+    pingThread(&pingOp);
+    rxRewind();
+    disconnectThread(&disconnectOp);
+    rxRewind();
+
+    // A FIN nobody waited for: the broker closed the connection, which is
+    // noticed now rather than when the next PINGREQ goes unanswered
+    if(sessionUp && rxPacket != NULL && ISTcpFinAck(rxPacket))
+    {
+        LOG0(LOG_BROKER_CLOSED);
+        SendTcpFin(rxPacket);
+        keepAliveStop();
+        sessionUp = false;
+        reconnectLost();
+    }
+    rxPacket = NULL;
+}
 
-        // Packet processing
+//-----------------------------------------------------------------------------
+// Commands
+//-----------------------------------------------------------------------------
+
+void tempCommand(USER_DATA* data)
+{
+    putsUart0(Get_Temp());
+}
+
+/*
+ * set <setting> <values>: MQTT options, telemetry format and report policy
+ */
+void setCommand(USER_DATA* data)
+{
+    if(stringcmp("version",getFieldString(data,2)))
+    {
+        // MQTT protocol level used by the next CONNECT: 4 (3.1.1) or 5
+        if(getFieldInteger(data,3) == 4 || getFieldInteger(data,3) == 5)
+            mqttGetConnectOptions()->protocolLevel = getFieldInteger(data,3);
+    }
+
+    // temperature payload: text or cbor
+    if(stringcmp("format",getFieldString(data,2)))
+    {
+        telemetryCbor = stringcmp("cbor",getFieldString(data,3));
+    }
+
+    // cbor batches: set batch <samples> <ms>, set threshold <tenths|off>, set flush on|off
+    if(stringcmp("batch",getFieldString(data,2)))
+    {
+        if(getFieldInteger(data,3) > 0 && getFieldInteger(data,3) <= BATCH_MAX_SAMPLES)
+            batchGetConfig()->maxSamples = getFieldInteger(data,3);
+        if(getFieldInteger(data,4) > 0)
+            batchGetConfig()->maxAgeMs = getFieldInteger(data,4);
+    }
+
+    if(stringcmp("threshold",getFieldString(data,2)))
+    {
+        batchGetConfig()->thresholdEnabled = !stringcmp("off",getFieldString(data,3));
+        batchGetConfig()->threshold = getFieldInteger(data,3);
+    }
+
+    // report policy: set deadband <tenths> <permille>, set interval <min ms> <max ms>
+    if(stringcmp("deadband",getFieldString(data,2)))
+    {
+        reportGetPolicy(channelReport(tempChannel))->absDeadband = getFieldInteger(data,3);
+        reportGetPolicy(channelReport(tempChannel))->relDeadband = getFieldInteger(data,4);
+    }
+
+    if(stringcmp("interval",getFieldString(data,2)))
+    {
+        reportGetPolicy(channelReport(tempChannel))->minIntervalMs = getFieldInteger(data,3);
+        reportGetPolicy(channelReport(tempChannel))->maxIntervalMs = getFieldInteger(data,4);
+    }
+
+    // temperature filter: set filter avg <n>, iir <permille>, median <n>, off
+    if(stringcmp("filter",getFieldString(data,2)))
+    {
+        if(stringcmp("avg",getFieldString(data,3)))
+            dspSetAverage(channelGetFilter(tempChannel), getFieldInteger(data,4));
+        if(stringcmp("iir",getFieldString(data,3)) && getFieldInteger(data,4) > 0 && getFieldInteger(data,4) <= 1000)
+            dspSetIir(channelGetFilter(tempChannel), getFieldInteger(data,4) * 32767 / 1000);
+        if(stringcmp("median",getFieldString(data,3)))
+            dspSetMedian(channelGetFilter(tempChannel), getFieldInteger(data,4));
+        if(stringcmp("off",getFieldString(data,3)))
+            dspSetNone(channelGetFilter(tempChannel));
+    }
+
+    if(stringcmp("flush",getFieldString(data,2)))
+    {
+        batchGetConfig()->flushOnShutdown = stringcmp("on",getFieldString(data,3));
+    }
+
+    // v5 properties attached to our publishes
+    if(stringcmp("expiry",getFieldString(data,2)))
+    {
+        mqttGetPublishOptions()->messageExpiry = getFieldInteger(data,3);
+    }
 
-        /*
-         * Sends TCP SYN
-         */
+    if(stringcmp("correlation",getFieldString(data,2)))
+    {
+        mqttSetCorrelationData(getFieldString(data,3));
+    }
 
-        if(tcpstate == TCPCLOSED)
+    if(stringcmp("userprop",getFieldString(data,2)))
+    {
+        mqttSetUserProperty(getFieldString(data,3), getFieldString(data,4));
+    }
+
+    if(stringcmp("mqtt",getFieldString(data,2)))
+    {
+        // used right away and saved with the rest of the config
+        etherSetMqttBrkIp(getFieldInteger(data,3), getFieldInteger(data,4), getFieldInteger(data,5), getFieldInteger(data,6));
+        etherGetMqttBrkIpAddress(configEdit()->brokerIp);
+        if(!configCommit())
+            putsUart0("EEPROM write failed\n\r");
+    }
+}
+
+/*
+ * help inputs, help outputs, help subs
+ */
+void helpTopics(USER_DATA* data)
+{
+    if(stringcmp("inputs",getFieldString(data,2)))
+    {
+        putsUart0("INPUTS 1. LED : subscribe led (give this command from putty and publish with topic name led and with data on/off on another mosquitto Client)\r\n");
+        putsUart0("       2. Internal temperature: Temperature sensor will be publishing the temperature data with the topic name temperature when it changes by 0.5 C, and at least every 50 seconds\r\n");
+        putsUart0("       3. UDP: give the following command in sfk shell (for windows) ----> sfk udpsend (board IP):5000 -listen ''hello''\r\n");
+        putsUart0("               the board IP is config get ip, 5000 is UDP port and hello is a UDP data\r\n");
+    }
+
+    if(stringcmp("outputs",getFieldString(data,2)))
+    {
+        putsUart0("OUTPUTS 1. LED: when subscribed to the led topic give the following commands through another mosquitto client (for windows):\r\n");
+        putsUart0("                mosquitto_pub -h (broker IP) -t led -m on ------> If this command is given, then BLUE LED turns on\r\n");
+        putsUart0("                mosquitto_pub -h (broker IP) -t led -m off ------> If this command is given, then BLUE LED turns off\r\n");
+        putsUart0("\r\n");
+        putsUart0("        2. Internal temperature: The incoming temperature data from RED BOARD can be subscribed through another mosquitto client with the topic name temperature\r\n");
+        putsUart0("        3. UDP: when the command is given in sfk shell as mentioned in Inputs, Red Board publishes the UDP data with the topic name udp\r\n");
+    }
+
+    if(stringcmp("subs",getFieldString(data,2)))
+    {
+        putsUart0("Subscribed Topics are: \r\n");
+        uint8_t i;
+        for(i = 0; i < mqttSubCount(); i++)
         {
-            if(Pubflag || Subflag || UnSubflag || Conflag)
-            {
-                SendTcpSynmessage(data);
-                tcpstate = TCPLISTEN;
-            }
+            putsUart0(mqttSubTopic(i));
+            if(mqttSubState(i) != MQTT_SUB_ACTIVE)
+                putsUart0(" (pending)");
+            putsUart0("\n\r");
         }
+    }
+}
 
-        /*
-         * sends Ping request for every 30 seconds
-         */
-        if(pingflag)
-        {
-            if(TIMER4_TAV_R > 40e6)
-            {
-                counterTimer++;
-                TIMER4_TAV_R = 0;
-            }
+void publishCommand(USER_DATA* data)
+{
+    char* topic = getFieldString(data,2);
+    char* text = getFieldString(data,3);
+    uint8_t i = 0, j;
+
+    // both are fields of one line, so they fit together
+    for(j = 0; topic[j] != '\0'; j++)
+        publishLine[i++] = topic[j];
+    publishLine[i++] = '\0';
+    Pub_topic = publishLine;
+    Pub_data = &publishLine[i];
+    for(j = 0; text[j] != '\0'; j++)
+        publishLine[i++] = text[j];
+    publishLine[i] = '\0';
+    Pub_writer = NULL;
+    publishStart();
+}
 
-            if(counterTimer > 30)
-            {
-                SendMqttPingRequest(data);
-                TIMER4_TAV_R = 0;
-                counterTimer = 0;
-                Switchcase = PING;
-            }
-        }
+void connectCommand(USER_DATA* data)
+{
+    // retried with backoff until the broker accepts
+    reconnectStart();
+}
 
-        /*
-         * Sends MQTT disconnect
-         */
-        if(Disflag)
+void subscribeCommand(USER_DATA* data)
+{
+    if(mqttSubAdd(getFieldString(data,2), configGet()->subscribeQos))
+        mqttSubSave();
+    Subflag = true;
+    sessionRestart();
+}
+
+void unsubscribeCommand(USER_DATA* data)
+{
+    if(mqttSubRemove(getFieldString(data,2)))
+        mqttSubSave();
+    UnSubflag = true;
+    sessionRestart();
+}
+
+void disconnectCommand(USER_DATA* data)
+{
+    setPinValue(RED_LED, 0);
+    keepAliveStop();
+    reconnectStop();
+    if(telemetryCbor && batchGetConfig()->flushOnShutdown && batchCount() > 0)
+        shutdownPending = SHUTDOWN_DISCONNECT;
+    else
+        Disflag = true;
+}
+
+void rebootCommand(USER_DATA* data)
+{
+    if(telemetryCbor && batchGetConfig()->flushOnShutdown && batchCount() > 0)
+        shutdownPending = SHUTDOWN_REBOOT;
+    else
+        NVIC_APINT_R = 0x05FA0004;
+}
+
+/*
+ * Registers the console commands, help lists them in this order
+ */
+void initCommands()
+{
+    initCli();
+    cliSetHelpTopics(helpTopics);
+    cliRegister("set", 2, setCommand, "version|format|batch|threshold|deadband|interval|filter|flush|expiry|correlation|userprop|mqtt <values>");
+    cliRegister("connect", 1, connectCommand, "connect to the broker, retried until accepted");
+    cliRegister("publish", 3, publishCommand, "<topic> <data>");
+    cliRegister("subscribe", 2, subscribeCommand, "<topic filter>");
+    cliRegister("unsubscribe", 2, unsubscribeCommand, "<topic filter>");
+    cliRegister("disconnect", 1, disconnectCommand, "close the session");
+    cliRegister("temp", 1, tempCommand, "temperature now");
+    cliRegister("ifconfig", 1, displayConnectionInfo, "addresses and link");
+    cliRegister("channels", 1, displayChannels, "inputs and their last values");
+    cliRegister("reports", 1, displayReportStats, "published and suppressed reports");
+    cliRegister("reconnect", 1, displayReconnectStats, "connection attempts and outages");
+    cliRegister("dsp", 1, displayDspBenchmark, "double against fixed point cycles");
+    cliRegister("events", 1, displayEventStats, "dispatch counts and latency");
+    cliRegister("sleep", 1, displaySleepStats, "time asleep and wake latency");
+    cliRegister("reboot", 1, rebootCommand, "reset, after flushing the batch");
+}
+
+//-----------------------------------------------------------------------------
+// Event handlers
+//-----------------------------------------------------------------------------
+
+/*
+ * EVENT_CLI: characters were received, run the command line once Enter
+ * completes it
+ */
+void cliHandler(uint8_t type, uint8_t arg)
+{
+    if(!getsUart0(&info))
+        return;
+    parseFields(&info);
+    cliDispatch(&info);
+
+    // the command may have raised a flag for the client
+    eventPost(EVENT_MQTT, 0);
+
+    // type-ahead of the next line
+    if(kbhitUart0())
+        eventPost(EVENT_CLI, 0);
+}
+
+/*
+ * EVENT_SAMPLE: an ADC block (or the digital tick) is ready, each report
+ * that fired is published by the MQTT handler
+ */
+void sensorHandler(uint8_t type, uint8_t arg)
+{
+    if(channelService(getUptimeMs()))
+        eventPost(EVENT_MQTT, 0);
+}
+
+/*
+ * EVENT_MQTT: starts whatever the client has to send next; posted whenever
+ * a flag, a due channel or the batch may have changed
+ */
+void mqttHandler(uint8_t type, uint8_t arg)
+{
+    uint8_t ch;
+
+    /*
+     * Each report that fired is published on the channel topic once the
+     * previous publish is done, temperature goes into the batch instead in
+     * cbor format
+     */
+    while(!Pubflag)
+    {
+        ch = channelNextDue();
+        if(ch == CHANNEL_NONE)
+            break;
+        LOG2(LOG_REPORT, ch, channelValue(ch));
+        if(ch == tempChannel && telemetryCbor)
+        {
+            if(!shutdownPending)
+                batchAdd(getUptimeMs(), channelValue(ch));
+        }
+        else
         {
-            sendMqttDisconnectRequest(data);
-            Disflag = false;
-            Switchcase = DISCON;
+            publishStart();
+            Pub_topic = channelTopic(ch);
+            Pub_data = channelText(ch);
+            Pub_writer = NULL;
         }
+    }
+
+    // a batch is published only after the previous publish completed
+    if(telemetryCbor && !Pubflag && (batchReady(getUptimeMs()) || (shutdownPending && batchCount() > 0)))
+    {
+        publishStart();
+        Pub_topic = "temperature";
+        Pub_writer = batchPayload;
+        Pub_context = batchTake();
+    }
+
+    // board health, skipped while the client is not connected
+    if(!Pubflag && statsDue() && reconnectState() == RECONNECT_CONNECTED)
+    {
+        publishStart();
+        Pub_topic = statsTopic();
+        Pub_writer = statsPayload;
+        Pub_context = NULL;
+    }
+
+    mqttRun(NULL);
+}
+
+/*
+ * EVENT_PING: nothing else was sent for most of the keep-alive interval
+ */
+void pingHandler(uint8_t type, uint8_t arg)
+{
+    pingWanted = true;
+    mqttRun(NULL);
+}
+
+/*
+ * EVENT_PING_TIMEOUT: the Ping response did not come, reconnect
+ */
+void pingTimeoutHandler(uint8_t type, uint8_t arg)
+{
+    LOG0(LOG_SESSION_LOST);
+    clientCounters.pingTimeouts++;
+    sessionUp = false;
+    reconnectLost();
+}
+
+/*
+ * EVENT_RECONNECT: starts a new handshake, right after a loss, then with
+ * backoff while the broker is away
+ */
+void reconnectHandler(uint8_t type, uint8_t arg)
+{
+    // a disconnect may have come after the event was posted
+    if(reconnectState() != RECONNECT_CONNECTING)
+        return;
+    LOG0(LOG_CONNECT);
+    Conflag = true;
+    sessionRestart();
+    eventPost(EVENT_MQTT, 0);
+}
+
+// End of the red LED blink that marks an RX buffer overflow
+static void overflowLedOff(void* context)
+{
+    overflowLedTimer = TIMER_NONE;
+    setPinValue(RED_LED, 0);
+}
+
+/*
+ * EVENT_ETHER_RX: the ENC28J60 has packets waiting; one is processed per
+ * event so that a burst of frames does not hold off the other handlers
+ */
+void etherRxHandler(uint8_t type, uint8_t arg)
+{
+    bool publish;
+
+    if (!etherIsDataAvailable())
+    {
+        etherAckInterrupt();
+        return;
+    }
+    PROF_BEGIN(PROF_RX_TOTAL);
+
+    // blink without holding off the receive path
+    if (etherIsOverflow())
+    {
+        setPinValue(RED_LED, 1);
+        stopTimer(overflowLedTimer);
+        overflowLedTimer = startOneshotTimer(overflowLedOff, NULL, OVERFLOW_BLINK_MS);
+    }
 
-        if (etherIsDataAvailable())
+    // Get packet
+    PROF_BEGIN(PROF_RX_GET);
+    etherGetPacket(data, MAX_PACKET_SIZE);
+    PROF_END(PROF_RX_GET);
+
+    // Handle ARP request
+    PROF_BEGIN(PROF_CLASSIFY);
+    if (etherIsArpRequest(data))
+    {
+        etherSendArpResponse(data);
+    }
+
+    /*
+     * sfk udpsend 192.168.1.141:5000 -listen "hello" (for windows)
+     *
+     * If UDP data is sent by sfk file, the UDP data converts into MQTT and publishes the
+     * UDP data with the topic name "udp"
+     *
+     * Sendip for linux
+     */
+
+    if (etherIsUdp(data))
+    {
+        Pub_data = etherGetUdpData(data);
+        publishStart();
+        Pub_topic = "udp";
+        Pub_writer = NULL;
+    }
+
+    // Handle IP datagram
+    if (etherIsIp(data))
+    {
+        if (etherIsIpUnicast(data))
         {
-            if (etherIsOverflow())
+            // handle icmp ping request
+            if (etherIsPingRequest(data))
             {
-                setPinValue(RED_LED, 1);
-                waitMicrosecond(100000);
-                setPinValue(RED_LED, 0);
+                etherSendPingResponse(data);
             }
 
-            // Get packet
-            etherGetPacket(data, MAX_PACKET_SIZE);
+        }
+    }
 
-            // Handle ARP request
-            if (etherIsArpRequest(data))
-            {
-                etherSendArpResponse(data);
-            }
+    /*
+     * Returns true when broker publishes the data
+     */
+    publish = IsMqttpublishServer(data);
+    PROF_END(PROF_CLASSIFY);
 
-            /*
-             * sfk udpsend 192.168.1.141:5000 -listen "hello" (for windows)
-             *
-             * If UDP data is sent by sfk file, the UDP data converts into MQTT and publishes the
-             * UDP data with the topic name "udp"
-             *
-             * Sendip for linux
-             */
+    PROF_BEGIN(PROF_MQTT);
+    if(publish)
+    {
+        Elements pub;
+        clientCounters.received++;
+        // collects the data and topic from MQTT broker when it publishes
+        pub = CollectPubData(data);
+        putsUart0(pub.Data);
+        putsUart0("\n\r");
+        SendTcpAck1(data);
+        sessionKeep(data);
+        topicDispatch(data, pub.topic, pub.Data);
+    }
+    else
+    {
+        // SYN ACK, CONNACK and the acks the operations are waiting for
+        mqttRun(data);
+    }
+    PROF_END(PROF_MQTT);
 
-            if (etherIsUdp(data))
-            {
-                Pub_data = etherGetUdpData(data);
-                tcpstate = TCPCLOSED;
-                Pubflag = true;
-                Pub_topic = "udp";
-            }
+    // the packet may have completed a publish or raised a flag
+    eventPost(EVENT_MQTT, 0);
 
-            // Handle IP datagram
-            if (etherIsIp(data))
-            {
-                if (etherIsIpUnicast(data))
-                {
-                    // handle icmp ping request
-                    if (etherIsPingRequest(data))
-                    {
-                        etherSendPingResponse(data);
-                    }
-
-                }
-            }
+    PROF_END(PROF_RX_TOTAL);
 
-            /*
-             * Returns true when broker publishes the data
-             */
+    // INT stays asserted while packets are waiting, so it fires again
+    // as soon as it is unmasked if one arrived in the meantime
+    if (etherIsDataAvailable())
+        eventPost(EVENT_ETHER_RX, 0);
+    else
+        etherAckInterrupt();
+}
 
-            if(IsMqttpublishServer(data))
-            {
-                Elements pub;
-                // collects the data and topic from MQTT broker when it publishes
-                pub = CollectPubData(data);
-                putsUart0(pub.Data);
-                putsUart0("\n\r");
-                SendTcpAck1(data);
-                /*
-                 * IFTT for publish
-                 */
-                if(stringcmp("led",pub.topic))
-                {
-                    if(stringcmp("on",pub.Data))
-                    {
-                        setPinValue(BLUE_LED, 1);
-                    }else if(stringcmp("off",pub.Data))
-                    {
-                        setPinValue(BLUE_LED, 0);
-                    }
-                }
-                else if(stringcmp("udp",pub.topic))
-                {
-                    etherSendUdpResponse(data,(uint8_t*)pub.Data, 9);
-                }
-            }
+//-----------------------------------------------------------------------------
+// Main
+//-----------------------------------------------------------------------------
 
-            /*
-             * check wether SYN ACk is received
-             */
-            if(tcpstate == TCPLISTEN)
-            {
-                if(IsTcpSynAck(data))
-                {
-                    tcpstate =  TCPSYN_RECV;
-                }
-            }
+int main(void)
+{
+    configRecord* config;
+    uint8_t mac[6];
 
-            /*
-             * Send ACk and Connect command
-             */
-            if(tcpstate == TCPSYN_RECV)
-            {
-                SendTcpAck(data);
-                _delay_cycles(6);
-                SendTcpPushAck(data);
-                tcpstate = TCPESTABLISHED;
-            }
+    // Queues first, initTimers() subscribes EVENT_TICK
+    initEvents();
 
-            if(tcpstate == TCPESTABLISHED)
-            {
-                /*
-                 * check for the states (publish or subscribe or unsubscribe or ping response or Fin ack when disconnect request is sent)
-                 */
-                switch(Switchcase)
-                {
-                case PUB:
-                    if(AvdSYN)
-                    {
-                        if(IsTcpAck(data))//it comes when QoS level of publish is 0
-                        {
-                            Pubflag = false;
-                            AvdSYN = true;
-                            Switchcase = 0;
-                            pingflag = true;
-                        }
-                    }
-
-                    if(IsPubAck(data)) // it comes when QoS level of publish is 1
-                    {
-                        SendTcpAck1(data);
-                        Pubflag = false;
-                        Switchcase = 0;
-                        pingflag = true;
-                    }
-
-                    if(IsPubRec(data)) // it comes when QoS level of publish is 2
-                    {
-                        SendMqttPublishRel(data);
-                        Pubflag = false;
-                    }
-
-                    if(IsPubCom(data))
-                    {
-                        SendTcpAck1(data);
-                        Switchcase = 0;
-                        pingflag = true;
-                    }
-                    break;
-
-                case SUB:
-                    if(IsSubAck(data))
-                    {
-                        SendTcpAck1(data);
-                        TIMER4_TAV_R = 0;
-                        Switchcase = 0;
-                    }
-                    break;
-
-                case UNSUB:
-                    if(IsUnsubAck(data))
-                    {
-                        SendTcpAck1(data);
-                        Switchcase = 0;
-                        UnSubflag = false;
-                        uint8_t i;
-                        for(i = 0; i < 10; i++)
-                        {
-                            if(stringcmp(SubTopicFrame.SubTopicArr[i], UnSub_topic))
-                            {
-                                break;
-                            }
-                        }
-
-                        while(i < 9)
-                        {
-                            stringCopy(SubTopicFrame.SubTopicArr[i], SubTopicFrame.SubTopicArr[i+1]);
-                            i++;
-                        }
-
-                        i = 0;
-                        //pingflag = true;
-                    }
-                    break;
-
-                case PING:
-
-                    if(IsMqttPingResponse(data))
-                    {
-                        SendTcpAck1(data);
-                        Switchcase = 0;
-                    }
-                    break;
-
-                case DISCON:
-                    if(ISTcpFinAck(data))
-                    {
-                        pingflag = false;
-                        SendTcpFin(data);
-                        Disflag = false;
-                        tcpstate = TCPCLOSED;
-                        Switchcase = 0;
-                    }
-                    break;
-
-                default:
-
-                    break;
-
-                }
-
-                /*
-                 * check weather MQTT connect ACK is received
-                 */
-                if(IsMqttConnectAck(data))
-                {
-                    SendTcpAck1(data);
-                    _delay_cycles(6);
-
-                    //Sends Publish message
-                    if(Pubflag)//if client is sending publish
-                    {
-                        SendMqttPublishClient(data,Pub_topic,Pub_data);
-                        Switchcase = PUB;
-
-                    }
-
-                    //Sends Subscribe message
-                    if(Subflag)// if client is sending subscribe
-                    {
-                        SendMqttSubscribeClient(data,Sub_topic);
-                        Switchcase = SUB;
-                        Subflag = false;
-
-                    }
-
-                    //Sends Unsubscribe message
-                    if(UnSubflag)// if client is sending unsubscribe
-                    {
-                        SendMqttUnSubscribeClient(data,UnSub_topic);
-                        Switchcase = UNSUB;
-                    }
-                }
+    // Init controller
+    initHw();
 
-            }
+    // Setup UART0 and EEPROM
+    initUart0();
+    setUart0BaudRate(115200, 40e6);
+    initEeprom();
+    initCommands();
+    initConfig();
+    initLog();
+    initStats();
+    initProf();
+    initCapture();
+    initTrace();
+    statsRegister("system", systemStatNames, (uint32_t*)&systemCounters, STATS_COUNT(systemCounters), systemStatsRefresh);
+    statsRegister("mqtt", clientStatNames, (uint32_t*)&clientCounters, STATS_COUNT(clientCounters), NULL);
+    LOG1(LOG_BOOT, SYSCTL_RESC_R);
+
+    // Route inbound publishes by topic filter
+    initMqttSubs();
+    initTopicTrie();
+    initBatch("Cel", -1);
+
+    // Packets and timer expiries first, the command line last
+    eventSubscribe(EVENT_ETHER_RX, EVENT_HIGH, etherRxHandler);
+    eventSubscribe(EVENT_SAMPLE, EVENT_NORMAL, sensorHandler);
+    eventSubscribe(EVENT_PING, EVENT_NORMAL, pingHandler);
+    eventSubscribe(EVENT_PING_TIMEOUT, EVENT_NORMAL, pingTimeoutHandler);
+    eventSubscribe(EVENT_RECONNECT, EVENT_NORMAL, reconnectHandler);
+    eventSubscribe(EVENT_MQTT, EVENT_NORMAL, mqttHandler);
+    eventSubscribe(EVENT_CLI, EVENT_LOW, cliHandler);
+
+    // temperature in 0.1 C, tenths = 1475 - raw * 0.604248 averaged over one second,
+    // reported as the config says
+    config = configGet();
+    tempChannel = channelAddAnalog("temperature", ADC_INPUT_TEMP, ADC_SAMPLE_RATE, -1);
+    dspInit(channelGetFilter(tempChannel), -19800, 15, 1475);
+    dspSetAverage(channelGetFilter(tempChannel), ADC_SAMPLE_RATE);
+    channelSetReport(tempChannel, config->reportDeadband, config->reportRelative, config->reportMinMs, config->reportMaxMs);
+    channelStart();
+    topicSubscribe("led", ledHandler);
+    topicSubscribe("udp", udpHandler);
+
+    // Init ethernet interface (eth0)
+    putsUart0("\nStarting e0th0\n");
+    putsUart0("\n\r");
+    putsUart0("\nIt is recommended to set MQTT Broker IP before staring the project\n");
+    putsUart0("\n\r");
+    etherSetIpAddress(config->ip[0], config->ip[1], config->ip[2], config->ip[3]);
+    etherSetIpSubnetMask(config->mask[0], config->mask[1], config->mask[2], config->mask[3]);
+    etherSetIpGatewayAddress(config->gateway[0], config->gateway[1], config->gateway[2], config->gateway[3]);
+    etherSetDNSAddress(config->dns[0], config->dns[1], config->dns[2], config->dns[3]);
+    etherSetMacAddress(config->mac[0], config->mac[1], config->mac[2], config->mac[3], config->mac[4], config->mac[5]);
+    etherSetMqttBrkIp(config->brokerIp[0], config->brokerIp[1], config->brokerIp[2], config->brokerIp[3]);
+    etherSetMqttBrkMacAddress(config->brokerMac);
+    etherSetMqttBrkPort(config->brokerPort);
+    mqttSetClientId(config->clientId);
+    mqttGetConnectOptions()->keepAlive = config->keepAlive;
+    mqttGetConnectOptions()->protocolLevel = config->protocolLevel;
+
+    //tcp = true;
+    etherInit(ETHER_UNICAST | ETHER_BROADCAST | ETHER_HALFDUPLEX);
+    etherEnableInterrupt();
+
+    // Retry jitter differs per board
+    etherGetMacAddress(mac);
+    initReconnect(mac);
+    statsStart(mac);
 
-        }
 
+    // Flash LED
+    setPinValue(GREEN_LED, 1);
+    waitMicrosecond(100000);
+    setPinValue(GREEN_LED, 0);
+    waitMicrosecond(100000);
+
+
+
+    // Main Loop
+    // Every event handler runs to completion; when none is waiting the
+    // binary log gets UART0 and the CPU sleeps
+    while (true)
+    {
+        if (!eventDispatch())
+        {
+            logService();
+            sleepIdle();
+        }
     }
 }
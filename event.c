@@ -0,0 +1,202 @@
+// Event Dispatcher Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Interrupts and handlers post events; eventDispatch() runs the handler of
+// the oldest event of the highest priority waiting, to completion, so the
+// longest handler bounds how late a HIGH event can start. Every event is
+// stamped when posted and the dispatcher keeps per type the latency to the
+// handler start and the handler run time.
+// Each priority has two single-producer single-consumer rings: one written
+// by interrupts (they all run at the same NVIC priority and cannot preempt
+// each other) and one written by handlers in the main loop. Only the
+// producer moves head and only the dispatcher moves tail, so no interrupts
+// are disabled. An event type already waiting is not queued again; handlers
+// process everything outstanding when they run (all frames, the latest ADC
+// block), so one event covers any number of posts and a ring never holds
+// more than one event per type.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "event.h"
+#include "Timer.h"
+#include "trace.h"
+
+#define EVENT_FROM_ISR      0
+#define EVENT_FROM_TASK     1
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _event
+{
+    uint8_t type;
+    uint8_t arg;
+    uint32_t postedUs;
+} event;
+
+typedef struct _eventRing
+{
+    event slot[EVENT_QUEUE_SIZE];
+    volatile uint8_t head;          // written by the producer only
+    volatile uint8_t tail;          // written by the dispatcher only
+} eventRing;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+eventRing eventRings[EVENT_PRIORITIES][2];
+_eventHandler eventHandlers[MAX_EVENT_TYPES];
+uint8_t eventPriority[MAX_EVENT_TYPES];
+volatile bool eventQueued[MAX_EVENT_TYPES];  // set by the poster, cleared by the dispatcher
+eventStats eventCounters[MAX_EVENT_TYPES];
+volatile uint32_t eventDrops = 0;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initEvents()
+{
+    uint8_t i, j;
+    for (i = 0; i < EVENT_PRIORITIES; i++)
+    {
+        for (j = 0; j < 2; j++)
+        {
+            eventRings[i][j].head = 0;
+            eventRings[i][j].tail = 0;
+        }
+    }
+    for (i = 0; i < MAX_EVENT_TYPES; i++)
+    {
+        eventHandlers[i] = NULL;
+        eventPriority[i] = EVENT_LOW;
+        eventQueued[i] = false;
+    }
+}
+
+// One handler per type, the priority applies to every post of the type
+bool eventSubscribe(uint8_t type, uint8_t priority, _eventHandler handler)
+{
+    if (type >= MAX_EVENT_TYPES || priority >= EVENT_PRIORITIES)
+        return false;
+    eventPriority[type] = priority;
+    eventHandlers[type] = handler;
+    return true;
+}
+
+static bool eventPush(uint8_t producer, uint8_t type, uint8_t arg)
+{
+    eventRing* ring;
+    uint8_t head;
+    if (type >= MAX_EVENT_TYPES || eventHandlers[type] == NULL)
+        return false;
+    if (eventQueued[type])
+        return true;
+    ring = &eventRings[eventPriority[type]][producer];
+    head = ring->head;
+    if ((uint8_t)(head - ring->tail) >= EVENT_QUEUE_SIZE)
+    {
+        eventDrops++;
+        return false;
+    }
+    ring->slot[head & (EVENT_QUEUE_SIZE - 1)].type = type;
+    ring->slot[head & (EVENT_QUEUE_SIZE - 1)].arg = arg;
+    ring->slot[head & (EVENT_QUEUE_SIZE - 1)].postedUs = getUptimeUs();
+    eventQueued[type] = true;
+    ring->head = head + 1;          // publish the slot last
+    TRACE(TRACE_EVENT_POST, type);
+    return true;
+}
+
+// Posts from the main loop (handlers, timer callbacks)
+bool eventPost(uint8_t type, uint8_t arg)
+{
+    return eventPush(EVENT_FROM_TASK, type, arg);
+}
+
+// Posts from an interrupt
+bool eventPostFromIsr(uint8_t type, uint8_t arg)
+{
+    return eventPush(EVENT_FROM_ISR, type, arg);
+}
+
+// Runs the handler of the next event, returns false if nothing was waiting
+bool eventDispatch()
+{
+    eventRing* ring;
+    event e;
+    eventStats* stats;
+    uint32_t start, latency, run;
+    uint8_t p, producer;
+
+    for (p = 0; p < EVENT_PRIORITIES; p++)
+    {
+        // interrupt events first, they are usually the older ones
+        for (producer = EVENT_FROM_ISR; producer <= EVENT_FROM_TASK; producer++)
+        {
+            ring = &eventRings[p][producer];
+            if (ring->tail == ring->head)
+                continue;
+            e = ring->slot[ring->tail & (EVENT_QUEUE_SIZE - 1)];
+            ring->tail++;
+            // posts from now on need another run, so clear before running
+            eventQueued[e.type] = false;
+
+            start = getUptimeUs();
+            TRACE(TRACE_EVENT_BEGIN, e.type);
+            (*eventHandlers[e.type])(e.type, e.arg);
+            TRACE(TRACE_EVENT_END, e.type);
+            run = getUptimeUs() - start;
+
+            latency = start - e.postedUs;
+            stats = &eventCounters[e.type];
+            stats->count++;
+            stats->lastLatencyUs = latency;
+            if (latency > stats->maxLatencyUs)
+                stats->maxLatencyUs = latency;
+            if (run > stats->maxRunUs)
+                stats->maxRunUs = run;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Returns true if an event is waiting, e.g. posted by an interrupt after
+// eventDispatch() found nothing; call with interrupts disabled before sleeping
+bool eventPending()
+{
+    uint8_t p;
+    for (p = 0; p < EVENT_PRIORITIES; p++)
+    {
+        if (eventRings[p][EVENT_FROM_ISR].head != eventRings[p][EVENT_FROM_ISR].tail
+         || eventRings[p][EVENT_FROM_TASK].head != eventRings[p][EVENT_FROM_TASK].tail)
+            return true;
+    }
+    return false;
+}
+
+eventStats* eventGetStats(uint8_t type)
+{
+    return &eventCounters[type];
+}
+
+// Posts lost to a full ring, should stay 0
+uint32_t eventDropped()
+{
+    return eventDrops;
+}
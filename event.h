@@ -0,0 +1,63 @@
+// Event Dispatcher Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef EVENT_H_
+#define EVENT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define EVENT_QUEUE_SIZE    16      // per priority and producer, power of 2
+
+// Priorities, lower runs first
+#define EVENT_HIGH          0
+#define EVENT_NORMAL        1
+#define EVENT_LOW           2
+#define EVENT_PRIORITIES    3
+
+// Event types
+#define EVENT_TICK          0       // uptime advanced, run the timers
+#define EVENT_ETHER_RX      1       // ENC28J60 has frames waiting
+#define EVENT_SAMPLE        2       // an ADC block (or digital tick) is ready
+#define EVENT_PING          3       // keep-alive wants a PINGREQ
+#define EVENT_PING_TIMEOUT  4       // no PINGRESP, the session is dead
+#define EVENT_RECONNECT     5       // start a handshake
+#define EVENT_MQTT          6       // client state changed, see what to send
+#define EVENT_CLI           7       // a command line is waiting
+#define MAX_EVENT_TYPES     8
+
+typedef void(*_eventHandler)(uint8_t type, uint8_t arg);
+
+typedef struct _eventStats
+{
+    uint32_t count;                 // dispatched
+    uint32_t lastLatencyUs;         // post to handler start
+    uint32_t maxLatencyUs;
+    uint32_t maxRunUs;              // handler run time
+} eventStats;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initEvents();
+bool eventSubscribe(uint8_t type, uint8_t priority, _eventHandler handler);
+bool eventPost(uint8_t type, uint8_t arg);
+bool eventPostFromIsr(uint8_t type, uint8_t arg);
+bool eventDispatch();
+bool eventPending();
+eventStats* eventGetStats(uint8_t type);
+uint32_t eventDropped();
+
+#endif
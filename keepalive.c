@@ -0,0 +1,84 @@
+// MQTT Keep-Alive Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// The broker only needs to hear from us once per keep-alive interval, and
+// any control packet counts. The time of the last packet sent on the session
+// is recorded, and a PINGREQ is due only once the connection has been idle
+// for 3/4 of the interval, so a board that publishes often never pings.
+// A PINGRESP must follow within KEEPALIVE_RESPONSE_MS, otherwise the broker
+// is considered gone and the caller reconnects. Both deadlines are timers:
+// the idle timer is restarted by every packet sent, and expiries are posted
+// as EVENT_PING and EVENT_PING_TIMEOUT for the MQTT client to act on.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "event.h"
+#include "keepalive.h"
+#include "Timer.h"
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+timerHandle keepAliveIdleTimer = TIMER_NONE;       // runs while keep-alive is on
+timerHandle keepAliveResponseTimer = TIMER_NONE;   // runs while a PINGRESP is outstanding
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static void keepAliveNoResponse(void* context)
+{
+    keepAliveStop();
+    eventPost(EVENT_PING_TIMEOUT, 0);
+}
+
+static void keepAliveIdle(void* context)
+{
+    if (isTimerRunning(keepAliveResponseTimer))
+        return;
+    keepAliveResponseTimer = startOneshotTimer(keepAliveNoResponse, NULL, KEEPALIVE_RESPONSE_MS);
+    eventPost(EVENT_PING, 0);
+}
+
+// Called when the broker accepts the connection with the negotiated interval
+// An interval of 0 disables keep-alive
+void keepAliveStart(uint16_t seconds)
+{
+    keepAliveStop();
+    if (seconds != 0)
+        keepAliveIdleTimer = startPeriodicTimer(keepAliveIdle, NULL, (uint32_t)seconds * 750);
+}
+
+void keepAliveStop()
+{
+    stopTimer(keepAliveIdleTimer);
+    stopTimer(keepAliveResponseTimer);
+    keepAliveIdleTimer = TIMER_NONE;
+    keepAliveResponseTimer = TIMER_NONE;
+}
+
+// Called for every MQTT packet sent to the broker
+void keepAliveSent()
+{
+    restartTimer(keepAliveIdleTimer);
+}
+
+// Called when PINGRESP arrives
+void keepAliveReceived()
+{
+    stopTimer(keepAliveResponseTimer);
+    keepAliveResponseTimer = TIMER_NONE;
+}
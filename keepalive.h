@@ -0,0 +1,32 @@
+// MQTT Keep-Alive Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef KEEPALIVE_H_
+#define KEEPALIVE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define KEEPALIVE_RESPONSE_MS   5000    // PINGRESP deadline
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void keepAliveStart(uint16_t seconds);
+void keepAliveStop();
+void keepAliveSent();
+void keepAliveReceived();
+
+#endif
@@ -0,0 +1,222 @@
+// Binary Log Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Hardware configuration:
+// UART0 TX, uDMA channel 9
+
+// Diagnostics as compact binary records instead of text. LOG0-LOG2 copy an
+// id, up to two arguments, a sequence number and the uptime into a ring
+// with interrupts masked for a few instructions; they are safe from
+// interrupts and cost a few dozen cycles. logService() runs from the main
+// loop when no event is waiting. It frames the records and streams them
+// with uDMA on UART0, one transfer at a time, between lines of console
+// text. Records are kept from boot, the first LOG_RECORDS wait in the ring
+// until log on.
+// Frame: COBS (consistent overhead byte stuffing) of
+//   seq (16) | uptime us (32) | id (8) | args (32 each) | checksum (8)
+// little endian, followed by a 0. A transfer also starts with a 0, so
+// console text shows up between frames as a chunk that does not decode.
+// The checksum makes the byte sum of the frame 0 mod 256. Records lost to
+// a full ring still use a sequence number, so the host sees the gap.
+// tools/log_decode.py prints the frames with the formats from log.h and
+// passes console text through.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "cli.h"
+#include "log.h"
+#include "Timer.h"
+#include "uart0.h"
+#include "udma.h"
+
+#define LOG_PAYLOAD_MAX     16      // seq, uptime, id, two args, checksum
+#define LOG_FRAME_MAX       (LOG_PAYLOAD_MAX + 2)   // COBS code byte and the 0
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _logRecord
+{
+    uint32_t timeUs;
+    uint16_t seq;
+    uint8_t id;
+    uint8_t argc;
+    int32_t arg[2];
+} logRecord;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+logRecord logRing[LOG_RECORDS];
+volatile uint16_t logHead = 0;      // written with interrupts masked
+volatile uint16_t logTail = 0;      // written by logService() only
+uint16_t logSeq = 0;
+bool logOn = false;
+uint8_t logBuffer[LOG_DMA_BUFFER];  // owned by the uDMA until uart0TxDmaReady()
+logStats logCounters;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void logWrite(uint8_t id, uint8_t argc, int32_t a, int32_t b)
+{
+    logRecord* record;
+    uint16_t head;
+    uint32_t key;
+
+    key = _disable_interrupts();
+    head = logHead;
+    if ((uint16_t)(head - logTail) >= LOG_RECORDS)
+    {
+        logSeq++;
+        logCounters.dropped++;
+        _restore_interrupts(key);
+        return;
+    }
+    record = &logRing[head & (LOG_RECORDS - 1)];
+    record->timeUs = getUptimeUs();
+    record->seq = logSeq++;
+    record->id = id;
+    record->argc = argc;
+    record->arg[0] = a;
+    record->arg[1] = b;
+    logHead = head + 1;
+    logCounters.records++;
+    _restore_interrupts(key);
+}
+
+static uint8_t logPut(uint8_t payload[], uint8_t size, uint32_t value, uint8_t bytes)
+{
+    while (bytes-- > 0)
+    {
+        payload[size++] = value;
+        value >>= 8;
+    }
+    return size;
+}
+
+// Writes the frame of record to out
+// Returns the frame size including the 0
+static uint8_t logEncode(logRecord* record, uint8_t out[])
+{
+    uint8_t payload[LOG_PAYLOAD_MAX];
+    uint8_t size = 0, sum = 0, code = 1, codeAt = 0, o = 1, i;
+
+    size = logPut(payload, size, record->seq, 2);
+    size = logPut(payload, size, record->timeUs, 4);
+    payload[size++] = record->id;
+    for (i = 0; i < record->argc; i++)
+        size = logPut(payload, size, record->arg[i], 4);
+    for (i = 0; i < size; i++)
+        sum += payload[i];
+    payload[size++] = -sum;
+
+    // COBS: every 0 becomes the distance to the next one, the frame is
+    // shorter than 254 bytes so no block needs splitting
+    for (i = 0; i < size; i++)
+    {
+        if (payload[i] == 0)
+        {
+            out[codeAt] = code;
+            codeAt = o++;
+            code = 1;
+        }
+        else
+        {
+            out[o++] = payload[i];
+            code++;
+        }
+    }
+    out[codeAt] = code;
+    out[o++] = 0;
+    return o;
+}
+
+// Frames the waiting records into one uDMA transfer if UART0 is free
+void logService()
+{
+    uint16_t size = 0;
+    uint16_t tail = logTail;
+
+    if (!logOn || tail == logHead || !uart0TxDmaReady())
+        return;
+    logBuffer[size++] = 0;
+    while (tail != logHead && size + LOG_FRAME_MAX <= LOG_DMA_BUFFER)
+        size += logEncode(&logRing[tail++ & (LOG_RECORDS - 1)], &logBuffer[size]);
+    logTail = tail;
+    if (uart0TxDmaStart(logBuffer, size))
+    {
+        logCounters.transfers++;
+        logCounters.bytes += size;
+    }
+}
+
+logStats* logGetStats()
+{
+    return &logCounters;
+}
+
+// log on [baud], log off, or log for the counters
+static void logCommand(USER_DATA* data)
+{
+    uint32_t baud = LOG_CONSOLE_BAUD;
+    if (data->fieldcount >= 2 && stringcmp("on", getFieldString(data, 2)))
+    {
+        if (data->fieldcount >= 3)
+            baud = getFieldInteger(data, 3);
+        // 16 samples per bit at 40 MHz
+        if (baud < 9600 || baud > 2500000)
+        {
+            putsUart0("Baud rate 9600 to 2500000\n\r");
+            return;
+        }
+        putsUart0("Binary log on at ");
+        putsUart0(itostring(baud));
+        putsUart0(" baud\n\r");
+        uart0Flush();
+        setUart0BaudRate(baud, 40e6);
+        logOn = true;
+    }
+    else if (data->fieldcount >= 2 && stringcmp("off", getFieldString(data, 2)))
+    {
+        logOn = false;
+        uart0Flush();
+        setUart0BaudRate(LOG_CONSOLE_BAUD, 40e6);
+        putsUart0("Binary log off\n\r");
+    }
+    else
+    {
+        putsUart0("Records: ");
+        putsUart0(itostring(logCounters.records));
+        putsUart0(", dropped ");
+        putsUart0(itostring(logCounters.dropped));
+        putsUart0("\n\rTransfers: ");
+        putsUart0(itostring(logCounters.transfers));
+        putsUart0(", bytes ");
+        putsUart0(itostring(logCounters.bytes));
+        putsUart0("\n\r");
+    }
+}
+
+// After initCli(), registers the log command
+void initLog()
+{
+    initUdma();
+    initUart0TxDma();
+    cliRegister("log", 1, logCommand, "on [baud]|off  binary log frames on UART0");
+}
@@ -0,0 +1,57 @@
+// Binary Log Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef LOG_H_
+#define LOG_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define LOG_RECORDS         64      // waiting to be sent, power of 2
+#define LOG_DMA_BUFFER      256     // bytes per uDMA transfer
+#define LOG_CONSOLE_BAUD    115200  // restored by log off
+
+// Message ids, tools/log_decode.py reads the format from the comment
+#define LOG_BOOT            1       // "boot, reset cause 0x%x"
+#define LOG_CONNECT         2       // "connecting to the broker"
+#define LOG_CONNECTED       3       // "connected"
+#define LOG_SESSION_LOST    4       // "no PINGRESP, session lost"
+#define LOG_REPORT          5       // "channel %d reports %d"
+#define LOG_PUBLISH_DROP    6       // "publish could not be built, dropped"
+#define LOG_BROKER_CLOSED   7       // "broker closed the connection"
+
+// Records the id and up to two arguments with a sequence number and the
+// uptime in us; nothing is formatted on the board
+#define LOG0(id)            logWrite(id, 0, 0, 0)
+#define LOG1(id, a)         logWrite(id, 1, a, 0)
+#define LOG2(id, a, b)      logWrite(id, 2, a, b)
+
+typedef struct _logStats
+{
+    uint32_t records;               // queued
+    uint32_t dropped;               // ring full, seen as gaps in the sequence
+    uint32_t transfers;             // uDMA transfers started
+    uint32_t bytes;                 // framed bytes sent
+} logStats;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initLog();
+void logWrite(uint8_t id, uint8_t argc, int32_t a, int32_t b);
+void logService();
+logStats* logGetStats();
+
+#endif
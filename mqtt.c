@@ -0,0 +1,593 @@
+// MQTT Session Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL w/ ENC28J60
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Keeps the set of broker subscriptions and the table of outstanding
+// SUBSCRIBE/UNSUBSCRIBE packets. Pending topics are packed into as few
+// packets as possible and sent back-to-back on the open connection; each
+// packet gets its own packet id so SUBACKs and UNSUBACKs may come back in
+// any order.
+//
+// The subscription set is saved in EEPROM. With a persistent session
+// (clean session = 0) the loaded set is assumed to still be held by the
+// broker, and it is only replayed when CONNACK reports no session present.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "mqtt.h"
+#include "eth0.h"
+#include "EEPROM.h"
+#include "alias.h"
+#include "prop.h"
+#include "keepalive.h"
+
+#define MQTT_SUBS_MAGIC 0x5342          // "SB", first half-word of the saved set
+#define MQTT_SUBS_ACKED 0x80            // saved qos flag, the broker granted the topic
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _mqttSub
+{
+    uint16_t offset;            // topic position in mqttTopicPool
+    uint8_t length;             // topic length excluding '\0'
+    uint8_t qos;
+    uint8_t state;
+    uint16_t packetId;          // packet carrying the last (un)subscribe
+    uint8_t position;           // topic index within that packet
+} mqttSub;
+
+typedef struct _mqttOp
+{
+    uint16_t packetId;
+    uint8_t type;               // MQTT_SUBSCRIBE, MQTT_UNSUBSCRIBE or 0 if free
+} mqttOp;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+char mqttTopicPool[MQTT_TOPIC_POOL_SIZE];
+uint16_t mqttTopicPoolUsed = 0;
+mqttSub mqttSubs[MQTT_MAX_SUBS];
+uint8_t mqttSubsCount = 0;
+mqttOp mqttOps[MQTT_MAX_OPS];
+uint16_t mqttPacketId = 0;
+mqttConnectOptions mqttOptions = {4, false, 60, "PQRT", 0xFFFFFFFF};
+mqttPublishOptions mqttPubOptions = {0, {0}, 0, "", ""};
+uint16_t mqttBrokerReceiveMax = 65535;  // from CONNACK, 65535 if absent
+uint32_t mqttBrokerMaxPacket = 0;       // from CONNACK, 0 = no limit
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Writes the variable length Remaining Length field
+// Returns the number of bytes written (1 to 4)
+uint8_t mqttEncodeLength(uint8_t buffer[], uint32_t length)
+{
+    uint8_t i = 0;
+    do
+    {
+        buffer[i] = length & 0x7F;
+        length >>= 7;
+        if (length > 0)
+            buffer[i] |= 0x80;
+        i++;
+    } while (length > 0 && i < 4);
+    return i;
+}
+
+// Reads the variable length Remaining Length field
+uint32_t mqttDecodeLength(uint8_t buffer[], uint8_t* bytes)
+{
+    uint32_t length = 0;
+    uint8_t i = 0;
+    do
+    {
+        length |= (uint32_t)(buffer[i] & 0x7F) << (7 * i);
+    } while ((buffer[i++] & 0x80) && i < 4);
+    *bytes = i;
+    return length;
+}
+
+// Returns a non-zero packet id not used by an outstanding operation
+uint16_t mqttNextPacketId()
+{
+    uint8_t i;
+    bool used = true;
+    while (used)
+    {
+        mqttPacketId++;
+        if (mqttPacketId == 0)
+            mqttPacketId = 1;
+        used = false;
+        for (i = 0; i < MQTT_MAX_OPS; i++)
+            used |= (mqttOps[i].type != 0 && mqttOps[i].packetId == mqttPacketId);
+    }
+    return mqttPacketId;
+}
+
+static bool mqttTopicEquals(uint8_t index, char* topic)
+{
+    char* stored = &mqttTopicPool[mqttSubs[index].offset];
+    uint8_t i = 0;
+    while (stored[i] == topic[i])
+    {
+        if (stored[i] == '\0')
+            return true;
+        i++;
+    }
+    return false;
+}
+
+static uint8_t mqttSubFind(char* topic)
+{
+    uint8_t i;
+    for (i = 0; i < mqttSubsCount; i++)
+    {
+        if (mqttTopicEquals(i, topic))
+            return i;
+    }
+    return MQTT_MAX_SUBS;
+}
+
+// Removes an entry and compacts the topic pool behind it
+static void mqttSubDelete(uint8_t index)
+{
+    uint16_t offset = mqttSubs[index].offset;
+    uint16_t size = mqttSubs[index].length + 1;
+    uint16_t i;
+    for (i = offset; i + size < mqttTopicPoolUsed; i++)
+        mqttTopicPool[i] = mqttTopicPool[i + size];
+    mqttTopicPoolUsed -= size;
+    for (i = index; i + 1 < mqttSubsCount; i++)
+        mqttSubs[i] = mqttSubs[i + 1];
+    mqttSubsCount--;
+    for (i = 0; i < mqttSubsCount; i++)
+    {
+        if (mqttSubs[i].offset > offset)
+            mqttSubs[i].offset -= size;
+    }
+}
+
+mqttConnectOptions* mqttGetConnectOptions()
+{
+    return &mqttOptions;
+}
+
+void mqttSetClientId(char* clientId)
+{
+    uint8_t i = 0;
+    while (clientId[i] != '\0' && i < MQTT_MAX_CLIENT_ID - 1)
+    {
+        mqttOptions.clientId[i] = clientId[i];
+        i++;
+    }
+    mqttOptions.clientId[i] = '\0';
+}
+
+mqttPublishOptions* mqttGetPublishOptions()
+{
+    return &mqttPubOptions;
+}
+
+// Sets the User Property sent with every v5 PUBLISH, an empty name clears it
+void mqttSetUserProperty(char* name, char* value)
+{
+    uint8_t i;
+    for (i = 0; name[i] != '\0' && i < MQTT_MAX_USER_PROPERTY - 1; i++)
+        mqttPubOptions.userName[i] = name[i];
+    mqttPubOptions.userName[i] = '\0';
+    for (i = 0; value[i] != '\0' && i < MQTT_MAX_USER_PROPERTY - 1; i++)
+        mqttPubOptions.userValue[i] = value[i];
+    mqttPubOptions.userValue[i] = '\0';
+}
+
+// Sets the Correlation Data sent with every v5 PUBLISH, "" clears it
+void mqttSetCorrelationData(char* data)
+{
+    uint8_t i;
+    for (i = 0; data[i] != '\0' && i < MQTT_MAX_CORRELATION; i++)
+        mqttPubOptions.correlationData[i] = (uint8_t)data[i];
+    mqttPubOptions.correlationLength = i;
+}
+
+bool mqttIsV5()
+{
+    return mqttOptions.protocolLevel == 5;
+}
+
+uint16_t mqttGetBrokerReceiveMaximum()
+{
+    return mqttBrokerReceiveMax;
+}
+
+uint32_t mqttGetBrokerMaximumPacket()
+{
+    return mqttBrokerMaxPacket;
+}
+
+// Handles a CONNACK: session present flag and, for v5, the limits the
+// broker announces in its properties
+void mqttProcessConnAck(uint8_t data[], uint16_t size)
+{
+    uint8_t bytes;
+    uint8_t* prop;
+    uint16_t k, i, length, aliasMax = 0, keepAlive = mqttOptions.keepAlive;
+    bool present;
+    mqttDecodeLength(&data[1], &bytes);
+    k = 1 + bytes;
+    present = (data[k] & 0x01) != 0;
+    mqttBrokerReceiveMax = 65535;
+    mqttBrokerMaxPacket = 0;
+    if (mqttIsV5() && k + 2 < size && propCheck(&data[k+2], size - k - 2, MQTT_CONNACK))
+    {
+        k += 2;
+        if ((prop = propFind(&data[k], PROP_TOPIC_ALIAS_MAXIMUM, NULL)) != NULL)
+            aliasMax = propGetInt(prop);
+        if ((prop = propFind(&data[k], PROP_RECEIVE_MAXIMUM, NULL)) != NULL)
+            mqttBrokerReceiveMax = propGetInt(prop);
+        if ((prop = propFind(&data[k], PROP_MAXIMUM_PACKET_SIZE, NULL)) != NULL)
+            mqttBrokerMaxPacket = propGetInt(prop);
+        if ((prop = propFind(&data[k], PROP_SERVER_KEEP_ALIVE, NULL)) != NULL)
+            keepAlive = propGetInt(prop);   // the broker's value overrides ours
+        if ((prop = propFind(&data[k], PROP_ASSIGNED_CLIENT_IDENTIFIER, NULL)) != NULL)
+        {
+            // we connected with an empty client id, keep the one we were given
+            prop = propGetData(prop, &length);
+            for (i = 0; i < length && i < MQTT_MAX_CLIENT_ID - 1; i++)
+                mqttOptions.clientId[i] = (char)prop[i];
+            mqttOptions.clientId[i] = '\0';
+        }
+    }
+    initTopicAliases(aliasMax);
+    keepAliveStart(keepAlive);
+    mqttSessionStart(present);
+}
+
+// Called on CONNACK with its session present flag
+// Brings the subscription store in line with what the broker still holds
+void mqttSessionStart(bool sessionPresent)
+{
+    if (sessionPresent && !mqttOptions.cleanSession)
+        mqttSubResume();
+    else
+        mqttSubRestore();
+}
+
+// Saved set layout (bytes, packed into EEPROM words):
+//   magic (2), count (1), checksum (1), then per topic qos (1), length (1), topic
+// The qos byte carries MQTT_SUBS_ACKED once the SUBACK for the topic came in
+static uint8_t mqttSubImage(uint8_t image[], uint16_t* size)
+{
+    uint16_t k = 4, j;
+    uint8_t i, count = 0, check = 0;
+    for (i = 0; i < mqttSubsCount; i++)
+    {
+        if (mqttSubs[i].state == MQTT_UNSUB_PENDING || mqttSubs[i].state == MQTT_UNSUB_SENT)
+            continue;
+        if (k + 2 + mqttSubs[i].length > EEPROM_MQTT_SUBS_WORDS * 4)
+            break;
+        image[k++] = mqttSubs[i].qos | (mqttSubs[i].state == MQTT_SUB_ACTIVE ? MQTT_SUBS_ACKED : 0);
+        image[k++] = mqttSubs[i].length;
+        for (j = 0; j < mqttSubs[i].length; j++)
+            image[k++] = mqttTopicPool[mqttSubs[i].offset + j];
+        count++;
+    }
+    for (j = 4; j < k; j++)
+        check += image[j];
+    image[0] = LOBYTE(MQTT_SUBS_MAGIC);
+    image[1] = HIBYTE(MQTT_SUBS_MAGIC);
+    image[2] = count;
+    image[3] = check;
+    *size = k;
+    return count;
+}
+
+// Persists the wanted subscription set (pending unsubscriptions excluded)
+void mqttSubSave()
+{
+    uint8_t image[EEPROM_MQTT_SUBS_WORDS * 4];
+    uint16_t size;
+    mqttSubImage(image, &size);
+    writeEepromBlock(EEPROM_MQTT_SUBS, image, size);
+}
+
+// Loads the saved subscription set; acknowledged topics start out active so
+// a resumed session does not resubscribe them, the rest are sent again
+void initMqttSubs()
+{
+    uint8_t image[EEPROM_MQTT_SUBS_WORDS * 4];
+    uint8_t i, count, check = 0;
+    uint16_t k = 4, j;
+    char topic[256];
+    mqttSubsCount = 0;
+    mqttTopicPoolUsed = 0;
+    for (i = 0; i < MQTT_MAX_OPS; i++)
+        mqttOps[i].type = 0;
+
+    readEepromBlock(EEPROM_MQTT_SUBS, image, 4);
+    if (image[0] != LOBYTE(MQTT_SUBS_MAGIC) || image[1] != HIBYTE(MQTT_SUBS_MAGIC))
+        return;
+    readEepromBlock(EEPROM_MQTT_SUBS, image, sizeof(image));
+    count = image[2];
+    for (i = 0; i < count && k + 2 <= sizeof(image); i++)
+    {
+        k += 2 + image[k+1];
+    }
+    for (j = 4; j < k && k <= sizeof(image); j++)
+        check += image[j];
+    if (k > sizeof(image) || check != image[3])
+        return;
+
+    k = 4;
+    for (i = 0; i < count; i++)
+    {
+        for (j = 0; j < image[k+1]; j++)
+            topic[j] = image[k+2+j];
+        topic[j] = '\0';
+        if (mqttSubAdd(topic, image[k] & ~MQTT_SUBS_ACKED) && (image[k] & MQTT_SUBS_ACKED))
+            mqttSubs[mqttSubsCount-1].state = MQTT_SUB_ACTIVE;
+        k += 2 + image[k+1];
+    }
+}
+
+// Queues a topic for subscription
+// Returns false if the store is full
+bool mqttSubAdd(char* topic, uint8_t qos)
+{
+    uint8_t i = mqttSubFind(topic);
+    uint16_t len = 0, j;
+    if (i < MQTT_MAX_SUBS)
+    {
+        mqttSubs[i].qos = qos;
+        if (mqttSubs[i].state != MQTT_SUB_SENT)
+            mqttSubs[i].state = MQTT_SUB_PENDING;
+        return true;
+    }
+    while (topic[len] != '\0')
+        len++;
+    if (len == 0 || len > 255 || mqttSubsCount == MQTT_MAX_SUBS || mqttTopicPoolUsed + len + 1 > MQTT_TOPIC_POOL_SIZE)
+        return false;
+    mqttSubs[mqttSubsCount].offset = mqttTopicPoolUsed;
+    mqttSubs[mqttSubsCount].length = len;
+    mqttSubs[mqttSubsCount].qos = qos;
+    mqttSubs[mqttSubsCount].state = MQTT_SUB_PENDING;
+    mqttSubs[mqttSubsCount].packetId = 0;
+    mqttSubs[mqttSubsCount].position = 0;
+    mqttSubsCount++;
+    for (j = 0; j <= len; j++)
+        mqttTopicPool[mqttTopicPoolUsed++] = topic[j];
+    return true;
+}
+
+// Queues a topic for unsubscription
+// Returns false if the topic is not in the store
+bool mqttSubRemove(char* topic)
+{
+    uint8_t i = mqttSubFind(topic);
+    if (i == MQTT_MAX_SUBS)
+        return false;
+    if (mqttSubs[i].state == MQTT_SUB_PENDING)
+        mqttSubDelete(i);
+    else
+        mqttSubs[i].state = MQTT_UNSUB_PENDING;
+    return true;
+}
+
+// Called after the broker starts a clean session: every kept topic must be
+// subscribed again and pending unsubscriptions are already satisfied
+void mqttSubRestore()
+{
+    uint8_t i = 0;
+    bool changed = false;
+    while (i < mqttSubsCount)
+    {
+        changed |= mqttSubs[i].state == MQTT_SUB_ACTIVE;
+        if (mqttSubs[i].state == MQTT_UNSUB_PENDING || mqttSubs[i].state == MQTT_UNSUB_SENT)
+            mqttSubDelete(i);
+        else
+            mqttSubs[i++].state = MQTT_SUB_PENDING;
+    }
+    for (i = 0; i < MQTT_MAX_OPS; i++)
+        mqttOps[i].type = 0;
+    // the saved acks no longer hold for this session
+    if (changed)
+        mqttSubSave();
+}
+
+// Called when the broker kept our session: active topics stay as they are and
+// anything in flight on the old connection is sent again
+void mqttSubResume()
+{
+    uint8_t i;
+    for (i = 0; i < mqttSubsCount; i++)
+    {
+        if (mqttSubs[i].state == MQTT_SUB_SENT)
+            mqttSubs[i].state = MQTT_SUB_PENDING;
+        else if (mqttSubs[i].state == MQTT_UNSUB_SENT)
+            mqttSubs[i].state = MQTT_UNSUB_PENDING;
+    }
+    for (i = 0; i < MQTT_MAX_OPS; i++)
+        mqttOps[i].type = 0;
+}
+
+uint8_t mqttSubCount()
+{
+    return mqttSubsCount;
+}
+
+char* mqttSubTopic(uint8_t index)
+{
+    return &mqttTopicPool[mqttSubs[index].offset];
+}
+
+uint8_t mqttSubState(uint8_t index)
+{
+    return mqttSubs[index].state;
+}
+
+// Records an outstanding operation
+// Returns false if the table is full
+bool mqttOpOpen(uint16_t packetId, uint8_t type)
+{
+    uint8_t i;
+    for (i = 0; i < MQTT_MAX_OPS; i++)
+    {
+        if (mqttOps[i].type == 0)
+        {
+            mqttOps[i].packetId = packetId;
+            mqttOps[i].type = type;
+            return true;
+        }
+    }
+    return false;
+}
+
+// Retires an outstanding operation
+// Returns its type or 0 if the packet id is unknown
+uint8_t mqttOpClose(uint16_t packetId)
+{
+    uint8_t i, type;
+    for (i = 0; i < MQTT_MAX_OPS; i++)
+    {
+        if (mqttOps[i].type != 0 && mqttOps[i].packetId == packetId)
+        {
+            type = mqttOps[i].type;
+            mqttOps[i].type = 0;
+            return type;
+        }
+    }
+    return 0;
+}
+
+uint8_t mqttOpCount()
+{
+    uint8_t i, count = 0;
+    for (i = 0; i < MQTT_MAX_OPS; i++)
+        count += (mqttOps[i].type != 0);
+    return count;
+}
+
+// Packs entries in state 'from' into packets of type 'type' and sends them
+// back-to-back until nothing is left or the operation table is full
+static void mqttSendBatches(uint8_t packet[], uint8_t from, uint8_t to, uint8_t type)
+{
+    char* topics[MQTT_MAX_BATCH_TOPICS];
+    uint8_t qos[MQTT_MAX_BATCH_TOPICS];
+    uint8_t index[MQTT_MAX_BATCH_TOPICS];
+    uint8_t i, count;
+    uint16_t size, id;
+    while (true)
+    {
+        count = 0;
+        size = 2;
+        for (i = 0; i < mqttSubsCount && count < MQTT_MAX_BATCH_TOPICS; i++)
+        {
+            if (mqttSubs[i].state == from && size + mqttSubs[i].length + 3 <= MQTT_MAX_BATCH_SIZE)
+            {
+                topics[count] = mqttSubTopic(i);
+                qos[count] = mqttSubs[i].qos;
+                index[count++] = i;
+                size += mqttSubs[i].length + 3;
+            }
+        }
+        if (count == 0)
+            break;
+        id = mqttNextPacketId();
+        if (!mqttOpOpen(id, type))
+            break;
+        for (i = 0; i < count; i++)
+        {
+            mqttSubs[index[i]].state = to;
+            mqttSubs[index[i]].packetId = id;
+            mqttSubs[index[i]].position = i;
+        }
+        if (type == MQTT_SUBSCRIBE)
+            SendMqttSubscribeClient(packet, id, topics, qos, count);
+        else
+            SendMqttUnSubscribeClient(packet, id, topics, count);
+    }
+}
+
+// Sends every queued subscription change on the established connection
+void mqttSendPending(uint8_t packet[])
+{
+    mqttSendBatches(packet, MQTT_SUB_PENDING, MQTT_SUB_SENT, MQTT_SUBSCRIBE);
+    mqttSendBatches(packet, MQTT_UNSUB_PENDING, MQTT_UNSUB_SENT, MQTT_UNSUBSCRIBE);
+}
+
+// Walks every MQTT packet in a TCP payload and completes the SUBACKs and
+// UNSUBACKs found against the operation table
+void mqttProcessAcks(uint8_t data[], uint16_t size)
+{
+    uint16_t offset = 0, body, id, codes;
+    uint32_t length;
+    uint8_t bytes, type, i, code;
+    bool changed = false;
+    while (offset + 2 <= size)
+    {
+        type = data[offset] & 0xF0;
+        length = mqttDecodeLength(&data[offset+1], &bytes);
+        body = offset + 1 + bytes;
+        if (body + length > size || length < 2)
+            break;
+        id = (data[body] << 8) | data[body+1];
+        codes = body + 2;
+        if (mqttIsV5())
+        {
+            // skip the properties in front of the reason codes
+            if (!propCheck(&data[codes], body + length - codes, type))
+            {
+                offset = body + length;
+                continue;
+            }
+            codes += propBlockSize(&data[codes]);
+        }
+        if ((type == MQTT_SUBACK || type == MQTT_UNSUBACK) && mqttOpClose(id) != 0)
+        {
+            // return codes follow the topic order of the SUBSCRIBE; a topic
+            // unsubscribed since then no longer counts as sent but keeps its
+            // code, so each topic looks its own up by position
+            i = 0;
+            while (i < mqttSubsCount)
+            {
+                if (mqttSubs[i].packetId == id && mqttSubs[i].state == MQTT_SUB_SENT && type == MQTT_SUBACK)
+                {
+                    code = mqttSubs[i].position;
+                    if (codes + code < body + length && data[codes+code] >= 0x80)
+                    {
+                        mqttSubDelete(i);
+                        changed = true;
+                        continue;
+                    }
+                    mqttSubs[i].state = MQTT_SUB_ACTIVE;
+                    changed = true;
+                }
+                else if (mqttSubs[i].packetId == id && mqttSubs[i].state == MQTT_UNSUB_SENT && type == MQTT_UNSUBACK)
+                {
+                    mqttSubDelete(i);
+                    changed = true;
+                    continue;
+                }
+                i++;
+            }
+        }
+        offset = body + length;
+    }
+    if (changed)
+        mqttSubSave();
+}
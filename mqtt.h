@@ -0,0 +1,112 @@
+// MQTT Session Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL w/ ENC28J60
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef MQTT_H_
+#define MQTT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MQTT_MAX_SUBS          40       // subscription store entries
+#define MQTT_TOPIC_POOL_SIZE   640      // bytes shared by all stored topics
+#define MQTT_MAX_OPS           8        // outstanding SUBSCRIBE/UNSUBSCRIBE packets
+#define MQTT_MAX_BATCH_TOPICS  16       // topics packed into one packet
+#define MQTT_MAX_BATCH_SIZE    1024     // MQTT bytes packed into one packet
+
+// Subscription store entry states
+#define MQTT_SUB_PENDING       1        // SUBSCRIBE not sent yet
+#define MQTT_SUB_SENT          2        // waiting for SUBACK
+#define MQTT_SUB_ACTIVE        3        // granted by broker
+#define MQTT_UNSUB_PENDING     4        // UNSUBSCRIBE not sent yet
+#define MQTT_UNSUB_SENT        5        // waiting for UNSUBACK
+
+// MQTT control packet types (upper nibble of the fixed header)
+#define MQTT_CONNECT           0x10
+#define MQTT_CONNACK           0x20
+#define MQTT_PUBLISH           0x30
+#define MQTT_PUBACK            0x40
+#define MQTT_PUBREC            0x50
+#define MQTT_PUBREL            0x60
+#define MQTT_PUBCOMP           0x70
+#define MQTT_SUBSCRIBE         0x80
+#define MQTT_SUBACK            0x90
+#define MQTT_UNSUBSCRIBE       0xA0
+#define MQTT_UNSUBACK          0xB0
+#define MQTT_PINGREQ           0xC0
+#define MQTT_PINGRESP          0xD0
+#define MQTT_DISCONNECT        0xE0
+#define MQTT_AUTH              0xF0
+
+#define MQTT_MAX_CLIENT_ID     24
+#define MQTT_MAX_PACKET        1468     // MQTT bytes in one Ethernet frame (1522 - 54)
+#define MQTT_RECEIVE_MAXIMUM   4        // QoS 1/2 publishes the broker may have in flight to us
+#define MQTT_MAX_CORRELATION   16
+#define MQTT_MAX_USER_PROPERTY 16
+
+typedef struct _mqttConnectOptions
+{
+    uint8_t protocolLevel;              // 4 = MQTT 3.1.1, 5 = MQTT 5.0
+    bool cleanSession;                  // false keeps broker state across connections
+    uint16_t keepAlive;                 // seconds
+    char clientId[MQTT_MAX_CLIENT_ID];
+    uint32_t sessionExpiry;             // v5 only, seconds the broker keeps a persistent session
+} mqttConnectOptions;
+
+// v5 properties attached to every PUBLISH we send
+typedef struct _mqttPublishOptions
+{
+    uint32_t messageExpiry;             // seconds, 0 = never expires
+    uint8_t correlationData[MQTT_MAX_CORRELATION];
+    uint8_t correlationLength;          // 0 = not sent
+    char userName[MQTT_MAX_USER_PROPERTY];   // user property, "" = not sent
+    char userValue[MQTT_MAX_USER_PROPERTY];
+} mqttPublishOptions;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint8_t mqttEncodeLength(uint8_t buffer[], uint32_t length);
+uint32_t mqttDecodeLength(uint8_t buffer[], uint8_t* bytes);
+uint16_t mqttNextPacketId();
+
+mqttConnectOptions* mqttGetConnectOptions();
+void mqttSetClientId(char* clientId);
+mqttPublishOptions* mqttGetPublishOptions();
+void mqttSetUserProperty(char* name, char* value);
+void mqttSetCorrelationData(char* data);
+bool mqttIsV5();
+uint16_t mqttGetBrokerReceiveMaximum();
+uint32_t mqttGetBrokerMaximumPacket();
+void mqttSessionStart(bool sessionPresent);
+void mqttProcessConnAck(uint8_t data[], uint16_t size);
+
+void initMqttSubs();
+bool mqttSubAdd(char* topic, uint8_t qos);
+bool mqttSubRemove(char* topic);
+void mqttSubRestore();
+void mqttSubResume();
+void mqttSubSave();
+uint8_t mqttSubCount();
+char* mqttSubTopic(uint8_t index);
+uint8_t mqttSubState(uint8_t index);
+
+bool mqttOpOpen(uint16_t packetId, uint8_t type);
+uint8_t mqttOpClose(uint16_t packetId);
+uint8_t mqttOpCount();
+
+void mqttSendPending(uint8_t packet[]);
+void mqttProcessAcks(uint8_t data[], uint16_t size);
+
+#endif
@@ -0,0 +1,142 @@
+// Cycle Profiling Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Where the time goes between a frame arriving and the response leaving.
+// PROF_BEGIN and PROF_END read the DWT cycle counter around a stage and
+// profRecord() adds the difference, less the cost of the markers, to the
+// stage's log2 histogram: one CLZ and three adds, no division. The prof
+// command dumps every stage with the build date, one line per stage and a
+// fixed set of buckets, so dumps of two builds can be compared line by line
+// by tools/prof_compare.py. With PROF_ENABLE 0 the markers expand to
+// nothing and only an empty initProf() is left.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "cli.h"
+#include "prof.h"
+#include "uart0.h"
+
+#if PROF_ENABLE
+
+#if defined(__TI_ARM__)
+#define PROF_CLZ(x)         _norm(x)
+#else
+#define PROF_CLZ(x)         __builtin_clz(x)
+#endif
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+profStage profStages[PROF_STAGES];
+uint32_t profOverhead = 0;          // cycles of an empty PROF_BEGIN/PROF_END
+const char* const profNames[PROF_STAGES] = {"rx_get", "classify", "mqtt", "build", "tx_put", "rx_total"};
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void profRecord(uint8_t stage, uint32_t cycles)
+{
+    profStage* p = &profStages[stage];
+    uint8_t bucket = 0;
+    cycles = cycles > profOverhead ? cycles - profOverhead : 0;
+    if (cycles != 0)
+    {
+        bucket = 32 - PROF_CLZ(cycles);
+        if (bucket >= PROF_BUCKETS)
+            bucket = PROF_BUCKETS - 1;
+    }
+    p->bucket[bucket]++;
+    p->count++;
+    p->sumCycles += cycles;
+    if (cycles > p->maxCycles)
+        p->maxCycles = cycles;
+}
+
+profStage* profGetStage(uint8_t stage)
+{
+    return &profStages[stage];
+}
+
+static void profClear()
+{
+    uint8_t i, j;
+    for (i = 0; i < PROF_STAGES; i++)
+    {
+        profStages[i].count = 0;
+        profStages[i].maxCycles = 0;
+        profStages[i].sumCycles = 0;
+        for (j = 0; j < PROF_BUCKETS; j++)
+            profStages[i].bucket[j] = 0;
+    }
+}
+
+// prof build <date> <time> overhead <cycles>
+// <stage> <count> <mean> <max> <bucket 0> ... <bucket PROF_BUCKETS-1>
+static void profDump()
+{
+    profStage* p;
+    uint8_t i, j;
+    putsUart0("prof build " __DATE__ " " __TIME__ " overhead ");
+    putsUart0(itostring(profOverhead));
+    putsUart0("\n\r");
+    for (i = 0; i < PROF_STAGES; i++)
+    {
+        p = &profStages[i];
+        putsUart0((char*)profNames[i]);
+        putcUart0(' ');
+        putsUart0(itostring(p->count));
+        putcUart0(' ');
+        putsUart0(itostring(p->count > 0 ? p->sumCycles / p->count : 0));
+        putcUart0(' ');
+        putsUart0(itostring(p->maxCycles));
+        for (j = 0; j < PROF_BUCKETS; j++)
+        {
+            putcUart0(' ');
+            putsUart0(itostring(p->bucket[j]));
+        }
+        putsUart0("\n\r");
+    }
+}
+
+// prof, or prof clear
+static void profCommand(USER_DATA* data)
+{
+    if (data->fieldcount >= 2 && stringcmp("clear", getFieldString(data, 2)))
+        profClear();
+    else
+        profDump();
+}
+
+// After initCli(), starts the cycle counter and registers the prof command
+void initProf()
+{
+    uint32_t start, end;
+    CORE_DEMCR_R |= CORE_DEMCR_TRCENA;
+    DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+    start = DWT_CYCCNT_R;
+    end = DWT_CYCCNT_R;
+    profOverhead = end - start;
+    profClear();
+    cliRegister("prof", 1, profCommand, "[clear]  cycle histograms of the receive path");
+}
+
+#else
+
+void initProf()
+{
+}
+
+#endif
@@ -0,0 +1,69 @@
+// Cycle Profiling Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 0 compiles the markers out, e.g. --define=PROF_ENABLE=0
+#ifndef PROF_ENABLE
+#define PROF_ENABLE         1
+#endif
+
+// Debug and trace registers (not in tm4c123gh6pm.h)
+#define CORE_DEMCR_R        (*((volatile uint32_t *)0xE000EDFC))
+#define CORE_DEMCR_TRCENA   0x01000000
+#define DWT_CTRL_R          (*((volatile uint32_t *)0xE0001000))
+#define DWT_CTRL_CYCCNTENA  0x00000001
+#define DWT_CYCCNT_R        (*((volatile uint32_t *)0xE0001004))
+
+#define PROF_BUCKETS        24      // bucket n counts 2^(n-1) to 2^n - 1 cycles, the last one the rest
+
+// Stages of a received frame
+#define PROF_RX_GET         0       // etherGetPacket
+#define PROF_CLASSIFY       1       // ARP, UDP, IP and publish tests
+#define PROF_MQTT           2       // operations or inbound publish, sends included
+#define PROF_BUILD          3       // headers and checksums of a TCP segment
+#define PROF_TX_PUT         4       // etherPutPacket
+#define PROF_RX_TOTAL       5       // etherRxHandler, one frame
+#define PROF_STAGES         6
+
+// Times the code between the two markers, which must be in the same block
+#if PROF_ENABLE
+#define PROF_BEGIN(stage)   uint32_t profStart##stage = DWT_CYCCNT_R
+#define PROF_END(stage)     profRecord(stage, DWT_CYCCNT_R - profStart##stage)
+#else
+#define PROF_BEGIN(stage)
+#define PROF_END(stage)
+#endif
+
+typedef struct _profStage
+{
+    uint32_t count;
+    uint32_t maxCycles;
+    uint64_t sumCycles;
+    uint32_t bucket[PROF_BUCKETS];
+} profStage;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initProf();
+void profRecord(uint8_t stage, uint32_t cycles);
+profStage* profGetStage(uint8_t stage);
+
+#endif
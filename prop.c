@@ -0,0 +1,476 @@
+// MQTT v5 Property Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Encodes and decodes MQTT v5 property blocks in place. Builders add
+// properties straight into the TX frame through a propWriter, and received
+// blocks are read where they sit in the RX frame: propCheck() validates a
+// block once, then propFind() and the propGet functions walk it on demand.
+// Nothing is copied into intermediate lists.
+//
+// Identifiers, types, the packets each property may appear in and the value
+// checks follow mosquitto_property_check_command() and
+// mosquitto_property_check_all(). Strings are not checked for valid UTF-8
+// and the values returned by propGetData()/propGetValue() are not '\0'
+// terminated.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "prop.h"
+#include "mqtt.h"
+
+#define PROP_MAX_ID         PROP_SHARED_SUB_AVAILABLE
+#define PROP_MAX_VARINT     268435455
+
+// Command mask bits, one per packet type; bit 0 is used for will properties
+#define CMD(type)           (1 << ((type) >> 4))
+#define CMD_ALL             0xFFFE
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _propInfo
+{
+    uint8_t type;               // PROP_TYPE_*, 0 for unknown identifiers
+    uint16_t commands;          // CMD() mask of packets allowed to carry it
+} propInfo;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+const propInfo propTable[PROP_MAX_ID + 1] =
+{
+    [PROP_PAYLOAD_FORMAT_INDICATOR]     = {PROP_TYPE_BYTE,        CMD(MQTT_PUBLISH) | CMD(PROP_CMD_WILL)},
+    [PROP_MESSAGE_EXPIRY_INTERVAL]      = {PROP_TYPE_INT32,       CMD(MQTT_PUBLISH) | CMD(PROP_CMD_WILL)},
+    [PROP_CONTENT_TYPE]                 = {PROP_TYPE_STRING,      CMD(MQTT_PUBLISH) | CMD(PROP_CMD_WILL)},
+    [PROP_RESPONSE_TOPIC]               = {PROP_TYPE_STRING,      CMD(MQTT_PUBLISH) | CMD(PROP_CMD_WILL)},
+    [PROP_CORRELATION_DATA]             = {PROP_TYPE_BINARY,      CMD(MQTT_PUBLISH) | CMD(PROP_CMD_WILL)},
+    [PROP_SUBSCRIPTION_IDENTIFIER]      = {PROP_TYPE_VARINT,      CMD(MQTT_PUBLISH) | CMD(MQTT_SUBSCRIBE)},
+    [PROP_SESSION_EXPIRY_INTERVAL]      = {PROP_TYPE_INT32,       CMD(MQTT_CONNECT) | CMD(MQTT_CONNACK) | CMD(MQTT_DISCONNECT)},
+    [PROP_ASSIGNED_CLIENT_IDENTIFIER]   = {PROP_TYPE_STRING,      CMD(MQTT_CONNACK)},
+    [PROP_SERVER_KEEP_ALIVE]            = {PROP_TYPE_INT16,       CMD(MQTT_CONNACK)},
+    [PROP_AUTHENTICATION_METHOD]        = {PROP_TYPE_STRING,      CMD(MQTT_CONNECT) | CMD(MQTT_CONNACK) | CMD(MQTT_AUTH)},
+    [PROP_AUTHENTICATION_DATA]          = {PROP_TYPE_BINARY,      CMD(MQTT_CONNECT) | CMD(MQTT_CONNACK) | CMD(MQTT_AUTH)},
+    [PROP_REQUEST_PROBLEM_INFORMATION]  = {PROP_TYPE_BYTE,        CMD(MQTT_CONNECT)},
+    [PROP_WILL_DELAY_INTERVAL]          = {PROP_TYPE_INT32,       CMD(PROP_CMD_WILL)},
+    [PROP_REQUEST_RESPONSE_INFORMATION] = {PROP_TYPE_BYTE,        CMD(MQTT_CONNECT)},
+    [PROP_RESPONSE_INFORMATION]         = {PROP_TYPE_STRING,      CMD(MQTT_CONNACK)},
+    [PROP_SERVER_REFERENCE]             = {PROP_TYPE_STRING,      CMD(MQTT_CONNACK) | CMD(MQTT_DISCONNECT)},
+    [PROP_REASON_STRING]                = {PROP_TYPE_STRING,      CMD(MQTT_CONNACK) | CMD(MQTT_PUBACK) | CMD(MQTT_PUBREC)
+                                                                  | CMD(MQTT_PUBREL) | CMD(MQTT_PUBCOMP) | CMD(MQTT_SUBACK)
+                                                                  | CMD(MQTT_UNSUBACK) | CMD(MQTT_DISCONNECT) | CMD(MQTT_AUTH)},
+    [PROP_RECEIVE_MAXIMUM]              = {PROP_TYPE_INT16,       CMD(MQTT_CONNECT) | CMD(MQTT_CONNACK)},
+    [PROP_TOPIC_ALIAS_MAXIMUM]          = {PROP_TYPE_INT16,       CMD(MQTT_CONNECT) | CMD(MQTT_CONNACK)},
+    [PROP_TOPIC_ALIAS]                  = {PROP_TYPE_INT16,       CMD(MQTT_PUBLISH)},
+    [PROP_MAXIMUM_QOS]                  = {PROP_TYPE_BYTE,        CMD(MQTT_CONNACK)},
+    [PROP_RETAIN_AVAILABLE]             = {PROP_TYPE_BYTE,        CMD(MQTT_CONNACK)},
+    [PROP_USER_PROPERTY]                = {PROP_TYPE_STRING_PAIR, CMD_ALL | CMD(PROP_CMD_WILL)},
+    [PROP_MAXIMUM_PACKET_SIZE]          = {PROP_TYPE_INT32,       CMD(MQTT_CONNECT) | CMD(MQTT_CONNACK)},
+    [PROP_WILDCARD_SUB_AVAILABLE]       = {PROP_TYPE_BYTE,        CMD(MQTT_CONNACK)},
+    [PROP_SUBSCRIPTION_ID_AVAILABLE]    = {PROP_TYPE_BYTE,        CMD(MQTT_CONNACK)},
+    [PROP_SHARED_SUB_AVAILABLE]         = {PROP_TYPE_BYTE,        CMD(MQTT_CONNACK)},
+};
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static uint16_t propRead16(uint8_t* p)
+{
+    return (p[0] << 8) | p[1];
+}
+
+static void propWrite16(uint8_t* p, uint16_t value)
+{
+    p[0] = value >> 8;
+    p[1] = value & 0xFF;
+}
+
+static uint16_t propStringLength(char* str)
+{
+    uint16_t len = 0;
+    while (str[len] != '\0')
+        len++;
+    return len;
+}
+
+// Range checks applied to integer values, as in mosquitto_property_check_all()
+static bool propValueOk(uint8_t identifier, uint32_t value)
+{
+    switch (identifier)
+    {
+    case PROP_PAYLOAD_FORMAT_INDICATOR:
+    case PROP_REQUEST_PROBLEM_INFORMATION:
+    case PROP_REQUEST_RESPONSE_INFORMATION:
+    case PROP_MAXIMUM_QOS:
+    case PROP_RETAIN_AVAILABLE:
+    case PROP_WILDCARD_SUB_AVAILABLE:
+    case PROP_SUBSCRIPTION_ID_AVAILABLE:
+    case PROP_SHARED_SUB_AVAILABLE:
+        return value <= 1;
+    case PROP_MAXIMUM_PACKET_SIZE:
+    case PROP_RECEIVE_MAXIMUM:
+    case PROP_TOPIC_ALIAS:
+    case PROP_SUBSCRIPTION_IDENTIFIER:
+        return value != 0;
+    default:
+        return true;
+    }
+}
+
+// Returns the PROP_TYPE_* of an identifier, 0 if it is not a v5 property
+uint8_t propType(uint8_t identifier)
+{
+    if (identifier > PROP_MAX_ID)
+        return 0;
+    return propTable[identifier].type;
+}
+
+// Returns true if the property may appear in the given packet type
+// (upper nibble of the fixed header, or PROP_CMD_WILL)
+bool propAllowed(uint8_t identifier, uint8_t command)
+{
+    if (propType(identifier) == 0)
+        return false;
+    return (propTable[identifier].commands & CMD(command)) != 0;
+}
+
+// Returns the encoded size of the property at prop, identifier included,
+// or 0 for an unknown identifier
+uint16_t propSize(uint8_t prop[])
+{
+    uint8_t bytes;
+    switch (propType(prop[0]))
+    {
+    case PROP_TYPE_BYTE:
+        return 1 + 1;
+    case PROP_TYPE_INT16:
+        return 1 + 2;
+    case PROP_TYPE_INT32:
+        return 1 + 4;
+    case PROP_TYPE_VARINT:
+        mqttDecodeLength(&prop[1], &bytes);
+        return 1 + bytes;
+    case PROP_TYPE_BINARY:
+    case PROP_TYPE_STRING:
+        return 1 + 2 + propRead16(&prop[1]);
+    case PROP_TYPE_STRING_PAIR:
+        return 1 + 2 + propRead16(&prop[1]) + 2 + propRead16(&prop[3 + propRead16(&prop[1])]);
+    default:
+        return 0;
+    }
+}
+
+//-----------------------------------------------------------------------------
+// Encoder
+//-----------------------------------------------------------------------------
+
+// Starts a property block for a packet of the given type
+// One byte is reserved for the property length; propEnd() makes room for a
+// longer length field if the block grows past 127 bytes
+void propBegin(propWriter* w, uint8_t buffer[], uint16_t size, uint8_t command)
+{
+    w->buffer = buffer;
+    w->size = size;
+    w->length = 0;
+    w->command = command;
+    w->ok = (buffer == NULL || size >= 1);
+}
+
+// Checks the identifier and room for n value bytes, writes the identifier
+// Sets *p to where the value goes, NULL when only measuring
+static bool propStart(propWriter* w, uint8_t identifier, uint8_t type, uint16_t n, uint8_t** p)
+{
+    if (propType(identifier) != type || !propAllowed(identifier, w->command)
+        || (w->buffer != NULL && 1 + w->length + 1 + n > w->size))
+    {
+        w->ok = false;
+        return false;
+    }
+    *p = NULL;
+    if (w->buffer != NULL)
+    {
+        *p = &w->buffer[1 + w->length];
+        **p = identifier;
+        (*p)++;
+    }
+    w->length += 1 + n;
+    return true;
+}
+
+bool propAddByte(propWriter* w, uint8_t identifier, uint8_t value)
+{
+    uint8_t* p;
+    if (!propValueOk(identifier, value) || !propStart(w, identifier, PROP_TYPE_BYTE, 1, &p))
+    {
+        w->ok = false;
+        return false;
+    }
+    if (p != NULL)
+        p[0] = value;
+    return true;
+}
+
+bool propAddInt16(propWriter* w, uint8_t identifier, uint16_t value)
+{
+    uint8_t* p;
+    if (!propValueOk(identifier, value) || !propStart(w, identifier, PROP_TYPE_INT16, 2, &p))
+    {
+        w->ok = false;
+        return false;
+    }
+    if (p != NULL)
+        propWrite16(p, value);
+    return true;
+}
+
+bool propAddInt32(propWriter* w, uint8_t identifier, uint32_t value)
+{
+    uint8_t* p;
+    if (!propValueOk(identifier, value) || !propStart(w, identifier, PROP_TYPE_INT32, 4, &p))
+    {
+        w->ok = false;
+        return false;
+    }
+    if (p != NULL)
+    {
+        propWrite16(p, value >> 16);
+        propWrite16(p + 2, value & 0xFFFF);
+    }
+    return true;
+}
+
+bool propAddVarint(propWriter* w, uint8_t identifier, uint32_t value)
+{
+    uint8_t* p;
+    uint8_t n = (value < 128) ? 1 : (value < 16384) ? 2 : (value < 2097152) ? 3 : 4;
+    if (value > PROP_MAX_VARINT || !propValueOk(identifier, value)
+        || !propStart(w, identifier, PROP_TYPE_VARINT, n, &p))
+    {
+        w->ok = false;
+        return false;
+    }
+    if (p != NULL)
+        mqttEncodeLength(p, value);
+    return true;
+}
+
+bool propAddBinary(propWriter* w, uint8_t identifier, uint8_t value[], uint16_t length)
+{
+    uint8_t* p;
+    uint16_t i;
+    if (!propStart(w, identifier, PROP_TYPE_BINARY, 2 + length, &p))
+        return false;
+    if (p != NULL)
+    {
+        propWrite16(p, length);
+        for (i = 0; i < length; i++)
+            p[2 + i] = value[i];
+    }
+    return true;
+}
+
+bool propAddString(propWriter* w, uint8_t identifier, char* value)
+{
+    uint8_t* p;
+    uint16_t i, length = propStringLength(value);
+    if (!propStart(w, identifier, PROP_TYPE_STRING, 2 + length, &p))
+        return false;
+    if (p != NULL)
+    {
+        propWrite16(p, length);
+        for (i = 0; i < length; i++)
+            p[2 + i] = (uint8_t)value[i];
+    }
+    return true;
+}
+
+bool propAddStringPair(propWriter* w, uint8_t identifier, char* name, char* value)
+{
+    uint8_t* p;
+    uint16_t i, nameLength = propStringLength(name), valueLength = propStringLength(value);
+    if (!propStart(w, identifier, PROP_TYPE_STRING_PAIR, 2 + nameLength + 2 + valueLength, &p))
+        return false;
+    if (p != NULL)
+    {
+        propWrite16(p, nameLength);
+        for (i = 0; i < nameLength; i++)
+            p[2 + i] = (uint8_t)name[i];
+        p += 2 + nameLength;
+        propWrite16(p, valueLength);
+        for (i = 0; i < valueLength; i++)
+            p[2 + i] = (uint8_t)value[i];
+    }
+    return true;
+}
+
+// Writes the property length in front of the block
+// Returns the size of the whole block including the length field
+uint16_t propEnd(propWriter* w)
+{
+    uint8_t field[4];
+    uint8_t bytes = mqttEncodeLength(field, w->length);
+    uint16_t i;
+    if (w->buffer != NULL)
+    {
+        if (bytes + w->length > w->size)
+        {
+            // no room to widen the length field, send no properties
+            w->length = 0;
+            w->ok = false;
+            bytes = mqttEncodeLength(field, 0);
+        }
+        for (i = w->length; bytes > 1 && i > 0; i--)
+            w->buffer[bytes - 1 + i] = w->buffer[i];
+        for (i = 0; i < bytes; i++)
+            w->buffer[i] = field[i];
+    }
+    return bytes + w->length;
+}
+
+//-----------------------------------------------------------------------------
+// Decoder
+//-----------------------------------------------------------------------------
+
+// Returns the size of a received block including its length field
+uint16_t propBlockSize(uint8_t props[])
+{
+    uint8_t bytes;
+    uint32_t length = mqttDecodeLength(props, &bytes);
+    return bytes + length;
+}
+
+// Returns the number of bytes of a variable byte integer that ends within
+// size bytes, or 0 if it runs past them or past the 4 bytes allowed
+static uint8_t propVarintBytes(uint8_t buffer[], uint32_t size)
+{
+    uint8_t i;
+    for (i = 0; i < 4 && i < size; i++)
+    {
+        if ((buffer[i] & 0x80) == 0)
+            return i + 1;
+    }
+    return 0;
+}
+
+// Validates a received property block of at most size bytes:
+// known identifiers allowed in the packet type, lengths inside the block,
+// value ranges, and no duplicates except User Property (and Subscription
+// Identifier in PUBLISH, where the broker sends one per matching subscription)
+bool propCheck(uint8_t props[], uint16_t size, uint8_t command)
+{
+    uint8_t bytes, id;
+    uint16_t k, n;
+    uint32_t end, seen[2] = {0, 0};
+    if (propVarintBytes(props, size) == 0)
+        return false;
+    end = mqttDecodeLength(props, &bytes);
+    end += bytes;
+    if (end > size)
+        return false;
+    k = bytes;
+    while (k < end)
+    {
+        id = props[k];
+        if (!propAllowed(id, command))
+            return false;
+        if (propType(id) == PROP_TYPE_VARINT && propVarintBytes(&props[k+1], end - k - 1) == 0)
+            return false;
+        if (propType(id) >= PROP_TYPE_BINARY && k + 3 > end)
+            return false;
+        if (propType(id) == PROP_TYPE_STRING_PAIR && k + 5 + propRead16(&props[k+1]) > end)
+            return false;
+        n = propSize(&props[k]);
+        if (k + n > end)
+            return false;
+        if (propType(id) < PROP_TYPE_BINARY && !propValueOk(id, propGetInt(&props[k])))
+            return false;
+        if ((seen[id >> 5] & (1u << (id & 31))) != 0 && id != PROP_USER_PROPERTY
+            && !(id == PROP_SUBSCRIPTION_IDENTIFIER && command == MQTT_PUBLISH))
+            return false;
+        seen[id >> 5] |= 1u << (id & 31);
+        k += n;
+    }
+    return true;
+}
+
+// Returns the first property with the given identifier after 'after'
+// (NULL to start at the beginning of the block), or NULL if there is none
+uint8_t* propFind(uint8_t props[], uint8_t identifier, uint8_t* after)
+{
+    uint8_t bytes;
+    uint16_t k, n;
+    uint32_t end = mqttDecodeLength(props, &bytes);
+    end += bytes;
+    k = bytes;
+    if (after != NULL)
+        k = (after - props) + propSize(after);
+    while (k < end)
+    {
+        if (props[k] == identifier)
+            return &props[k];
+        n = propSize(&props[k]);
+        if (n == 0)
+            return NULL;
+        k += n;
+    }
+    return NULL;
+}
+
+// Returns the value of a byte, two byte, four byte or variable length property
+uint32_t propGetInt(uint8_t* prop)
+{
+    uint8_t bytes;
+    switch (propType(prop[0]))
+    {
+    case PROP_TYPE_BYTE:
+        return prop[1];
+    case PROP_TYPE_INT16:
+        return propRead16(&prop[1]);
+    case PROP_TYPE_INT32:
+        return ((uint32_t)propRead16(&prop[1]) << 16) | propRead16(&prop[3]);
+    case PROP_TYPE_VARINT:
+        return mqttDecodeLength(&prop[1], &bytes);
+    default:
+        return 0;
+    }
+}
+
+// Returns the string or binary data of a property (the name of a pair)
+uint8_t* propGetData(uint8_t* prop, uint16_t* length)
+{
+    if (propType(prop[0]) < PROP_TYPE_BINARY)
+    {
+        *length = 0;
+        return NULL;
+    }
+    *length = propRead16(&prop[1]);
+    return &prop[3];
+}
+
+// Returns the value string of a User Property
+uint8_t* propGetValue(uint8_t* prop, uint16_t* length)
+{
+    uint8_t* value;
+    if (propType(prop[0]) != PROP_TYPE_STRING_PAIR)
+    {
+        *length = 0;
+        return NULL;
+    }
+    value = &prop[3 + propRead16(&prop[1])];
+    *length = propRead16(value);
+    return value + 2;
+}
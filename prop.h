@@ -0,0 +1,98 @@
+// MQTT v5 Property Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef PROP_H_
+#define PROP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// Property identifiers (same values as MQTT_PROP_* in mqtt_protocol.h)
+#define PROP_PAYLOAD_FORMAT_INDICATOR       0x01
+#define PROP_MESSAGE_EXPIRY_INTERVAL        0x02
+#define PROP_CONTENT_TYPE                   0x03
+#define PROP_RESPONSE_TOPIC                 0x08
+#define PROP_CORRELATION_DATA               0x09
+#define PROP_SUBSCRIPTION_IDENTIFIER        0x0B
+#define PROP_SESSION_EXPIRY_INTERVAL        0x11
+#define PROP_ASSIGNED_CLIENT_IDENTIFIER     0x12
+#define PROP_SERVER_KEEP_ALIVE              0x13
+#define PROP_AUTHENTICATION_METHOD          0x15
+#define PROP_AUTHENTICATION_DATA            0x16
+#define PROP_REQUEST_PROBLEM_INFORMATION    0x17
+#define PROP_WILL_DELAY_INTERVAL            0x18
+#define PROP_REQUEST_RESPONSE_INFORMATION   0x19
+#define PROP_RESPONSE_INFORMATION           0x1A
+#define PROP_SERVER_REFERENCE               0x1C
+#define PROP_REASON_STRING                  0x1F
+#define PROP_RECEIVE_MAXIMUM                0x21
+#define PROP_TOPIC_ALIAS_MAXIMUM            0x22
+#define PROP_TOPIC_ALIAS                    0x23
+#define PROP_MAXIMUM_QOS                    0x24
+#define PROP_RETAIN_AVAILABLE               0x25
+#define PROP_USER_PROPERTY                  0x26
+#define PROP_MAXIMUM_PACKET_SIZE            0x27
+#define PROP_WILDCARD_SUB_AVAILABLE         0x28
+#define PROP_SUBSCRIPTION_ID_AVAILABLE      0x29
+#define PROP_SHARED_SUB_AVAILABLE           0x2A
+
+// Value types
+#define PROP_TYPE_BYTE          1
+#define PROP_TYPE_INT16         2
+#define PROP_TYPE_INT32         3
+#define PROP_TYPE_VARINT        4
+#define PROP_TYPE_BINARY        5
+#define PROP_TYPE_STRING        6
+#define PROP_TYPE_STRING_PAIR   7
+
+// Pseudo command for the will properties of CONNECT
+#define PROP_CMD_WILL           0x00
+
+// Writes one property block straight into a TX buffer
+// A NULL buffer only measures, so a builder can size its fixed header first
+typedef struct _propWriter
+{
+    uint8_t* buffer;            // property length field position, or NULL
+    uint16_t size;              // room in buffer
+    uint16_t length;            // property bytes after the length field
+    uint8_t command;            // packet type the block belongs to
+    bool ok;                    // false once an add was rejected
+} propWriter;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint8_t propType(uint8_t identifier);
+bool propAllowed(uint8_t identifier, uint8_t command);
+uint16_t propSize(uint8_t prop[]);
+
+void propBegin(propWriter* w, uint8_t buffer[], uint16_t size, uint8_t command);
+bool propAddByte(propWriter* w, uint8_t identifier, uint8_t value);
+bool propAddInt16(propWriter* w, uint8_t identifier, uint16_t value);
+bool propAddInt32(propWriter* w, uint8_t identifier, uint32_t value);
+bool propAddVarint(propWriter* w, uint8_t identifier, uint32_t value);
+bool propAddBinary(propWriter* w, uint8_t identifier, uint8_t value[], uint16_t length);
+bool propAddString(propWriter* w, uint8_t identifier, char* value);
+bool propAddStringPair(propWriter* w, uint8_t identifier, char* name, char* value);
+uint16_t propEnd(propWriter* w);
+
+uint16_t propBlockSize(uint8_t props[]);
+bool propCheck(uint8_t props[], uint16_t size, uint8_t command);
+uint8_t* propFind(uint8_t props[], uint8_t identifier, uint8_t* after);
+uint32_t propGetInt(uint8_t* prop);
+uint8_t* propGetData(uint8_t* prop, uint16_t* length);
+uint8_t* propGetValue(uint8_t* prop, uint16_t* length);
+
+#endif
@@ -0,0 +1,83 @@
+// Protothread Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: -
+// Target uC:       -
+// System Clock:    -
+
+// Stackless coroutines in the style of Dunkels' protothreads. A thread is a
+// function returning PT_WAITING, PT_YIELDED, PT_EXITED or PT_ENDED that is
+// called again whenever what it waits for may have happened (an event
+// handler runs it); it resumes after the wait it returned from. The only
+// state kept between calls is the line to resume at, 2 bytes per thread:
+//  - locals do not survive a wait, keep them in a struct next to the pt
+//  - waits cannot be inside a switch statement of the thread itself
+//
+//    PT_THREAD(blink(pt* p))
+//    {
+//        PT_BEGIN(p);
+//        while (true)
+//        {
+//            PT_WAIT_UNTIL(p, buttonPressed);
+//            toggleLed();
+//            PT_YIELD_UNTIL(p, !buttonPressed);
+//        }
+//        PT_END(p);
+//    }
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef PT_H_
+#define PT_H_
+
+#include <stdint.h>
+
+// Thread results
+#define PT_WAITING  0               // blocked in a wait
+#define PT_YIELDED  1               // gave up the CPU, runnable
+#define PT_EXITED   2               // left through PT_EXIT
+#define PT_ENDED    3               // ran to PT_END
+
+typedef struct _pt
+{
+    uint16_t lc;                    // line to resume at, 0 to start over
+} pt;
+
+#define PT_THREAD(declaration)  char declaration
+
+#define PT_INIT(p)              ((p)->lc = 0)
+
+#define PT_BEGIN(p)             { char ptYield = 1; (void)ptYield; switch ((p)->lc) { case 0:
+
+#define PT_END(p)               } ptYield = 0; PT_INIT(p); return PT_ENDED; }
+
+// Returns PT_WAITING until condition holds
+#define PT_WAIT_UNTIL(p, condition) \
+    do { (p)->lc = __LINE__; case __LINE__: \
+        if (!(condition)) return PT_WAITING; } while (0)
+
+#define PT_WAIT_WHILE(p, condition) PT_WAIT_UNTIL(p, !(condition))
+
+// Runs child (a PT_THREAD call) until it exits or ends
+#define PT_WAIT_THREAD(p, child) PT_WAIT_WHILE(p, (child) < PT_EXITED)
+
+// Returns PT_YIELDED once, then resumes when condition holds; unlike
+// PT_WAIT_UNTIL it never goes on in the same call, so a condition such as
+// "a packet is offered" is not met twice by the same packet
+#define PT_YIELD_UNTIL(p, condition) \
+    do { ptYield = 0; (p)->lc = __LINE__; case __LINE__: \
+        if (ptYield == 0 || !(condition)) return PT_YIELDED; } while (0)
+
+#define PT_YIELD(p)             PT_YIELD_UNTIL(p, 1)
+
+// Starts over from PT_BEGIN on the next call
+#define PT_RESTART(p)           do { PT_INIT(p); return PT_WAITING; } while (0)
+
+#define PT_EXIT(p)              do { PT_INIT(p); return PT_EXITED; } while (0)
+
+#endif
@@ -0,0 +1,182 @@
+// MQTT Reconnect Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Brings the broker session back after it is lost or a handshake stalls.
+// The first retry goes out immediately; the following ones wait
+// RECONNECT_BASE_MS doubling up to RECONNECT_MAX_MS. Each delay is drawn
+// from [delay/2, delay) with a PRNG seeded from the MAC address, so boards
+// that lose a broker at the same moment spread their SYNs out instead of
+// retrying in lockstep. The backoff delay and the handshake deadline run
+// on one timer; EVENT_RECONNECT asks the MQTT client for a handshake.
+// The client reports a lost session as soon as the broker closes the
+// connection with a FIN, or when a PINGREQ goes unanswered if the broker
+// simply went away.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "event.h"
+#include "reconnect.h"
+#include "stats.h"
+#include "Timer.h"
+#include "trace.h"
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+uint8_t reconnectCurrent = RECONNECT_IDLE;
+uint8_t reconnectRetries = 0;           // attempts since the session was lost
+timerHandle reconnectTimer = TIMER_NONE; // backoff delay or handshake deadline
+uint32_t reconnectLostTime = 0;
+uint32_t reconnectSeed = 1;
+reconnectStats reconnectCounters;
+const char* const reconnectStatNames[] = {"attempts", "connected", "timeouts", "losses", "last_outage_ms", "max_outage_ms"};
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// xorshift32
+static uint32_t reconnectRandom()
+{
+    reconnectSeed ^= reconnectSeed << 13;
+    reconnectSeed ^= reconnectSeed >> 17;
+    reconnectSeed ^= reconnectSeed << 5;
+    return reconnectSeed;
+}
+
+static void reconnectExpired(void* context);
+
+// Returns the delay before a retry: none for the first, then backoff
+uint32_t reconnectBackoff(uint8_t retries)
+{
+    uint32_t delay = 0;
+    if (retries > 0)
+    {
+        delay = RECONNECT_MAX_MS;
+        if (retries < 8 && (RECONNECT_BASE_MS << (retries - 1)) < RECONNECT_MAX_MS)
+            delay = RECONNECT_BASE_MS << (retries - 1);
+        delay = delay / 2 + reconnectRandom() % (delay / 2);
+    }
+    return delay;
+}
+
+// Schedules the next attempt
+static void reconnectSchedule()
+{
+    stopTimer(reconnectTimer);
+    reconnectTimer = startOneshotTimer(reconnectExpired, NULL, reconnectBackoff(reconnectRetries));
+    reconnectCurrent = RECONNECT_WAITING;
+    TRACE(TRACE_RECONNECT, RECONNECT_WAITING);
+}
+
+// End of the backoff delay, or of the handshake deadline
+static void reconnectExpired(void* context)
+{
+    reconnectTimer = TIMER_NONE;
+    if (reconnectCurrent == RECONNECT_WAITING)
+    {
+        reconnectCounters.attempts++;
+        reconnectCurrent = RECONNECT_CONNECTING;
+        TRACE(TRACE_RECONNECT, RECONNECT_CONNECTING);
+        eventPost(EVENT_RECONNECT, 0);
+        reconnectTimer = startOneshotTimer(reconnectExpired, NULL, RECONNECT_HANDSHAKE_MS);
+    }
+    else if (reconnectCurrent == RECONNECT_CONNECTING)
+    {
+        reconnectCounters.timeouts++;
+        if (reconnectRetries < 255)
+            reconnectRetries++;
+        reconnectSchedule();
+    }
+}
+
+void initReconnect(uint8_t mac[6])
+{
+    uint8_t i;
+    // FNV-1a over the MAC, never zero for xorshift
+    reconnectSeed = 2166136261u;
+    for (i = 0; i < 6; i++)
+    {
+        reconnectSeed ^= mac[i];
+        reconnectSeed *= 16777619u;
+    }
+    if (reconnectSeed == 0)
+        reconnectSeed = 1;
+    reconnectCurrent = RECONNECT_IDLE;
+    reconnectRetries = 0;
+    statsRegister("reconnect", reconnectStatNames, (uint32_t*)&reconnectCounters, STATS_COUNT(reconnectCounters), NULL);
+}
+
+// Asks for a connection, the first attempt starts right away
+void reconnectStart()
+{
+    if (reconnectCurrent == RECONNECT_IDLE)
+    {
+        reconnectRetries = 0;
+        reconnectLostTime = getUptimeMs();
+        reconnectSchedule();
+    }
+}
+
+// Disconnect requested, stop retrying
+void reconnectStop()
+{
+    stopTimer(reconnectTimer);
+    reconnectTimer = TIMER_NONE;
+    reconnectCurrent = RECONNECT_IDLE;
+    TRACE(TRACE_RECONNECT, RECONNECT_IDLE);
+}
+
+// Called when an established session dies (broker FIN or no PINGRESP)
+void reconnectLost()
+{
+    if (reconnectCurrent == RECONNECT_CONNECTED)
+    {
+        reconnectCounters.losses++;
+        reconnectRetries = 0;
+        reconnectLostTime = getUptimeMs();
+        reconnectSchedule();
+    }
+}
+
+// Called when the broker accepts CONNECT
+void reconnectConnected()
+{
+    uint32_t outage;
+    if (reconnectCurrent == RECONNECT_WAITING || reconnectCurrent == RECONNECT_CONNECTING)
+    {
+        outage = getUptimeMs() - reconnectLostTime;
+        reconnectCounters.successes++;
+        reconnectCounters.lastOutageMs = outage;
+        if (outage > reconnectCounters.maxOutageMs)
+            reconnectCounters.maxOutageMs = outage;
+    }
+    stopTimer(reconnectTimer);
+    reconnectTimer = TIMER_NONE;
+    reconnectCurrent = RECONNECT_CONNECTED;
+    TRACE(TRACE_RECONNECT, RECONNECT_CONNECTED);
+    reconnectRetries = 0;
+}
+
+uint8_t reconnectState()
+{
+    return reconnectCurrent;
+}
+
+reconnectStats* reconnectGetStats()
+{
+    return &reconnectCounters;
+}
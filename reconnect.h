@@ -0,0 +1,54 @@
+// MQTT Reconnect Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef RECONNECT_H_
+#define RECONNECT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define RECONNECT_BASE_MS       500     // delay before the second retry
+#define RECONNECT_MAX_MS        60000   // backoff cap
+#define RECONNECT_HANDSHAKE_MS  5000    // SYN to CONNACK deadline
+
+// Reconnect states
+#define RECONNECT_IDLE          0       // not connected and not wanted
+#define RECONNECT_WAITING       1       // backoff delay running
+#define RECONNECT_CONNECTING    2       // handshake in progress
+#define RECONNECT_CONNECTED     3
+
+typedef struct _reconnectStats
+{
+    uint32_t attempts;                  // handshakes started
+    uint32_t successes;                 // CONNACKs accepted
+    uint32_t timeouts;                  // handshakes that missed the deadline
+    uint32_t losses;                    // established sessions that were lost
+    uint32_t lastOutageMs;              // loss (or first try) to CONNACK
+    uint32_t maxOutageMs;
+} reconnectStats;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initReconnect(uint8_t mac[6]);
+void reconnectStart();
+void reconnectStop();
+void reconnectLost();
+void reconnectConnected();
+uint32_t reconnectBackoff(uint8_t retries);
+uint8_t reconnectState();
+reconnectStats* reconnectGetStats();
+
+#endif
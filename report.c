@@ -0,0 +1,172 @@
+// Report Policy Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Decides per metric whether a new sample is worth reporting. A sample is
+// reported when it moved out of the deadband around the last reported
+// value, but no sooner than minIntervalMs after the previous report; a
+// heartbeat is reported after maxIntervalMs even if nothing changed.
+// A change held back by the rate cap is kept (the one furthest from the last
+// report) and reported once the cap allows, even if the value has come back
+// by then, so an excursion is delayed but never lost. Callers publish
+// reportValue(), which is that held value rather than the current sample.
+// Values are integers in the caller's fixed-point unit; the relative
+// deadband is in 1/1000 of the last reported value.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "report.h"
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _reportMetric
+{
+    char* name;
+    reportPolicy policy;
+    reportStats stats;
+    bool reported;                  // lastValue and lastTime are valid
+    int32_t lastValue;
+    uint32_t lastTime;
+    bool pending;                   // a change is waiting for the rate cap
+    int32_t pendingValue;
+} reportMetric;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+reportMetric reportMetrics[MAX_REPORTS];
+uint8_t reportMetricCount = 0;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Registers a metric, returns its handle or REPORT_NONE if the table is full
+uint8_t reportAdd(char* name, int32_t absDeadband, uint16_t relDeadband, uint32_t minIntervalMs, uint32_t maxIntervalMs)
+{
+    reportMetric* m;
+    if (reportMetricCount >= MAX_REPORTS)
+        return REPORT_NONE;
+    m = &reportMetrics[reportMetricCount];
+    m->name = name;
+    m->policy.absDeadband = absDeadband;
+    m->policy.relDeadband = relDeadband;
+    m->policy.minIntervalMs = minIntervalMs;
+    m->policy.maxIntervalMs = maxIntervalMs;
+    m->stats.sent = 0;
+    m->stats.heartbeats = 0;
+    m->stats.suppressed = 0;
+    m->stats.rateLimited = 0;
+    m->reported = false;
+    m->pending = false;
+    return reportMetricCount++;
+}
+
+static uint32_t reportDistance(int32_t a, int32_t b)
+{
+    return (a >= b) ? (uint32_t)(a - b) : (uint32_t)(b - a);
+}
+
+// Evaluates a sample, returns true if reportValue() should be reported
+bool reportSample(uint8_t metric, int32_t value, uint32_t now)
+{
+    reportMetric* m = &reportMetrics[metric];
+    uint32_t elapsed, delta, last;
+    bool changed;
+
+    if (!m->reported)
+    {
+        changed = true;
+        elapsed = m->policy.minIntervalMs;
+    }
+    else
+    {
+        elapsed = now - m->lastTime;
+        delta = reportDistance(value, m->lastValue);
+        last = reportDistance(m->lastValue, 0);
+
+        // with no deadband configured every sample counts as a change
+        changed = m->policy.absDeadband == 0 && m->policy.relDeadband == 0;
+        if (m->policy.absDeadband != 0 && delta >= (uint32_t)m->policy.absDeadband)
+            changed = true;
+        if (m->policy.relDeadband != 0 && (uint64_t)delta * 1000 >= (uint64_t)last * m->policy.relDeadband)
+            changed = true;
+
+        if (m->policy.maxIntervalMs != 0 && elapsed >= m->policy.maxIntervalMs)
+        {
+            if (!changed)
+                m->stats.heartbeats++;
+            changed = true;
+            elapsed = m->policy.minIntervalMs;
+        }
+    }
+
+    if (elapsed < m->policy.minIntervalMs)
+    {
+        if (changed)
+        {
+            m->stats.rateLimited++;
+            if (!m->pending || delta > reportDistance(m->pendingValue, m->lastValue))
+                m->pendingValue = value;
+            m->pending = true;
+        }
+        else
+            m->stats.suppressed++;
+        return false;
+    }
+    if (!changed && !m->pending)
+    {
+        m->stats.suppressed++;
+        return false;
+    }
+
+    // a held excursion wins over a current value that moved less
+    if (!m->pending || (changed && delta >= reportDistance(m->pendingValue, m->lastValue)))
+        m->pendingValue = value;
+    m->stats.sent++;
+    m->reported = true;
+    m->pending = false;
+    m->lastValue = m->pendingValue;
+    m->lastTime = now;
+    return true;
+}
+
+// Value to publish after reportSample() returned true
+int32_t reportValue(uint8_t metric)
+{
+    return reportMetrics[metric].lastValue;
+}
+
+uint8_t reportCount()
+{
+    return reportMetricCount;
+}
+
+char* reportName(uint8_t metric)
+{
+    return reportMetrics[metric].name;
+}
+
+reportPolicy* reportGetPolicy(uint8_t metric)
+{
+    return &reportMetrics[metric].policy;
+}
+
+reportStats* reportGetStats(uint8_t metric)
+{
+    return &reportMetrics[metric].stats;
+}
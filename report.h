@@ -0,0 +1,52 @@
+// Report Policy Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_REPORTS         8
+#define REPORT_NONE         0xFF
+
+typedef struct _reportPolicy
+{
+    int32_t absDeadband;            // report when |v - last| >= absDeadband, 0 = off
+    uint16_t relDeadband;           // or when |v - last| >= relDeadband/1000 * |last|, 0 = off
+    uint32_t minIntervalMs;         // rate cap between reports
+    uint32_t maxIntervalMs;         // heartbeat, 0 = none
+} reportPolicy;
+
+typedef struct _reportStats
+{
+    uint32_t sent;                  // reports, heartbeats included
+    uint32_t heartbeats;            // reports forced by maxIntervalMs
+    uint32_t suppressed;            // samples inside the deadband
+    uint32_t rateLimited;           // changes held back by minIntervalMs
+} reportStats;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+uint8_t reportAdd(char* name, int32_t absDeadband, uint16_t relDeadband, uint32_t minIntervalMs, uint32_t maxIntervalMs);
+bool reportSample(uint8_t metric, int32_t value, uint32_t now);
+int32_t reportValue(uint8_t metric);
+uint8_t reportCount();
+char* reportName(uint8_t metric);
+reportPolicy* reportGetPolicy(uint8_t metric);
+reportStats* reportGetStats(uint8_t metric);
+
+#endif
@@ -0,0 +1,100 @@
+// Idle Sleep Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// Called by the main loop when eventDispatch() finds nothing to do. With
+// interrupts disabled it checks that no event slipped in, stretches SysTick
+// to the next timer expiry and executes WFI; any interrupt (ENC28J60 INT,
+// UART0, the ADC block, SysTick) ends the sleep even though PRIMASK is
+// set. The uptime is then corrected and interrupts enabled, so the
+// interrupt that woke the CPU runs and posts its event.
+// This is sleep, not deep sleep: deep sleep would stop the PLL that clocks
+// Timer 2, the ADC and SPI0, and the ADC keeps sampling through uDMA while
+// the CPU sleeps. The cycles from the WFI return to interrupts enabled are
+// counted with the DWT cycle counter on every wake and checked against
+// SLEEP_WAKE_BOUND_CYCLES; the rest of the wake-to-packet latency is the
+// EVENT_ETHER_RX dispatch latency kept by the event dispatcher.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "event.h"
+#include "prof.h"
+#include "sleep.h"
+#include "Timer.h"
+#include "trace.h"
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+sleepStats sleepCounters;
+uint32_t sleepRemainderUs = 0;      // below 1 ms, not in sleptMs yet
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initSleep()
+{
+    CORE_DEMCR_R |= CORE_DEMCR_TRCENA;
+    DWT_CYCCNT_R = 0;
+    DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+    NVIC_SYS_CTRL_R &= ~(NVIC_SYS_CTRL_SLEEPDEEP | NVIC_SYS_CTRL_SLEEPEXIT);
+}
+
+// Sleeps until the next interrupt
+void sleepIdle()
+{
+    uint32_t start, wake, cycles, slept;
+    bool tickless;
+
+    __asm(" CPSID I");
+    if (eventPending())
+    {
+        sleepCounters.skipped++;
+        __asm(" CPSIE I");
+        return;
+    }
+    start = getUptimeUs();
+    tickless = startTickless(timerNextExpiry(TICKLESS_MAX_MS));
+    TRACE(TRACE_SLEEP_BEGIN, 0);
+    __asm(" DSB");
+    __asm(" WFI");
+    wake = DWT_CYCCNT_R;
+    TRACE(TRACE_SLEEP_END, 0);
+    if (tickless)
+        slept = stopTickless();
+    else
+        slept = getUptimeUs() - start;
+    cycles = DWT_CYCCNT_R - wake;
+
+    sleepCounters.sleeps++;
+    sleepCounters.lastSleepUs = slept;
+    if (slept > sleepCounters.maxSleepUs)
+        sleepCounters.maxSleepUs = slept;
+    sleepRemainderUs += slept;
+    sleepCounters.sleptMs += sleepRemainderUs / 1000;
+    sleepRemainderUs %= 1000;
+    sleepCounters.lastWakeCycles = cycles;
+    if (cycles > sleepCounters.maxWakeCycles)
+        sleepCounters.maxWakeCycles = cycles;
+    if (cycles > SLEEP_WAKE_BOUND_CYCLES)
+        sleepCounters.overBound++;
+    __asm(" CPSIE I");
+}
+
+sleepStats* sleepGetStats()
+{
+    return &sleepCounters;
+}
@@ -0,0 +1,45 @@
+// Idle Sleep Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef SLEEP_H_
+#define SLEEP_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// WFI return to interrupts enabled, 10 us; the pending interrupt then
+// starts 12 cycles later
+#define SLEEP_WAKE_BOUND_CYCLES 400
+
+typedef struct _sleepStats
+{
+    uint32_t sleeps;                // WFIs executed
+    uint32_t skipped;               // an event came in before the WFI
+    uint32_t sleptMs;               // total time asleep
+    uint32_t lastSleepUs;
+    uint32_t maxSleepUs;
+    uint32_t lastWakeCycles;        // WFI return to interrupts enabled
+    uint32_t maxWakeCycles;
+    uint32_t overBound;             // wakes longer than SLEEP_WAKE_BOUND_CYCLES
+} sleepStats;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initSleep();
+void sleepIdle();
+sleepStats* sleepGetStats();
+
+#endif
@@ -0,0 +1,237 @@
+// Runtime Statistics Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Registry of the counters every layer keeps. A layer owns a struct of
+// uint32_t counters, increments them with a plain ++ from the one context
+// that writes each of them, and registers the struct once with a name per
+// counter; nothing is locked or copied on the hot path. Values kept
+// elsewhere (ring drops, queue depths) are copied in by the layer's refresh
+// function just before a read. The stats command prints the registry, and
+// every period the registry is published as JSON on sys/<mac>/stats, e.g.
+//   {"uptime":1234,"ether":{"rx":10,"tx":8,...},"mqtt":{...}}
+// where a flattening JSON input (Telegraf, Node-RED) can chart it.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cli.h"
+#include "event.h"
+#include "stats.h"
+#include "Timer.h"
+#include "uart0.h"
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _statsLayer
+{
+    const char* name;
+    const char* const* names;
+    uint32_t* counters;
+    uint8_t count;
+    _statsRefresh refresh;
+} statsLayer;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+statsLayer statsLayers[MAX_STATS_LAYERS];
+uint8_t statsLayerCount = 0;
+char statsText[STATS_TEXT_SIZE];
+uint16_t statsTextSize = 0;
+char statsTopicName[] = "sys/000000000000/stats";
+timerHandle statsTimer = TIMER_NONE;
+uint32_t statsPeriodMs = STATS_PUBLISH_MS;
+bool statsPending = false;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+static void statsRefresh()
+{
+    uint8_t i;
+    for (i = 0; i < statsLayerCount; i++)
+    {
+        if (statsLayers[i].refresh != NULL)
+            (*statsLayers[i].refresh)();
+    }
+}
+
+static void statsPut(const char* str)
+{
+    while (*str != '\0' && statsTextSize < STATS_TEXT_SIZE)
+        statsText[statsTextSize++] = *str++;
+}
+
+static void statsPutUint(uint32_t value)
+{
+    char digits[10];
+    uint8_t i = 0;
+    do
+    {
+        digits[i++] = '0' + value % 10;
+        value /= 10;
+    } while (value > 0);
+    while (i > 0 && statsTextSize < STATS_TEXT_SIZE)
+        statsText[statsTextSize++] = digits[--i];
+}
+
+// Formats the registry into statsText
+static void statsFormat()
+{
+    statsLayer* layer;
+    uint8_t i, j;
+    statsRefresh();
+    statsTextSize = 0;
+    statsPut("{\"uptime\":");
+    statsPutUint(getUptimeMs() / 1000);
+    for (i = 0; i < statsLayerCount; i++)
+    {
+        layer = &statsLayers[i];
+        statsPut(",\"");
+        statsPut(layer->name);
+        statsPut("\":{");
+        for (j = 0; j < layer->count; j++)
+        {
+            if (j > 0)
+                statsPut(",");
+            statsPut("\"");
+            statsPut(layer->names[j]);
+            statsPut("\":");
+            statsPutUint(layer->counters[j]);
+        }
+        statsPut("}");
+    }
+    statsPut("}");
+}
+
+static void statsTick(void* context)
+{
+    statsPending = true;
+    eventPost(EVENT_MQTT, 0);
+}
+
+static void statsShow()
+{
+    statsLayer* layer;
+    uint8_t i, j;
+    statsRefresh();
+    for (i = 0; i < statsLayerCount; i++)
+    {
+        layer = &statsLayers[i];
+        putsUart0((char*)layer->name);
+        putsUart0(":");
+        for (j = 0; j < layer->count; j++)
+        {
+            putsUart0(j > 0 ? ", " : " ");
+            putsUart0((char*)layer->names[j]);
+            putsUart0(" ");
+            putsUart0(itostring(layer->counters[j]));
+        }
+        putsUart0("\n\r");
+    }
+}
+
+// stats, stats clear, stats period <s> (0 stops publishing)
+static void statsCommand(USER_DATA* data)
+{
+    uint8_t i, j;
+    if (data->fieldcount >= 2 && stringcmp("clear", getFieldString(data, 2)))
+    {
+        for (i = 0; i < statsLayerCount; i++)
+        {
+            for (j = 0; j < statsLayers[i].count; j++)
+                statsLayers[i].counters[j] = 0;
+        }
+    }
+    else if (data->fieldcount >= 3 && stringcmp("period", getFieldString(data, 2)))
+    {
+        statsPeriodMs = getFieldInteger(data, 3) > 0 ? getFieldInteger(data, 3) * 1000 : 0;
+        if (statsTimer != TIMER_NONE)
+            stopTimer(statsTimer);
+        statsTimer = TIMER_NONE;
+        if (statsPeriodMs > 0)
+            statsTimer = startPeriodicTimer(statsTick, NULL, statsPeriodMs);
+    }
+    else
+        statsShow();
+}
+
+// After initCli(), registers the stats command
+void initStats()
+{
+    statsLayerCount = 0;
+    cliRegister("stats", 1, statsCommand, "[clear|period <s>]  counters of every layer");
+}
+
+// names and counters must stay valid, they are read in place
+// Returns false if the registry is full
+bool statsRegister(const char* layer, const char* const names[], uint32_t counters[], uint8_t count, _statsRefresh refresh)
+{
+    statsLayer* entry;
+    if (statsLayerCount >= MAX_STATS_LAYERS)
+        return false;
+    entry = &statsLayers[statsLayerCount++];
+    entry->name = layer;
+    entry->names = names;
+    entry->counters = counters;
+    entry->count = count;
+    entry->refresh = refresh;
+    return true;
+}
+
+// Names the topic after the board and starts the publish timer
+void statsStart(uint8_t mac[6])
+{
+    static const char hex[] = "0123456789abcdef";
+    uint8_t i;
+    for (i = 0; i < 6; i++)
+    {
+        statsTopicName[4 + 2 * i] = hex[mac[i] >> 4];
+        statsTopicName[5 + 2 * i] = hex[mac[i] & 15];
+    }
+    if (statsPeriodMs > 0)
+        statsTimer = startPeriodicTimer(statsTick, NULL, statsPeriodMs);
+}
+
+// Returns true once per period, when the stats should be published
+bool statsDue()
+{
+    bool due = statsPending;
+    statsPending = false;
+    return due;
+}
+
+char* statsTopic()
+{
+    return statsTopicName;
+}
+
+// _payloadWriter for the publish: a NULL buffer takes the snapshot and
+// measures it, the second call copies the same text
+uint16_t statsPayload(uint8_t buffer[], uint16_t size, void* context)
+{
+    uint16_t i;
+    if (buffer == NULL)
+    {
+        statsFormat();
+        return statsTextSize;
+    }
+    for (i = 0; i < size && i < statsTextSize; i++)
+        buffer[i] = statsText[i];
+    return i;
+}
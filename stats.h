@@ -0,0 +1,42 @@
+// Runtime Statistics Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef STATS_H_
+#define STATS_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_STATS_LAYERS    8
+#define STATS_TEXT_SIZE     1024    // JSON payload
+#define STATS_PUBLISH_MS    60000   // default publish period
+
+// Number of counters in a struct of uint32_t counters
+#define STATS_COUNT(s)      (sizeof(s) / sizeof(uint32_t))
+
+// Copies gauges kept elsewhere into the layer's counters before a read
+typedef void(*_statsRefresh)();
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initStats();
+bool statsRegister(const char* layer, const char* const names[], uint32_t counters[], uint8_t count, _statsRefresh refresh);
+void statsStart(uint8_t mac[6]);
+bool statsDue();
+char* statsTopic();
+uint16_t statsPayload(uint8_t buffer[], uint16_t size, void* context);
+
+#endif
@@ -0,0 +1,178 @@
+/*
+ * MQTT v5 interop check of the board's topic aliases, through a broker.
+ *
+ * Build and run from tools/:
+ *     cc -O2 -I.. -o alias_check alias_check.c -lmosquitto
+ *     ./alias_check [-k <board client id>] <broker> <count> <topic>...
+ *
+ * Set the board to v5 (set version 5), connect it to the same broker and
+ * have it publish each topic at least count times, e.g. from the console or
+ * by letting the channel reports run. Every publish after the first on a
+ * connection goes out with an empty topic and only its alias, so the
+ * broker has to resolve the alias to deliver it here. This subscribes as a
+ * v5 client and checks that count messages arrive for every topic, each
+ * under its full topic name, and that nothing arrives under another name.
+ * Without -k the board's connects counter (stats) should not move,
+ * or the publishes did not share a connection. User Property and
+ * Correlation Data of the first message are shown when the board sends
+ * them. The exit status is 1 on a missing or misrouted message.
+ *
+ * With -k, once half of the messages are in, a second client connects with
+ * the board's client id, so the broker drops the board's connection. The
+ * board then publishes again on a new connection, and whatever was in
+ * flight is retried once PUBLISH_TIMEOUT_MS runs out. Those publishes must
+ * carry their topics again rather than an alias the new connection never
+ * learnt; a broker that gets one closes the connection with a Protocol
+ * Error and the rest of the messages never arrive.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mosquitto.h"
+#include "prop.h"
+
+#define MAX_TOPICS      16
+#define TIMEOUT_S       120
+
+static char** topics;
+static int topicCount;
+static int wanted;
+static int received[MAX_TOPICS];
+static int misrouted = 0;
+static bool shown = false;
+
+static void onConnect(struct mosquitto* mosq, void* obj, int rc, int flags, const mosquitto_property* props)
+{
+    int i;
+    if (rc != 0)
+    {
+        printf("connect refused: %s\n", mosquitto_reason_string(rc));
+        exit(1);
+    }
+    for (i = 0; i < topicCount; i++)
+        mosquitto_subscribe_v5(mosq, NULL, topics[i], 1, 0, NULL);
+}
+
+static void showProperties(const mosquitto_property* props)
+{
+    char *name = NULL, *value = NULL;
+    void* data = NULL;
+    uint16_t length = 0;
+    if (mosquitto_property_read_string_pair(props, PROP_USER_PROPERTY, &name, &value, false) != NULL)
+        printf("  user property %s=%s\n", name, value);
+    if (mosquitto_property_read_binary(props, PROP_CORRELATION_DATA, &data, &length, false) != NULL)
+        printf("  correlation data %.*s\n", length, (char*)data);
+    free(name);
+    free(value);
+    free(data);
+}
+
+static void onMessage(struct mosquitto* mosq, void* obj, const struct mosquitto_message* msg, const mosquitto_property* props)
+{
+    int i;
+    for (i = 0; i < topicCount; i++)
+    {
+        if (strcmp(msg->topic, topics[i]) == 0)
+        {
+            if (!shown)
+            {
+                printf("first message \"%s\": %.*s\n", msg->topic, msg->payloadlen, (char*)msg->payload);
+                showProperties(props);
+                shown = true;
+            }
+            received[i]++;
+            return;
+        }
+    }
+    if (misrouted++ < 10)
+        printf("message under unexpected topic \"%s\"\n", msg->topic);
+}
+
+static bool reached(int count)
+{
+    int i;
+    for (i = 0; i < topicCount; i++)
+    {
+        if (received[i] < count)
+            return false;
+    }
+    return true;
+}
+
+// Takes the board's client id for a moment, which ends its connection
+static void kick(const char* host, const char* clientId)
+{
+    struct mosquitto* mosq = mosquitto_new(clientId, true, NULL);
+    int i;
+    mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+    if (mosquitto_connect_bind_v5(mosq, host, 1883, 60, NULL, NULL) == MOSQ_ERR_SUCCESS)
+    {
+        for (i = 0; i < 10; i++)
+            mosquitto_loop(mosq, 100, 1);
+        mosquitto_disconnect(mosq);
+        printf("took over client id %s\n", clientId);
+    }
+    else
+        printf("cannot connect as %s\n", clientId);
+    mosquitto_destroy(mosq);
+}
+
+int main(int argc, char* argv[])
+{
+    struct mosquitto* mosq;
+    time_t deadline;
+    int i, failures = 0;
+    const char* kickId = NULL;
+
+    if (argc > 2 && strcmp(argv[1], "-k") == 0)
+    {
+        kickId = argv[2];
+        argv += 2;
+        argc -= 2;
+    }
+    if (argc < 4 || argc - 3 > MAX_TOPICS)
+    {
+        fprintf(stderr, "usage: %s [-k <board client id>] <broker> <count> <topic>... (up to %d topics)\n",
+                argv[0], MAX_TOPICS);
+        return 2;
+    }
+    wanted = atoi(argv[2]);
+    topics = &argv[3];
+    topicCount = argc - 3;
+
+    mosquitto_lib_init();
+    mosq = mosquitto_new(NULL, true, NULL);
+    mosquitto_int_option(mosq, MOSQ_OPT_PROTOCOL_VERSION, MQTT_PROTOCOL_V5);
+    mosquitto_connect_v5_callback_set(mosq, onConnect);
+    mosquitto_message_v5_callback_set(mosq, onMessage);
+    if (mosquitto_connect_bind_v5(mosq, argv[1], 1883, 60, NULL, NULL) != MOSQ_ERR_SUCCESS)
+    {
+        printf("cannot connect to %s\n", argv[1]);
+        return 1;
+    }
+
+    deadline = time(NULL) + TIMEOUT_S;
+    while (!reached(wanted) && time(NULL) < deadline)
+    {
+        if (mosquitto_loop(mosq, 100, 1) != MOSQ_ERR_SUCCESS)
+            mosquitto_reconnect(mosq);
+        if (kickId != NULL && reached((wanted + 1) / 2))
+        {
+            kick(argv[1], kickId);
+            kickId = NULL;
+        }
+    }
+
+    for (i = 0; i < topicCount; i++)
+    {
+        printf("%s: %d of %d\n", topics[i], received[i], wanted);
+        failures += received[i] < wanted;
+    }
+    printf("%d misrouted\n", misrouted);
+    mosquitto_disconnect(mosq);
+    mosquitto_destroy(mosq);
+    mosquitto_lib_cleanup();
+    return failures || misrouted ? 1 : 0;
+}
@@ -0,0 +1,150 @@
+#!/usr/bin/env python3
+"""Decode CBOR telemetry published by the board and print it as JSON.
+
+Usage:
+    mosquitto_sub -h <broker> -t temperature -C 1 | python3 cbor_decode.py
+    python3 cbor_decode.py a3637365710c...       (hex on the command line)
+    python3 cbor_decode.py -f payload.bin
+
+Decimal fractions (tag 4) are printed as numbers, other tags as
+{"tag": n, "value": ...}. Only what the board's encoder produces is
+required, but every RFC 8949 major type is accepted.
+"""
+
+import json
+import struct
+import sys
+from decimal import Decimal
+
+
+class CborError(Exception):
+    pass
+
+
+def decode(data, pos=0):
+    """Returns (item, next position) for the item starting at pos."""
+    if pos >= len(data):
+        raise CborError("truncated at byte %d" % pos)
+    initial = data[pos]
+    major, info = initial >> 5, initial & 0x1F
+    pos += 1
+
+    if major == 7:
+        if info == 20:
+            return False, pos
+        if info == 21:
+            return True, pos
+        if info in (22, 23):
+            return None, pos
+        if info == 25:
+            return _half(data[pos:pos + 2]), pos + 2
+        if info == 26:
+            return struct.unpack(">f", data[pos:pos + 4])[0], pos + 4
+        if info == 27:
+            return struct.unpack(">d", data[pos:pos + 8])[0], pos + 8
+        if info < 24:
+            return {"simple": info}, pos
+        raise CborError("unsupported simple value %d" % info)
+
+    if info < 24:
+        arg = info
+    elif info in (24, 25, 26, 27):
+        size = 1 << (info - 24)
+        if pos + size > len(data):
+            raise CborError("truncated argument at byte %d" % pos)
+        arg = int.from_bytes(data[pos:pos + size], "big")
+        pos += size
+    elif info == 31 and major in (2, 3, 4, 5):
+        return _indefinite(data, pos, major)
+    else:
+        raise CborError("bad additional info %d at byte %d" % (info, pos - 1))
+
+    if major == 0:
+        return arg, pos
+    if major == 1:
+        return -1 - arg, pos
+    if major in (2, 3):
+        if pos + arg > len(data):
+            raise CborError("truncated string at byte %d" % pos)
+        raw = bytes(data[pos:pos + arg])
+        return (raw.hex() if major == 2 else raw.decode("utf-8")), pos + arg
+    if major == 4:
+        items = []
+        for _ in range(arg):
+            item, pos = decode(data, pos)
+            items.append(item)
+        return items, pos
+    if major == 5:
+        result = {}
+        for _ in range(arg):
+            key, pos = decode(data, pos)
+            value, pos = decode(data, pos)
+            result[str(key)] = value
+        return result, pos
+    # major 6: tag
+    value, pos = decode(data, pos)
+    if arg == 4 and isinstance(value, list) and len(value) == 2:
+        return Decimal(value[1]).scaleb(value[0]), pos
+    return {"tag": arg, "value": value}, pos
+
+
+def _indefinite(data, pos, major):
+    items = []
+    while True:
+        if pos >= len(data):
+            raise CborError("unterminated indefinite item")
+        if data[pos] == 0xFF:
+            pos += 1
+            break
+        item, pos = decode(data, pos)
+        items.append(item)
+    if major == 2:
+        return "".join(items), pos
+    if major == 3:
+        return "".join(items), pos
+    if major == 4:
+        return items, pos
+    return {str(k): v for k, v in zip(items[::2], items[1::2])}, pos
+
+
+def _half(raw):
+    half = int.from_bytes(raw, "big")
+    exp = (half >> 10) & 0x1F
+    mant = half & 0x3FF
+    if exp == 0:
+        value = mant * 2.0 ** -24
+    elif exp == 31:
+        value = float("inf") if mant == 0 else float("nan")
+    else:
+        value = (mant + 1024) * 2.0 ** (exp - 25)
+    return -value if half & 0x8000 else value
+
+
+def _json_default(value):
+    if isinstance(value, Decimal):
+        return float(value)
+    raise TypeError(type(value))
+
+
+def main(argv):
+    if len(argv) > 2 and argv[1] == "-f":
+        with open(argv[2], "rb") as f:
+            data = f.read()
+    elif len(argv) > 1:
+        data = bytes.fromhex("".join(argv[1:]))
+    else:
+        data = sys.stdin.buffer.read()
+
+    pos = 0
+    while pos < len(data):
+        item, pos = decode(data, pos)
+        print(json.dumps(item, default=_json_default))
+    return 0
+
+
+if __name__ == "__main__":
+    try:
+        sys.exit(main(sys.argv))
+    except CborError as e:
+        print("cbor_decode: %s" % e, file=sys.stderr)
+        sys.exit(1)
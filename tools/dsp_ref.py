@@ -0,0 +1,149 @@
+#!/usr/bin/env python3
+"""Host reference for the fixed-point sensor pipeline in dsp.c.
+
+Runs raw ADC counts through a bit-exact model of the firmware (calibration,
+then the selected filter) next to the same filter in floating point, and
+prints both with the largest difference. Use it to check a firmware change
+or to pick filter settings from a recorded trace before trying them on the
+board.
+
+Usage:
+    python3 dsp_ref.py 2050 2051 2049 ...            (raw counts)
+    python3 dsp_ref.py --filter median:5 < raw.txt
+    python3 dsp_ref.py --filter iir:125 --gain -19800 15 1475 2050 ...
+
+Filters: none, avg:<n>, iir:<permille>, median:<n> (as "set filter" on the
+board). The default filter is avg:16 and the default calibration
+is the TM4C123 temperature sensor in tenths of a degree.
+"""
+
+import argparse
+import sys
+
+INT16_MIN, INT16_MAX = -32768, 32767
+INT32_MIN, INT32_MAX = -2 ** 31, 2 ** 31 - 1
+MAX_WINDOW = 16
+
+
+def ssat16(x):
+    return max(INT16_MIN, min(INT16_MAX, x))
+
+
+def qadd(a, b):
+    return max(INT32_MIN, min(INT32_MAX, a + b))
+
+
+def divide(total, count):
+    """C division rounding halves away from zero."""
+    half = count // 2
+    num = total - half if total < 0 else total + half
+    q = abs(num) // count
+    return ssat16(-q if num < 0 else q)
+
+
+class FixedFilter:
+    """Mirrors dspFilter/dspProcess()."""
+
+    def __init__(self, gain, shift, offset, kind, arg):
+        self.gain, self.shift, self.offset = gain, shift, offset
+        self.kind = kind
+        self.length = min(arg, MAX_WINDOW) if arg else MAX_WINDOW
+        self.alpha = max(1, arg * 32767 // 1000) if kind == "iir" else 0x7FFF
+        self.window = [0] * MAX_WINDOW
+        self.index = self.count = self.sum = self.state = 0
+        self.output = 0
+
+    def calibrate(self, raw):
+        scaled = raw * self.gain
+        if self.shift > 0:
+            scaled = (scaled + (1 << (self.shift - 1))) >> self.shift
+        return ssat16(qadd(scaled, self.offset))
+
+    def process(self, raw):
+        x = self.calibrate(raw)
+        if self.kind == "avg":
+            old = self.window[self.index] if self.count == self.length else 0
+            self.count = min(self.count + 1, self.length)
+            self.window[self.index] = x
+            self.index = (self.index + 1) % self.length
+            self.sum = qadd(self.sum, x - old)
+            self.output = divide(self.sum, self.count)
+        elif self.kind == "iir":
+            if self.count == 0:
+                self.state = x << 15
+                self.count = 1
+            else:
+                self.state = qadd(self.state, (x - self.output) * self.alpha)
+            self.output = ssat16((self.state + (1 << 14)) >> 15)
+        elif self.kind == "median":
+            self.count = min(self.count + 1, self.length)
+            self.window[self.index] = x
+            self.index = (self.index + 1) % self.length
+            s = sorted(self.window[:self.count])
+            n = self.count
+            if n & 1:
+                self.output = s[n // 2]
+            else:
+                self.output = int((s[n // 2 - 1] + s[n // 2]) / 2)
+        else:
+            self.output = x
+        return self.output
+
+
+class FloatFilter:
+    """The same pipeline without quantization."""
+
+    def __init__(self, gain, shift, offset, kind, arg):
+        self.gain = gain / float(1 << shift)
+        self.offset = offset
+        self.kind = kind
+        self.length = min(arg, MAX_WINDOW) if arg else MAX_WINDOW
+        self.alpha = arg / 1000.0 if kind == "iir" else 1.0
+        self.history = []
+        self.output = None
+
+    def process(self, raw):
+        x = self.offset + raw * self.gain
+        self.history = (self.history + [x])[-self.length:]
+        if self.kind == "avg":
+            self.output = sum(self.history) / len(self.history)
+        elif self.kind == "iir":
+            self.output = x if self.output is None else self.output + self.alpha * (x - self.output)
+        elif self.kind == "median":
+            s = sorted(self.history)
+            n = len(s)
+            self.output = s[n // 2] if n & 1 else (s[n // 2 - 1] + s[n // 2]) / 2
+        else:
+            self.output = x
+        return self.output
+
+
+def main():
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("raw", nargs="*", type=int, help="raw ADC counts (default: stdin)")
+    parser.add_argument("--filter", default="avg:16", metavar="TYPE[:N]",
+                        help="none | avg:<n> | iir:<permille> | median:<n>")
+    parser.add_argument("--gain", nargs=3, type=int, default=[-19800, 15, 1475],
+                        metavar=("GAIN", "SHIFT", "OFFSET"), help="calibration as in dspInit()")
+    args = parser.parse_args()
+
+    kind, _, arg = args.filter.partition(":")
+    if kind not in ("none", "avg", "iir", "median"):
+        parser.error("unknown filter %s" % kind)
+    arg = int(arg) if arg else 0
+    samples = args.raw or [int(tok) for tok in sys.stdin.read().split()]
+
+    fixed = FixedFilter(*args.gain, kind, arg)
+    ref = FloatFilter(*args.gain, kind, arg)
+    worst = 0.0
+    print("raw\tfixed\tfloat")
+    for raw in samples:
+        f = fixed.process(raw)
+        r = ref.process(raw)
+        worst = max(worst, abs(f - r))
+        print("%d\t%d\t%.2f" % (raw, f, r))
+    print("max error: %.2f" % worst)
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,121 @@
+#!/usr/bin/env python3
+"""Print the binary log frames the board sends on UART0.
+
+Usage:
+    python3 log_decode.py /dev/ttyACM0 [baud]     (needs pyserial)
+    python3 log_decode.py -f capture.bin
+
+Give the board "log on <baud>" first; the default baud here is 115200.
+Frames are COBS encoded and end with a 0:
+    seq (16) | uptime us (32) | id (8) | args (32 each) | checksum (8)
+little endian, the byte sum of a frame is 0 mod 256. Formats come from the
+comments of the LOG_ ids in log.h. Anything between frames that does not
+decode is console text and is printed as it is. Gaps in the sequence are
+records the board dropped.
+"""
+
+import os
+import re
+import struct
+import sys
+
+HEADER = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..", "log.h")
+
+
+def load_formats(path=HEADER):
+    """Returns {id: (name, format)} from the #define LOG_x n // "format" lines."""
+    formats = {}
+    pattern = re.compile(r'#define\s+(LOG_\w+)\s+(\d+)\s*//\s*"(.*)"')
+    with open(path) as header:
+        for line in header:
+            match = pattern.match(line.strip())
+            if match:
+                formats[int(match.group(2))] = (match.group(1), match.group(3))
+    return formats
+
+
+def cobs_decode(chunk):
+    """Returns the decoded bytes, or None if chunk is not valid COBS."""
+    out = bytearray()
+    pos = 0
+    while pos < len(chunk):
+        code = chunk[pos]
+        if code == 0 or pos + code > len(chunk):
+            return None
+        out += chunk[pos + 1:pos + code]
+        pos += code
+        if code < 0xFF and pos < len(chunk):
+            out.append(0)
+    return bytes(out)
+
+
+def parse_frame(chunk):
+    """Returns (seq, time us, id, args) or None if chunk is not a frame."""
+    payload = cobs_decode(chunk)
+    if payload is None or len(payload) < 8 or (len(payload) - 8) % 4 != 0:
+        return None
+    if sum(payload) & 0xFF != 0:
+        return None
+    seq, time_us, msg_id = struct.unpack_from("<HIB", payload)
+    argc = (len(payload) - 8) // 4
+    args = struct.unpack_from("<%di" % argc, payload, 7)
+    return seq, time_us, msg_id, args
+
+
+class Decoder:
+    def __init__(self, formats, out=sys.stdout):
+        self.formats = formats
+        self.out = out
+        self.pending = bytearray()
+        self.next_seq = None
+
+    def feed(self, data):
+        self.pending += data
+        while True:
+            end = self.pending.find(0)
+            if end < 0:
+                return
+            chunk = bytes(self.pending[:end])
+            del self.pending[:end + 1]
+            if chunk:
+                self.chunk(chunk)
+
+    def chunk(self, chunk):
+        frame = parse_frame(chunk)
+        if frame is None:
+            self.out.write(chunk.decode("ascii", "replace"))
+            return
+        seq, time_us, msg_id, args = frame
+        if self.next_seq is not None and seq != self.next_seq:
+            self.out.write("(%d records lost)\n" % ((seq - self.next_seq) & 0xFFFF))
+        self.next_seq = (seq + 1) & 0xFFFF
+        name, fmt = self.formats.get(msg_id, ("LOG_%d" % msg_id, "id %d" % msg_id + " %d" * len(args)))
+        try:
+            text = fmt % args
+        except TypeError:
+            text = "%s %s" % (fmt, " ".join(str(a) for a in args))
+        self.out.write("%12.6f %5d  %s\n" % (time_us / 1e6, seq, text))
+        self.out.flush()
+
+
+def main(argv):
+    decoder = Decoder(load_formats())
+    if len(argv) == 3 and argv[1] == "-f":
+        with open(argv[2], "rb") as capture:
+            decoder.feed(capture.read())
+        return 0
+    if len(argv) in (2, 3):
+        import serial
+        baud = int(argv[2]) if len(argv) == 3 else 115200
+        port = serial.Serial(argv[1], baud, timeout=0.1)
+        try:
+            while True:
+                decoder.feed(port.read(4096))
+        except KeyboardInterrupt:
+            return 0
+    sys.stderr.write(__doc__)
+    return 2
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
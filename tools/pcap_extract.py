@@ -0,0 +1,85 @@
+#!/usr/bin/env python3
+"""Turn a capture dump from the console into a .pcap file.
+
+Usage:
+    python3 pcap_extract.py console.txt out.pcap
+    python3 pcap_extract.py /dev/ttyACM0 out.pcap [baud]
+
+The first form reads a saved console log, the second opens the serial port
+(pyserial), sends "capture dump" and reads until the end marker. The dump
+is hex lines between
+    -----BEGIN PCAP-----
+    -----END PCAP-----
+and the bytes are a complete pcap file. Anything on a line before a binary
+log frame delimiter (0x00) is dropped, so a dump taken with log on still
+extracts. The last dump in a log file wins.
+"""
+
+import os
+import re
+import sys
+
+BEGIN = "-----BEGIN PCAP-----"
+END = "-----END PCAP-----"
+HEX = re.compile(r"^([0-9a-f]{2})+$")
+
+
+def extract(lines):
+    """Returns the bytes of the last complete dump, or None."""
+    dump = None
+    body = None
+    for line in lines:
+        line = line.split("\x00")[-1].strip()
+        if line.endswith(BEGIN):
+            body = bytearray()
+        elif line.endswith(END):
+            if body is not None:
+                dump = bytes(body)
+            body = None
+        elif body is not None and HEX.match(line):
+            body += bytes.fromhex(line)
+    return dump
+
+
+def read_serial(port, baud):
+    import serial
+    lines = []
+    with serial.Serial(port, baud, timeout=5) as tty:
+        tty.reset_input_buffer()
+        tty.write(b"capture dump\r")
+        while True:
+            raw = tty.readline()
+            if not raw:
+                raise SystemExit("timed out before " + END)
+            line = raw.decode("latin-1")
+            lines.append(line)
+            if END in line:
+                return lines
+
+
+def main(argv):
+    if len(argv) not in (3, 4):
+        sys.stderr.write(__doc__)
+        return 2
+    if os.path.isfile(argv[1]):
+        with open(argv[1], encoding="latin-1") as log:
+            lines = log.read().replace("\r", "\n").split("\n")
+    else:
+        lines = read_serial(argv[1], int(argv[3]) if len(argv) == 4 else 115200)
+    dump = extract(lines)
+    if dump is None:
+        sys.stderr.write("no complete dump found\n")
+        return 1
+    with open(argv[2], "wb") as out:
+        out.write(dump)
+    frames = 0
+    offset = 24
+    while offset + 16 <= len(dump):
+        frames += 1
+        offset += 16 + int.from_bytes(dump[offset + 8:offset + 12], "little")
+    print("%s: %d frames, %d bytes" % (argv[2], frames, len(dump)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
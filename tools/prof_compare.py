@@ -0,0 +1,87 @@
+#!/usr/bin/env python3
+"""Compare the prof dumps of two firmware builds.
+
+Usage:
+    python3 prof_compare.py old.txt new.txt [percent]
+
+Each file is the console output of the prof command (other lines are
+ignored):
+    prof build <date> <time> overhead <cycles>
+    <stage> <count> <mean> <max> <bucket 0> ... <bucket 23>
+Bucket n counts 2^(n-1) to 2^n - 1 cycles, bucket 0 zero cycles and the
+last one everything above. For every stage in both dumps the mean and the
+50th/90th/99th percentile buckets are printed side by side. A stage whose
+mean grew by more than percent (default 10) or whose 90th percentile moved
+up a bucket is flagged, and the exit status is 1 if any was.
+"""
+
+import sys
+
+PERCENTILES = (50, 90, 99)
+
+
+def load(path):
+    """Returns (build, {stage: (count, mean, max, buckets)})."""
+    build = "?"
+    stages = {}
+    with open(path, errors="replace") as dump:
+        for line in dump:
+            fields = line.split()
+            if len(fields) >= 2 and fields[0] == "prof" and fields[1] == "build":
+                build = " ".join(fields[2:])
+                continue
+            if len(fields) < 5 or not all(f.isdigit() for f in fields[1:]):
+                continue
+            values = [int(f) for f in fields[1:]]
+            stages[fields[0]] = (values[0], values[1], values[2], values[3:])
+    return build, stages
+
+
+def percentile(buckets, pct):
+    """Returns the index of the bucket holding the pct percentile."""
+    total = sum(buckets)
+    if total == 0:
+        return 0
+    seen = 0
+    for index, count in enumerate(buckets):
+        seen += count
+        if seen * 100 >= total * pct:
+            return index
+    return len(buckets) - 1
+
+
+def bound(index):
+    """Upper bound in cycles of a bucket, as text."""
+    return "0" if index == 0 else "<%d" % (1 << index)
+
+
+def main(argv):
+    if len(argv) not in (3, 4):
+        sys.stderr.write(__doc__)
+        return 2
+    limit = float(argv[3]) if len(argv) == 4 else 10.0
+    old_build, old = load(argv[1])
+    new_build, new = load(argv[2])
+    print("old: %s\nnew: %s\n" % (old_build, new_build))
+    print("%-10s %10s %10s %7s  %s" % ("stage", "old mean", "new mean", "change",
+                                        "  ".join("p%d old/new" % p for p in PERCENTILES)))
+    regressed = False
+    for stage in old:
+        if stage not in new:
+            continue
+        old_count, old_mean, _, old_buckets = old[stage]
+        new_count, new_mean, _, new_buckets = new[stage]
+        change = (new_mean - old_mean) * 100.0 / old_mean if old_mean else 0.0
+        marks = []
+        for pct in PERCENTILES:
+            marks.append("%s/%s" % (bound(percentile(old_buckets, pct)), bound(percentile(new_buckets, pct))))
+        flag = ""
+        if old_count and new_count and (change > limit or percentile(new_buckets, 90) > percentile(old_buckets, 90)):
+            flag = "  REGRESSION"
+            regressed = True
+        print("%-10s %10d %10d %+6.1f%%  %s%s" % (stage, old_mean, new_mean, change, "  ".join(marks), flag))
+    return 1 if regressed else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
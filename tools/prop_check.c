@@ -0,0 +1,354 @@
+/*
+ * Host round-trip check of the v5 property codec against libmosquitto.
+ *
+ * Build and run from tools/:
+ *     cc -O1 -g -fsanitize=address -I.. -o prop_check prop_check.c ../prop.c -lmosquitto
+ *     ./prop_check [seed]
+ *
+ * Every round picks a packet type and a few random properties (unknown
+ * identifiers, out of range values and duplicates included) and adds them
+ * both to a propWriter block and to a mosquitto_property list. The block
+ * must be accepted (every propAdd and then propCheck) exactly when every
+ * mosquitto_property_add call and mosquitto_property_check_all accept the
+ * list. propAllowed must agree with mosquitto_property_check_command. An
+ * accepted block must decode to the values added, in order, and the first
+ * property of each identifier must read back the same through propFind and
+ * the mosquitto_property_read functions.
+ *
+ * Then every accepted block is copied into a buffer of exactly its size,
+ * random bytes of it are changed and propCheck is run on the copy. Any
+ * property it passes is read through propGetInt, propGetData and
+ * propGetValue, so AddressSanitizer reports a read past the block. The
+ * exit status is 1 on any disagreement.
+ *
+ * Known difference: a PUBLISH from the broker may carry several
+ * Subscription Identifiers and propCheck accepts that, while
+ * mosquitto_property_check_all rejects every duplicate but User Property,
+ * so those rounds are not compared.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mosquitto.h"
+#include "mqtt.h"
+#include "prop.h"
+
+#define ROUNDS          200000
+#define MUTATIONS       8
+#define MAX_ADDED       6
+#define BLOCK_SIZE      256
+#define CMD_WILL        0x100   // mosquitto's command value for will properties
+
+typedef struct _added
+{
+    uint8_t id;
+    uint8_t type;
+    uint32_t value;
+    char name[8];
+    char text[8];
+} added;
+
+static const uint8_t commands[] = {MQTT_CONNECT, MQTT_CONNACK, MQTT_PUBLISH, MQTT_PUBACK, MQTT_PUBREC,
+                                   MQTT_PUBREL, MQTT_PUBCOMP, MQTT_SUBSCRIBE, MQTT_SUBACK, MQTT_UNSUBSCRIBE,
+                                   MQTT_UNSUBACK, MQTT_DISCONNECT, MQTT_AUTH, PROP_CMD_WILL};
+
+// The firmware's copies live in mqtt.c, which only builds for the board
+uint8_t mqttEncodeLength(uint8_t buffer[], uint32_t length)
+{
+    uint8_t i = 0;
+    do
+    {
+        buffer[i] = length & 0x7F;
+        length >>= 7;
+        if (length > 0)
+            buffer[i] |= 0x80;
+        i++;
+    } while (length > 0 && i < 4);
+    return i;
+}
+
+uint32_t mqttDecodeLength(uint8_t buffer[], uint8_t* bytes)
+{
+    uint32_t length = 0;
+    uint8_t i = 0;
+    do
+    {
+        length |= (uint32_t)(buffer[i] & 0x7F) << (7 * i);
+    } while ((buffer[i++] & 0x80) && i < 4);
+    *bytes = i;
+    return length;
+}
+
+static int mosqCommand(uint8_t command)
+{
+    return command == PROP_CMD_WILL ? CMD_WILL : command;
+}
+
+static void randomText(char* out)
+{
+    int i, n = rand() % 7;
+    for (i = 0; i < n; i++)
+        out[i] = 'a' + rand() % 26;
+    out[n] = '\0';
+}
+
+// Mostly edge values, so range checks are hit often
+static uint32_t randomValue(uint8_t type)
+{
+    switch (type)
+    {
+    case PROP_TYPE_BYTE:
+        return rand() % 3;
+    case PROP_TYPE_INT16:
+        return rand() % 2 ? (uint32_t)(rand() % 2) : (uint32_t)(rand() & 0xFFFF);
+    case PROP_TYPE_INT32:
+        return rand() % 2 ? (uint32_t)(rand() % 2) : (uint32_t)rand();
+    default:
+        // a Subscription Identifier of 0 is malformed on the wire, not
+        // something the add functions look at
+        return 1 + (uint32_t)rand() % (rand() % 2 ? 200 : 268435455);
+    }
+}
+
+// Adds one property to both sides, clears *mosqOk unless libmosquitto took it
+static void addBoth(propWriter* w, mosquitto_property** list, added* a, bool* mosqOk)
+{
+    int rc;
+    switch (a->type)
+    {
+    case PROP_TYPE_BYTE:
+        propAddByte(w, a->id, a->value);
+        rc = mosquitto_property_add_byte(list, a->id, a->value);
+        break;
+    case PROP_TYPE_INT16:
+        propAddInt16(w, a->id, a->value);
+        rc = mosquitto_property_add_int16(list, a->id, a->value);
+        break;
+    case PROP_TYPE_INT32:
+        propAddInt32(w, a->id, a->value);
+        rc = mosquitto_property_add_int32(list, a->id, a->value);
+        break;
+    case PROP_TYPE_VARINT:
+        propAddVarint(w, a->id, a->value);
+        rc = mosquitto_property_add_varint(list, a->id, a->value);
+        break;
+    case PROP_TYPE_BINARY:
+        propAddBinary(w, a->id, (uint8_t*)a->text, strlen(a->text));
+        rc = mosquitto_property_add_binary(list, a->id, a->text, strlen(a->text));
+        break;
+    case PROP_TYPE_STRING:
+        propAddString(w, a->id, a->text);
+        rc = mosquitto_property_add_string(list, a->id, a->text);
+        break;
+    default:
+        propAddStringPair(w, a->id, a->name, a->text);
+        rc = mosquitto_property_add_string_pair(list, a->id, a->name, a->text);
+        break;
+    }
+    *mosqOk &= rc == MOSQ_ERR_SUCCESS;
+}
+
+static bool sameData(uint8_t* data, uint16_t length, const char* text)
+{
+    return length == strlen(text) && memcmp(data, text, length) == 0;
+}
+
+// Checks the decoded block against what was added, in order
+static bool decodes(uint8_t block[], added a[], int count)
+{
+    uint8_t bytes, *p, *data;
+    uint16_t length;
+    int i;
+    mqttDecodeLength(block, &bytes);
+    p = block + bytes;
+    for (i = 0; i < count; i++)
+    {
+        if (p[0] != a[i].id)
+            return false;
+        if (a[i].type < PROP_TYPE_BINARY && propGetInt(p) != a[i].value)
+            return false;
+        if (a[i].type >= PROP_TYPE_BINARY)
+        {
+            data = propGetData(p, &length);
+            if (!sameData(data, length, a[i].type == PROP_TYPE_STRING_PAIR ? a[i].name : a[i].text))
+                return false;
+        }
+        if (a[i].type == PROP_TYPE_STRING_PAIR)
+        {
+            data = propGetValue(p, &length);
+            if (!sameData(data, length, a[i].text))
+                return false;
+        }
+        p += propSize(p);
+    }
+    return p == block + propBlockSize(block);
+}
+
+// Compares the first property of each identifier with libmosquitto's reading
+static bool readsAlike(uint8_t block[], mosquitto_property* list, added a[], int count)
+{
+    uint8_t *p, *data, b;
+    uint16_t length, i16;
+    uint32_t i32;
+    char *name = NULL, *text = NULL;
+    void* bin = NULL;
+    bool ok = true;
+    int i;
+    for (i = 0; i < count && ok; i++)
+    {
+        p = propFind(block, a[i].id, NULL);
+        if (p == NULL)
+            return false;
+        switch (a[i].type)
+        {
+        case PROP_TYPE_BYTE:
+            ok = mosquitto_property_read_byte(list, a[i].id, &b, false) != NULL && b == propGetInt(p);
+            break;
+        case PROP_TYPE_INT16:
+            ok = mosquitto_property_read_int16(list, a[i].id, &i16, false) != NULL && i16 == propGetInt(p);
+            break;
+        case PROP_TYPE_INT32:
+            ok = mosquitto_property_read_int32(list, a[i].id, &i32, false) != NULL && i32 == propGetInt(p);
+            break;
+        case PROP_TYPE_VARINT:
+            ok = mosquitto_property_read_varint(list, a[i].id, &i32, false) != NULL && i32 == propGetInt(p);
+            break;
+        case PROP_TYPE_BINARY:
+            ok = mosquitto_property_read_binary(list, a[i].id, &bin, &i16, false) != NULL
+                 && (data = propGetData(p, &length)) != NULL && length == i16 && memcmp(data, bin, length) == 0;
+            break;
+        case PROP_TYPE_STRING:
+            ok = mosquitto_property_read_string(list, a[i].id, &text, false) != NULL
+                 && (data = propGetData(p, &length)) != NULL && sameData(data, length, text);
+            break;
+        default:
+            ok = mosquitto_property_read_string_pair(list, a[i].id, &name, &text, false) != NULL
+                 && (data = propGetData(p, &length)) != NULL && sameData(data, length, name)
+                 && (data = propGetValue(p, &length)) != NULL && sameData(data, length, text);
+            break;
+        }
+        free(name);
+        free(text);
+        free(bin);
+        name = text = NULL;
+        bin = NULL;
+    }
+    return ok;
+}
+
+// Reads every property of a block propCheck passed, for the sanitizer
+static unsigned touch(uint8_t block[])
+{
+    uint8_t *p = NULL, *data;
+    uint16_t length, i;
+    unsigned sum = 0, id;
+    for (id = 1; id <= PROP_SHARED_SUB_AVAILABLE; id++)
+    {
+        while ((p = propFind(block, id, p)) != NULL)
+        {
+            sum += propGetInt(p);
+            if ((data = propGetData(p, &length)) != NULL)
+                for (i = 0; i < length; i++)
+                    sum += data[i];
+            if ((data = propGetValue(p, &length)) != NULL)
+                for (i = 0; i < length; i++)
+                    sum += data[i];
+        }
+    }
+    return sum;
+}
+
+int main(int argc, char* argv[])
+{
+    uint8_t block[BLOCK_SIZE], *copy, command;
+    added a[MAX_ADDED];
+    propWriter w;
+    mosquitto_property* list;
+    uint16_t size;
+    int i, j, k, count, failures = 0, compared = 0, accepted = 0, mutated = 0;
+    bool ours, mosqOk, subIds;
+    volatile unsigned sink = 0;
+
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+    mosquitto_lib_init();
+
+    for (i = 0; i <= PROP_SHARED_SUB_AVAILABLE + 1; i++)
+    {
+        for (j = 0; j < (int)sizeof(commands); j++)
+        {
+            if (propAllowed(i, commands[j]) != (mosquitto_property_check_command(mosqCommand(commands[j]), i) == MOSQ_ERR_SUCCESS))
+            {
+                if (failures++ < 10)
+                    printf("identifier 0x%02x in command 0x%02x: propAllowed %d\n", i, commands[j], propAllowed(i, commands[j]));
+            }
+        }
+    }
+
+    for (i = 0; i < ROUNDS; i++)
+    {
+        command = commands[rand() % sizeof(commands)];
+        count = 1 + rand() % MAX_ADDED;
+        list = NULL;
+        mosqOk = true;
+        subIds = false;
+        propBegin(&w, block, sizeof(block), command);
+        for (j = 0; j < count; j++)
+        {
+            // mostly identifiers the packet may carry, some past the table
+            do
+                a[j].id = rand() % (PROP_SHARED_SUB_AVAILABLE + 3);
+            while (!propAllowed(a[j].id, command) && rand() % 4 != 0);
+            a[j].type = propType(a[j].id) != 0 ? propType(a[j].id) : 1 + rand() % PROP_TYPE_STRING_PAIR;
+            a[j].value = randomValue(a[j].type);
+            randomText(a[j].name);
+            randomText(a[j].text);
+            for (k = 0; k < j; k++)
+                subIds |= a[j].id == PROP_SUBSCRIPTION_IDENTIFIER && a[k].id == a[j].id && command == MQTT_PUBLISH;
+            addBoth(&w, &list, &a[j], &mosqOk);
+        }
+        size = propEnd(&w);
+        ours = w.ok && propCheck(block, size, command);
+        mosqOk = mosqOk && mosquitto_property_check_all(mosqCommand(command), list) == MOSQ_ERR_SUCCESS;
+        if (!subIds)
+        {
+            compared++;
+            if (ours != mosqOk)
+            {
+                if (failures++ < 10)
+                {
+                    printf("command 0x%02x:", command);
+                    for (j = 0; j < count; j++)
+                        printf(" 0x%02x=%u", a[j].id, (unsigned)a[j].value);
+                    printf(": ours %d, mosquitto %d\n", ours, mosqOk);
+                }
+            }
+            else if (ours && (!decodes(block, a, count) || !readsAlike(block, list, a, count)))
+            {
+                if (failures++ < 10)
+                    printf("command 0x%02x: block decodes differently\n", command);
+            }
+        }
+        mosquitto_property_free_all(&list);
+
+        if (!ours)
+            continue;
+        accepted++;
+        for (j = 0; j < MUTATIONS; j++)
+        {
+            copy = malloc(size);
+            memcpy(copy, block, size);
+            copy[rand() % size] = rand() % 2 ? (uint8_t)rand() : 0x80 | PROP_SUBSCRIPTION_IDENTIFIER;
+            copy[size - 1] |= rand() % 2 ? 0x80 : 0;
+            if (propCheck(copy, size, command))
+                sink += touch(copy);
+            mutated++;
+            free(copy);
+        }
+    }
+
+    mosquitto_lib_cleanup();
+    printf("%d rounds, %d compared, %d accepted, %d mutated blocks, %d failures\n",
+           ROUNDS, compared, accepted, mutated, failures);
+    return failures ? 1 : 0;
+}
@@ -0,0 +1,139 @@
+/*
+ * Host check of the topic trie against libmosquitto.
+ *
+ * Build and run from tools/:
+ *     cc -O2 -I.. -o topic_check topic_check.c ../topic.c -lmosquitto
+ *     ./topic_check [seed]
+ *
+ * Random filters and topics are built from a few short levels, wildcards,
+ * empty levels and a '$' level. For every pair, topicMatches() and a trie
+ * holding only that filter must agree with mosquitto_topic_matches_sub(),
+ * and a filter mosquitto_sub_topic_check() rejects must be rejected by
+ * topicSubscribe() without using up trie nodes. Then the trie is filled with distinct
+ * filters and dispatching a topic is timed against calling
+ * mosquitto_topic_matches_sub() for every filter, which is what the old
+ * firmware did with strings. The exit status is 1 on any disagreement.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "mosquitto.h"
+#include "topic.h"
+
+#define PAIRS       200000
+#define FILTERS     16
+#define TOPICS      4096
+#define ROUNDS      200
+
+static const char* const levels[] = {"a", "b", "led", "udp", "", "$sys", "+", "#", "a+", "b#"};
+
+static void handler(uint8_t packet[], char* topic, char* data)
+{
+}
+
+// Up to 4 levels; wildcards only if wild, so topics never carry them
+static void randomName(char* out, int wild)
+{
+    int count = 1 + rand() % 4;
+    int i, pick;
+    out[0] = '\0';
+    for (i = 0; i < count; i++)
+    {
+        do
+            pick = rand() % (sizeof(levels) / sizeof(levels[0]));
+        while (!wild && (strchr(levels[pick], '+') || strchr(levels[pick], '#')));
+        if (i > 0)
+            strcat(out, "/");
+        strcat(out, levels[pick]);
+    }
+}
+
+static double seconds()
+{
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+int main(int argc, char* argv[])
+{
+    char filter[64], topic[64];
+    char filters[FILTERS][64];
+    char topics[TOPICS][64];
+    int i, j, failures = 0, count = 0, filterCount, tries;
+    bool expected, valid;
+    volatile unsigned matches = 0;
+    double start, trie, linear;
+
+    srand(argc > 1 ? atoi(argv[1]) : 1);
+    initTopicTrie();
+    for (i = 0; i < PAIRS; i++)
+    {
+        randomName(filter, 1);
+        randomName(topic, 0);
+        valid = mosquitto_sub_topic_check(filter) == MOSQ_ERR_SUCCESS;
+        if (topicSubscribe(filter, handler) != valid)
+        {
+            if (failures++ < 10)
+                printf("subscribe \"%s\": %s, mosquitto %s\n", filter, valid ? "rejected" : "accepted", valid ? "accepts" : "rejects");
+        }
+        // an empty topic is not a topic
+        else if (valid && mosquitto_topic_matches_sub(filter, topic, &expected) == MOSQ_ERR_SUCCESS
+                 && ((topicDispatch(NULL, topic, NULL) != 0) != expected || topicMatches(filter, topic) != expected))
+        {
+            if (failures++ < 10)
+                printf("\"%s\" against \"%s\": mosquitto %d, trie %d, topicMatches %d\n", filter, topic,
+                       expected, topicDispatch(NULL, topic, NULL) != 0, topicMatches(filter, topic));
+        }
+        topicUnsubscribe(filter);
+    }
+
+    // everything was unsubscribed, so the whole pool must be free again
+    for (i = 0; i < MAX_TOPIC_NODES - 1; i++)
+    {
+        sprintf(filter, "n%d", i);
+        if (!topicSubscribe(filter, handler))
+        {
+            printf("node pool leaked, %d of %d nodes left\n", i, MAX_TOPIC_NODES - 1);
+            failures++;
+            break;
+        }
+    }
+    initTopicTrie();
+
+    // speed, with as many filters as the pool holds
+    for (tries = 0; count < FILTERS && tries < 100000; tries++)
+    {
+        randomName(filters[count], 1);
+        if (mosquitto_sub_topic_check(filters[count]) == MOSQ_ERR_SUCCESS
+            && topicSubscribe(filters[count], handler))
+            count++;
+    }
+    filterCount = count;
+    for (i = 0; i < TOPICS; i++)
+        randomName(topics[i], 0);
+    start = seconds();
+    for (j = 0; j < ROUNDS; j++)
+        for (i = 0; i < TOPICS; i++)
+            matches += topicDispatch(NULL, topics[i], NULL);
+    trie = seconds() - start;
+    start = seconds();
+    for (j = 0; j < ROUNDS; j++)
+    {
+        for (i = 0; i < TOPICS; i++)
+        {
+            for (count = 0; count < filterCount; count++)
+            {
+                mosquitto_topic_matches_sub(filters[count], topics[i], &expected);
+                matches += expected;
+            }
+        }
+    }
+    linear = seconds() - start;
+    printf("%d pairs, %d failures\n", PAIRS, failures);
+    printf("%d filters: trie %.0f ns/topic, mosquitto_topic_matches_sub per filter %.0f ns/topic\n",
+           filterCount, trie * 1e9 / (ROUNDS * TOPICS), linear * 1e9 / (ROUNDS * TOPICS));
+    return failures ? 1 : 0;
+}
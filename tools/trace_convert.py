@@ -0,0 +1,164 @@
+#!/usr/bin/env python3
+"""Turn a trace dump from the console into a timeline.
+
+Usage:
+    python3 trace_convert.py console.txt out.json
+    python3 trace_convert.py --folded console.txt out.folded
+
+The dump is the output of the trace dump command:
+    -----BEGIN TRACE-----
+    cycles <hz> records <written>
+    <cycles 8 hex><id 2 hex><arg 6 hex> ... (4 per line)
+    -----END TRACE-----
+Anything on a line before a binary log frame delimiter (0x00) is dropped.
+The JSON is Chrome trace-event format, open it in chrome://tracing or
+ui.perfetto.dev. --folded writes the self time of every slice in the
+"track;slice;slice microseconds" form flamegraph.pl reads.
+
+How each id is drawn comes from the comments of the TRACE_ ids in trace.h
+(begin/end/mark/value, the track, then a label or the table the arg is
+looked up in), vector names from TRACE_VECTOR_ and event names from the
+EVENT_ types in event.h.
+"""
+
+import json
+import os
+import re
+import sys
+
+ROOT = os.path.join(os.path.dirname(os.path.abspath(__file__)), "..")
+BEGIN = "-----BEGIN TRACE-----"
+END = "-----END TRACE-----"
+RECORD = re.compile(r"^[0-9a-f]{16}$")
+
+
+def load_defines(path, pattern):
+    """Returns the re matches of pattern over the lines of path."""
+    matches = []
+    with open(path) as header:
+        for line in header:
+            match = re.match(pattern, line.strip())
+            if match:
+                matches.append(match)
+    return matches
+
+
+def load_tables():
+    """Returns ({id: (kind, track, label)}, {table: {arg: name}})."""
+    points = {}
+    for m in load_defines(os.path.join(ROOT, "trace.h"),
+                          r"#define\s+TRACE_\w+\s+(\d+)\s*//\s*(begin|end|mark|value)\s+(\w+)\s*(\w*)"):
+        points[int(m.group(1))] = (m.group(2), m.group(3), m.group(4))
+    vectors = {int(m.group(2)): m.group(1).lower()
+               for m in load_defines(os.path.join(ROOT, "trace.h"), r"#define\s+TRACE_VECTOR_(\w+)\s+(\d+)")}
+    events = {int(m.group(2)): m.group(1).lower()
+              for m in load_defines(os.path.join(ROOT, "event.h"), r"#define\s+EVENT_(\w+)\s+(\d+)\s*//")}
+    return points, {"vector": vectors, "event": events}
+
+
+def extract(lines):
+    """Returns (hz, [(cycles, id, arg)]) of the last complete dump."""
+    dump = None
+    body = None
+    hz = 40000000
+    for line in lines:
+        line = line.split("\x00")[-1].strip()
+        if line.endswith(BEGIN):
+            body = []
+        elif line.endswith(END):
+            if body is not None:
+                dump = (hz, body)
+            body = None
+        elif body is not None:
+            fields = line.split()
+            if len(fields) >= 2 and fields[0] == "cycles":
+                hz = int(fields[1])
+            elif fields and all(RECORD.match(f) for f in fields):
+                for f in fields:
+                    event = int(f[8:], 16)
+                    body.append((int(f[:8], 16), event >> 24, event & 0xFFFFFF))
+    return dump
+
+
+def timeline(hz, records):
+    """Returns [(us, id, arg)] in time order, the 32-bit count unwrapped."""
+    out = []
+    total = 0
+    previous = None
+    for cycles, point, arg in records:
+        if previous is not None:
+            delta = (cycles - previous) & 0xFFFFFFFF
+            if delta >= 0x80000000:
+                delta -= 0x100000000        # claimed its slot a little late
+            total += delta
+        previous = cycles
+        out.append((total * 1e6 / hz, point, arg))
+    out.sort(key=lambda r: r[0])
+    return out
+
+
+def name_of(label, arg, tables):
+    if label in tables:
+        return tables[label].get(arg, "%s %d" % (label, arg))
+    return label
+
+
+def chrome(records, points, tables):
+    tracks = {}
+    events = []
+    for us, point, arg in records:
+        kind, track, label = points.get(point, ("mark", "unknown", "id%d" % point))
+        tid = tracks.setdefault(track, len(tracks) + 1)
+        base = {"ts": us, "pid": 1, "tid": tid}
+        if kind == "begin":
+            events.append(dict(base, ph="B", name=name_of(label, arg, tables), args={"arg": arg}))
+        elif kind == "end":
+            events.append(dict(base, ph="E"))
+        elif kind == "mark":
+            events.append(dict(base, ph="i", s="t", name=name_of(label or track, arg, tables), args={"arg": arg}))
+        else:
+            events.append(dict(base, ph="C", name=track, args={label or "value": arg}))
+    for track, tid in tracks.items():
+        events.append({"ph": "M", "pid": 1, "tid": tid, "name": "thread_name", "args": {"name": track}})
+    return json.dumps({"traceEvents": events, "displayTimeUnit": "ns"}, indent=0)
+
+
+def folded(records, points, tables):
+    stacks = {}
+    totals = {}
+    for us, point, arg in records:
+        kind, track, label = points.get(point, ("mark", "unknown", ""))
+        stack = stacks.setdefault(track, [])
+        if kind == "begin":
+            stack.append([name_of(label, arg, tables), us, 0.0])
+        elif kind == "end" and stack:
+            name, start, children = stack.pop()
+            path = ";".join([track] + [s[0] for s in stack] + [name])
+            totals[path] = totals.get(path, 0.0) + (us - start) - children
+            if stack:
+                stack[-1][2] += us - start
+    return "".join("%s %d\n" % (path, round(us)) for path, us in sorted(totals.items()))
+
+
+def main(argv):
+    fold = len(argv) > 1 and argv[1] == "--folded"
+    if fold:
+        argv = argv[:1] + argv[2:]
+    if len(argv) != 3:
+        sys.stderr.write(__doc__)
+        return 2
+    with open(argv[1], encoding="latin-1") as log:
+        dump = extract(log.read().replace("\r", "\n").split("\n"))
+    if dump is None:
+        sys.stderr.write("no complete dump found\n")
+        return 1
+    points, tables = load_tables()
+    records = timeline(*dump)
+    with open(argv[2], "w") as out:
+        out.write(folded(records, points, tables) if fold else chrome(records, points, tables))
+    print("%s: %d records" % (argv[2], len(records)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
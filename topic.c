@@ -0,0 +1,324 @@
+// Topic Trie Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Routes inbound PUBLISH topics to handlers registered against MQTT topic
+// filters. Filters are stored one '/'-separated level per node, so a topic is
+// dispatched in O(levels) node visits instead of comparing it against every
+// subscription. Matching follows mosquitto_topic_matches_sub():
+//   "+" matches exactly one (possibly empty) level
+//   "#" matches the parent level and every level below it
+//   topics starting with '$' are not matched by a leading wildcard
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "topic.h"
+
+#define TOPIC_ROOT 0
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _topicNode
+{
+    char level[MAX_TOPIC_LEVEL];
+    uint8_t parent;
+    uint8_t child;              // first literal child
+    uint8_t next;               // next literal sibling, or next free node
+    uint8_t plus;               // '+' child
+    uint8_t hash;               // '#' child
+    _topicHandler handler;      // set when a filter ends at this node
+} topicNode;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+topicNode topicNodes[MAX_TOPIC_NODES];
+uint8_t topicFree;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Returns the length of the level starting at str (up to '/' or '\0')
+static uint8_t topicLevelLength(char* str)
+{
+    uint8_t len = 0;
+    while (str[len] != '/' && str[len] != '\0')
+        len++;
+    return len;
+}
+
+static bool topicLevelEquals(char* level, char* str, uint8_t len)
+{
+    uint8_t i;
+    for (i = 0; i < len; i++)
+    {
+        if (level[i] != str[i])
+            return false;
+    }
+    return level[len] == '\0';
+}
+
+static uint8_t topicAllocNode(uint8_t parent, char* str, uint8_t len)
+{
+    uint8_t n = topicFree;
+    uint8_t i;
+    if (n == TOPIC_NONE || len >= MAX_TOPIC_LEVEL)
+        return TOPIC_NONE;
+    topicFree = topicNodes[n].next;
+    for (i = 0; i < len; i++)
+        topicNodes[n].level[i] = str[i];
+    topicNodes[n].level[len] = '\0';
+    topicNodes[n].parent = parent;
+    topicNodes[n].child = TOPIC_NONE;
+    topicNodes[n].next = TOPIC_NONE;
+    topicNodes[n].plus = TOPIC_NONE;
+    topicNodes[n].hash = TOPIC_NONE;
+    topicNodes[n].handler = NULL;
+    return n;
+}
+
+// Finds the child of node n holding the given level, optionally creating it
+static uint8_t topicChild(uint8_t n, char* str, uint8_t len, bool create)
+{
+    uint8_t c;
+    if (len == 1 && str[0] == '+')
+    {
+        if (topicNodes[n].plus == TOPIC_NONE && create)
+            topicNodes[n].plus = topicAllocNode(n, str, len);
+        return topicNodes[n].plus;
+    }
+    if (len == 1 && str[0] == '#')
+    {
+        if (topicNodes[n].hash == TOPIC_NONE && create)
+            topicNodes[n].hash = topicAllocNode(n, str, len);
+        return topicNodes[n].hash;
+    }
+    c = topicNodes[n].child;
+    while (c != TOPIC_NONE && !topicLevelEquals(topicNodes[c].level, str, len))
+        c = topicNodes[c].next;
+    if (c == TOPIC_NONE && create)
+    {
+        c = topicAllocNode(n, str, len);
+        if (c != TOPIC_NONE)
+        {
+            topicNodes[c].next = topicNodes[n].child;
+            topicNodes[n].child = c;
+        }
+    }
+    return c;
+}
+
+// Returns unused leaves to the free list, walking up towards the root
+static void topicPrune(uint8_t n)
+{
+    uint8_t p, c;
+    while (n != TOPIC_ROOT && topicNodes[n].handler == NULL && topicNodes[n].child == TOPIC_NONE
+           && topicNodes[n].plus == TOPIC_NONE && topicNodes[n].hash == TOPIC_NONE)
+    {
+        p = topicNodes[n].parent;
+        if (topicNodes[p].plus == n)
+            topicNodes[p].plus = TOPIC_NONE;
+        else if (topicNodes[p].hash == n)
+            topicNodes[p].hash = TOPIC_NONE;
+        else if (topicNodes[p].child == n)
+            topicNodes[p].child = topicNodes[n].next;
+        else
+        {
+            c = topicNodes[p].child;
+            while (topicNodes[c].next != n)
+                c = topicNodes[c].next;
+            topicNodes[c].next = topicNodes[n].next;
+        }
+        topicNodes[n].next = topicFree;
+        topicFree = n;
+        n = p;
+    }
+}
+
+// Wildcards must occupy a whole level, '#' must be the last one and every
+// level must fit a node
+static bool topicValid(char* filter)
+{
+    uint8_t len, i;
+    if (filter[0] == '\0')
+        return false;
+    while (true)
+    {
+        len = topicLevelLength(filter);
+        if (len >= MAX_TOPIC_LEVEL)
+            return false;
+        for (i = 0; len > 1 && i < len; i++)
+        {
+            if (filter[i] == '+' || filter[i] == '#')
+                return false;
+        }
+        if (len == 1 && filter[0] == '#' && filter[1] != '\0')
+            return false;
+        if (filter[len] == '\0')
+            return true;
+        filter += len + 1;
+    }
+}
+
+// Walks the trie along a filter, returns the node of its last level
+// The filter is checked first, so a bad one creates nothing; if the pool runs
+// out halfway, the levels created on the way are given back
+static uint8_t topicFind(char* filter, bool create)
+{
+    uint8_t n = TOPIC_ROOT;
+    uint8_t c, len;
+    if (!topicValid(filter))
+        return TOPIC_NONE;
+    while (true)
+    {
+        len = topicLevelLength(filter);
+        c = topicChild(n, filter, len, create);
+        if (c == TOPIC_NONE)
+        {
+            if (create)
+                topicPrune(n);
+            return TOPIC_NONE;
+        }
+        n = c;
+        if (filter[len] == '\0')
+            return n;
+        filter += len + 1;
+    }
+}
+
+// Node n has matched every level before str; done is set when none are left
+static uint8_t topicMatchNode(uint8_t n, char* str, bool done, uint8_t packet[], char* topic, char* data)
+{
+    uint8_t count = 0;
+    uint8_t len, c;
+    bool wild = !(n == TOPIC_ROOT && str[0] == '$');
+
+    // "#" also matches its parent level, so it fires before checking done
+    c = topicNodes[n].hash;
+    if (c != TOPIC_NONE && wild && topicNodes[c].handler != NULL)
+    {
+        if (packet != NULL)
+            (*topicNodes[c].handler)(packet, topic, data);
+        count++;
+    }
+    if (done)
+    {
+        if (topicNodes[n].handler != NULL)
+        {
+            if (packet != NULL)
+                (*topicNodes[n].handler)(packet, topic, data);
+            count++;
+        }
+        return count;
+    }
+
+    len = topicLevelLength(str);
+    c = topicChild(n, str, len, false);
+    if (c != TOPIC_NONE && !(len == 1 && (str[0] == '+' || str[0] == '#')))
+        count += topicMatchNode(c, str + len + (str[len] == '/'), str[len] == '\0', packet, topic, data);
+    c = topicNodes[n].plus;
+    if (c != TOPIC_NONE && wild)
+        count += topicMatchNode(c, str + len + (str[len] == '/'), str[len] == '\0', packet, topic, data);
+    return count;
+}
+
+void initTopicTrie()
+{
+    uint8_t i;
+    for (i = 0; i < MAX_TOPIC_NODES; i++)
+    {
+        topicNodes[i].level[0] = '\0';
+        topicNodes[i].handler = NULL;
+        topicNodes[i].next = i + 1;
+    }
+    topicNodes[MAX_TOPIC_NODES-1].next = TOPIC_NONE;
+    // node 0 is the root and never freed
+    topicNodes[TOPIC_ROOT].parent = TOPIC_NONE;
+    topicNodes[TOPIC_ROOT].child = TOPIC_NONE;
+    topicNodes[TOPIC_ROOT].next = TOPIC_NONE;
+    topicNodes[TOPIC_ROOT].plus = TOPIC_NONE;
+    topicNodes[TOPIC_ROOT].hash = TOPIC_NONE;
+    topicFree = 1;
+}
+
+// Registers (or replaces) the handler of a topic filter
+// Returns false if the filter is invalid or the node pool is exhausted
+bool topicSubscribe(char* filter, _topicHandler handler)
+{
+    uint8_t n = topicFind(filter, true);
+    if (n == TOPIC_NONE)
+        return false;
+    topicNodes[n].handler = handler;
+    return true;
+}
+
+bool topicUnsubscribe(char* filter)
+{
+    uint8_t n = topicFind(filter, false);
+    if (n == TOPIC_NONE || topicNodes[n].handler == NULL)
+        return false;
+    topicNodes[n].handler = NULL;
+    topicPrune(n);
+    return true;
+}
+
+// Calls the handler of every filter matching the topic
+// Returns the number of handlers called
+uint8_t topicDispatch(uint8_t packet[], char* topic, char* data)
+{
+    if (topic[0] == '\0')
+        return 0;
+    return topicMatchNode(TOPIC_ROOT, topic, false, packet, topic, data);
+}
+
+// Compares a single filter against a topic without using the trie
+bool topicMatches(char* filter, char* topic)
+{
+    uint8_t len;
+    if (topic[0] == '$' && (filter[0] == '+' || filter[0] == '#'))
+        return false;
+    while (true)
+    {
+        if (filter[0] == '#' && filter[1] == '\0')
+            return true;
+        len = topicLevelLength(topic);
+        if (filter[0] == '+' && (filter[1] == '/' || filter[1] == '\0'))
+            filter++;
+        else
+        {
+            if (topicLevelLength(filter) != len)
+                return false;
+            while (len--)
+            {
+                if (*filter++ != *topic)
+                    return false;
+                topic++;
+            }
+            len = 0;
+        }
+        topic += len;
+        if (*filter == '\0' || *topic == '\0')
+            break;
+        filter++;
+        topic++;
+    }
+    // "a/#" also matches "a"
+    if (*filter == '/' && filter[1] == '#' && filter[2] == '\0')
+        return true;
+    return *filter == '\0' && *topic == '\0';
+}
@@ -0,0 +1,38 @@
+// Topic Trie Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef TOPIC_H_
+#define TOPIC_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_TOPIC_NODES      48     // static node pool shared by all filters
+#define MAX_TOPIC_LEVEL      16     // characters per level including '\0'
+#define TOPIC_NONE           0xFF   // null node index
+
+// Called with the received frame so a handler can answer on the same buffer
+typedef void(*_topicHandler)(uint8_t packet[], char* topic, char* data);
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initTopicTrie();
+bool topicSubscribe(char* filter, _topicHandler handler);
+bool topicUnsubscribe(char* filter);
+uint8_t topicDispatch(uint8_t packet[], char* topic, char* data);
+bool topicMatches(char* filter, char* topic);
+
+#endif
@@ -0,0 +1,175 @@
+// Event Trace Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+// The order of things inside the firmware: ISR entries and exits, event
+// posts and handler runs, timer expiries, reconnect state changes, frames
+// and sleeps. TRACE(id, arg) writes an 8-byte record (DWT cycle count, then
+// id and a 24-bit arg) into a ring that overwrites the oldest record. The
+// slot is claimed with LDREX/STREX, so an ISR that interrupts a writer just
+// takes the next slot, and nothing waits or masks interrupts. Records can
+// land a few cycles out of order that way; the converter sorts them. The
+// 32-bit count wraps every 107 s at 40 MHz, so the converter adds up the
+// deltas between records; a gap that long with nothing traced is lost.
+// trace dump writes the ring in hex lines between BEGIN and END markers as
+// the UART0 TX ring has room, with tracing paused, and
+// tools/trace_convert.py turns it into Chrome trace JSON for chrome://tracing
+// or Perfetto, or folded stacks for flamegraph.pl.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "cli.h"
+#include "prof.h"
+#include "Timer.h"
+#include "trace.h"
+#include "uart0.h"
+
+#if TRACE_ENABLE
+
+#define TRACE_LINE          4       // records per hex line
+
+//-----------------------------------------------------------------------------
+// Structures
+//-----------------------------------------------------------------------------
+
+typedef struct _traceRecord
+{
+    uint32_t cycles;
+    uint32_t event;                 // id << 24 | arg
+} traceRecord;
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+traceRecord traceRing[TRACE_RECORDS];
+volatile uint32_t traceHead = 0;    // records written since clear
+volatile bool traceOn = false;
+bool traceDumping = false;
+uint32_t traceDumpNext;             // record the dump writes next
+uint32_t traceDumpEnd;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+// Claims the next record, retried if an interrupt claimed one in between
+static uint32_t traceReserve()
+{
+#if defined(__TI_ARM__)
+    uint32_t index;
+    do
+        index = __ldrex((void*)&traceHead);
+    while (__strex(index + 1, (void*)&traceHead) != 0);
+    return index;
+#else
+    return __atomic_fetch_add(&traceHead, 1, __ATOMIC_RELAXED);
+#endif
+}
+
+void traceWrite(uint8_t id, uint32_t arg)
+{
+    traceRecord* record;
+    uint32_t cycles;
+    if (!traceOn)
+        return;
+    cycles = DWT_CYCCNT_R;
+    record = &traceRing[traceReserve() & (TRACE_RECORDS - 1)];
+    record->cycles = cycles;
+    record->event = ((uint32_t)id << 24) | (arg & 0xFFFFFF);
+}
+
+static void tracePutHex(uint32_t value)
+{
+    static const char hex[] = "0123456789abcdef";
+    int8_t shift;
+    for (shift = 28; shift >= 0; shift -= 4)
+        putcUart0(hex[(value >> shift) & 15]);
+}
+
+// Writes as many lines as the TX ring takes, then comes back later
+static void traceDumpStep(void* context)
+{
+    traceRecord* record;
+    uint8_t n;
+    while (uart0TxSpace() >= TRACE_LINE * 17 + 32)
+    {
+        for (n = 0; n < TRACE_LINE && traceDumpNext != traceDumpEnd; n++)
+        {
+            record = &traceRing[traceDumpNext++ & (TRACE_RECORDS - 1)];
+            if (n > 0)
+                putcUart0(' ');
+            tracePutHex(record->cycles);
+            tracePutHex(record->event);
+        }
+        if (n > 0)
+            putsUart0("\n\r");
+        if (n < TRACE_LINE)
+        {
+            putsUart0("-----END TRACE-----\n\r");
+            traceDumping = false;
+            return;
+        }
+    }
+    startOneshotTimer(traceDumpStep, NULL, TRACE_DUMP_MS);
+}
+
+// trace on|off|clear|dump
+static void traceCommand(USER_DATA* data)
+{
+    char* arg = data->fieldcount >= 2 ? getFieldString(data, 2) : "";
+
+    if (traceDumping)
+        return;
+    if (stringcmp("on", arg))
+        traceOn = true;
+    else if (stringcmp("off", arg))
+        traceOn = false;
+    else if (stringcmp("clear", arg))
+        traceHead = 0;
+    else if (stringcmp("dump", arg))
+    {
+        traceOn = false;
+        traceDumping = true;
+        traceDumpEnd = traceHead;
+        traceDumpNext = traceDumpEnd > TRACE_RECORDS ? traceDumpEnd - TRACE_RECORDS : 0;
+        putsUart0("-----BEGIN TRACE-----\n\rcycles 40000000 records ");
+        putsUart0(itostring(traceDumpEnd));
+        putsUart0("\n\r");
+        traceDumpStep(NULL);
+    }
+    else
+    {
+        putsUart0(traceOn ? "Trace on" : "Trace off");
+        putsUart0(", records ");
+        putsUart0(itostring(traceHead));
+        putsUart0("\n\r");
+    }
+}
+
+// After initCli(), starts the cycle counter and registers the trace command
+void initTrace()
+{
+    CORE_DEMCR_R |= CORE_DEMCR_TRCENA;
+    DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+    cliRegister("trace", 1, traceCommand, "on|off|clear|dump  event timeline");
+}
+
+#else
+
+void initTrace()
+{
+}
+
+#endif
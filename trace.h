@@ -0,0 +1,64 @@
+// Event Trace Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    40 MHz
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef TRACE_H_
+#define TRACE_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// 0 compiles the trace points out, e.g. --define=TRACE_ENABLE=0
+#ifndef TRACE_ENABLE
+#define TRACE_ENABLE        1
+#endif
+
+#define TRACE_RECORDS       256     // power of 2, the oldest is overwritten
+#define TRACE_DUMP_MS       5       // between dump lines while the TX ring is full
+
+// Trace points, the comment tells tools/trace_convert.py how to draw them:
+// begin/end a slice, mark an instant or set a value, on the named track,
+// with the arg looked up as an ISR vector or event type where given
+#define TRACE_ISR_BEGIN     1       // begin isr vector
+#define TRACE_ISR_END       2       // end isr
+#define TRACE_EVENT_POST    3       // mark queue event
+#define TRACE_EVENT_BEGIN   4       // begin main event
+#define TRACE_EVENT_END     5       // end main
+#define TRACE_TIMER         6       // mark timer expired
+#define TRACE_RECONNECT     7       // value reconnect state
+#define TRACE_ETHER_RX      8       // mark ether rx
+#define TRACE_ETHER_TX      9       // mark ether tx
+#define TRACE_SLEEP_BEGIN   10      // begin main sleep
+#define TRACE_SLEEP_END     11      // end main
+
+// ISR args, the exception number
+#define TRACE_VECTOR_SYSTICK 15
+#define TRACE_VECTOR_ETHER  18      // GPIO port C
+#define TRACE_VECTOR_UART0  21
+#define TRACE_VECTOR_ADC0   30
+
+// id and a 24-bit arg, safe from any priority
+#if TRACE_ENABLE
+#define TRACE(id, arg)      traceWrite(id, arg)
+#else
+#define TRACE(id, arg)
+#endif
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initTrace();
+void traceWrite(uint8_t id, uint32_t arg);
+
+#endif
@@ -14,6 +14,19 @@
 //   U0TX (PA1) and U0RX (PA0) are connected to the 2nd controller
 //   The USB on the 2nd controller enumerates to an ICDI interface and a virtual COM port
 
+// Output and input go through ring buffers served by the UART0 interrupt,
+// so neither putsUart0() nor a half typed line holds up the main loop.
+// putcUart0() queues a character and returns; the interrupt refills the TX
+// FIFO when it runs low. Received characters are moved to the RX ring and
+// EVENT_CLI is posted; getsUart0() edits the line as far as the characters
+// received allow and reports when Enter completes it. Each ring has one
+// producer and one consumer. Characters that do not fit are dropped and
+// counted rather than waited for.
+// The binary log borrows the TX FIFO: uart0TxDmaStart() hands it to uDMA
+// channel 9 once the TX ring is empty, so frames never split a line of
+// text. Text queued meanwhile waits in the ring until the uDMA completion
+// interrupt gives the FIFO back.
+
 //-----------------------------------------------------------------------------
 // Device includes, defines, and assembler directives
 //-----------------------------------------------------------------------------
@@ -24,15 +37,33 @@
 #include <ctype.h>
 #include "tm4c123gh6pm.h"
 #include "uart0.h"
+#include "event.h"
+#include "trace.h"
+#include "udma.h"
 
 // PortA masks
 #define UART_TX_MASK 2
 #define UART_RX_MASK 1
 
+#define UART0_TX_DMA_CHANNEL    9
+#define UART0_TX_DMA_CONTROL    (UDMA_CHCTL_DSTINC_NONE | UDMA_CHCTL_DSTSIZE_8 | UDMA_CHCTL_SRCINC_8 \
+                                 | UDMA_CHCTL_SRCSIZE_8 | UDMA_CHCTL_ARBSIZE_4 | UDMA_CHCTL_XFERMODE_BASIC)
+
 //-----------------------------------------------------------------------------
 // Global variables
 //-----------------------------------------------------------------------------
 
+char uart0TxRing[UART0_TX_BUFFER];
+volatile uint16_t uart0TxHead = 0;      // written by putcUart0() only
+volatile uint16_t uart0TxTail = 0;      // written with the TX interrupt masked
+char uart0RxRing[UART0_RX_BUFFER];
+volatile uint16_t uart0RxHead = 0;      // written by the interrupt only
+volatile uint16_t uart0RxTail = 0;      // written by the main loop only
+uint8_t uart0LineCount = 0;             // characters of the line being edited
+uint32_t uart0TxDrops = 0;
+volatile uint32_t uart0RxDrops = 0;
+volatile bool uart0TxDma = false;       // the uDMA owns the TX FIFO
+
 //-----------------------------------------------------------------------------
 // Subroutines
 //-----------------------------------------------------------------------------
@@ -69,6 +100,13 @@ void initUart0()
     UART0_LCRH_R = UART_LCRH_WLEN_8 | UART_LCRH_FEN;    // configure for 8N1 w/ 16-level FIFO
     UART0_CTL_R = UART_CTL_TXE | UART_CTL_RXE | UART_CTL_UARTEN;
                                                         // enable TX, RX, and module
+
+    // Received characters and the receive timeout (one key press left in
+    // the FIFO) interrupt; TX interrupts while the TX ring has data
+    UART0_IFLS_R = UART_IFLS_TX4_8 | UART_IFLS_RX4_8;
+    UART0_ICR_R = UART_ICR_RXIC | UART_ICR_RTIC | UART_ICR_TXIC;
+    UART0_IM_R = UART_IM_RXIM | UART_IM_RTIM;
+    NVIC_EN0_R |= 1 << (INT_UART0-16);
 }
 
 // Set baud rate as function of instruction cycle frequency
@@ -76,18 +114,57 @@ void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc)
 {
     uint32_t divisorTimes128 = (fcyc * 8) / baudRate;   // calculate divisor (r) in units of 1/128,
                                                         // where r = fcyc / 16 * baudRate
+    UART0_CTL_R &= ~UART_CTL_UARTEN;                    // turn-off UART0 to allow safe programming
     UART0_IBRD_R = divisorTimes128 >> 7;                 // set integer value to floor(r)
     UART0_FBRD_R = ((divisorTimes128 + 1)) >> 1 & 63;    // set fractional value to round(fract(r)*64)
+    UART0_LCRH_R = UART0_LCRH_R;                         // the divisors load on a LCRH write
+    UART0_CTL_R |= UART_CTL_UARTEN;
 }
 
-// Blocking function that writes a serial character when the UART buffer is not full
+// Sets up uDMA channel 9 for uart0TxDmaStart(), after initUdma()
+void initUart0TxDma()
+{
+    UDMA_CHMAP1_R &= ~UDMA_CHMAP1_CH9SEL_M;          // channel 9 encoding 0 is UART0 TX
+    UDMA_ALTCLR_R = 1 << UART0_TX_DMA_CHANNEL;
+    UDMA_USEBURSTCLR_R = 1 << UART0_TX_DMA_CHANNEL;
+    UDMA_REQMASKCLR_R = 1 << UART0_TX_DMA_CHANNEL;
+}
+
+// Moves the TX ring into the FIFO while it has room
+// Called by the interrupt, or with the TX interrupt masked
+static void uart0TxFill()
+{
+    uint16_t tail = uart0TxTail;
+    while (tail != uart0TxHead && !(UART0_FR_R & UART_FR_TXFF))
+        UART0_DR_R = uart0TxRing[tail++ & (UART0_TX_BUFFER - 1)];
+    uart0TxTail = tail;
+}
+
+// Queues a character for transmission, dropped if the TX ring is full
 void putcUart0(char c)
 {
-    while (UART0_FR_R & UART_FR_TXFF);               // wait if uart0 tx fifo full
-    UART0_DR_R = c;                                  // write character to fifo
+    uint16_t head = uart0TxHead;
+    if ((uint16_t)(head - uart0TxTail) >= UART0_TX_BUFFER)
+    {
+        uart0TxDrops++;
+        return;
+    }
+    uart0TxRing[head & (UART0_TX_BUFFER - 1)] = c;
+    uart0TxHead = head + 1;
+
+    // sent after the uDMA transfer, by the completion interrupt
+    if (uart0TxDma)
+        return;
+
+    // a FIFO filled past its level interrupts when it drains below it; a
+    // nearly empty one may never cross it, so top it up here
+    UART0_IM_R &= ~UART_IM_TXIM;
+    uart0TxFill();
+    if (uart0TxTail != uart0TxHead)
+        UART0_IM_R |= UART_IM_TXIM;
 }
 
-// Blocking function that writes a string when the UART buffer is not full
+// Queues a string for transmission
 void putsUart0(char* str)
 {
     uint8_t i = 0;
@@ -95,17 +172,108 @@ void putsUart0(char* str)
         putcUart0(str[i++]);
 }
 
-// Blocking function that returns with serial data once the buffer is not empty
+// Blocking function that returns with serial data once the RX ring is not empty
 char getcUart0()
 {
-    while (UART0_FR_R & UART_FR_RXFE);               // wait if uart0 rx fifo empty
-    return UART0_DR_R & 0xFF;                        // get character from fifo
+    char c;
+    while (uart0RxTail == uart0RxHead);
+    c = uart0RxRing[uart0RxTail & (UART0_RX_BUFFER - 1)];
+    uart0RxTail++;
+    return c;
 }
 
-// Returns the status of the receive buffer
+// Returns true if a received character is waiting
 bool kbhitUart0()
 {
-    return !(UART0_FR_R & UART_FR_RXFE);
+    return uart0RxTail != uart0RxHead;
+}
+
+void uart0Isr()
+{
+    uint16_t head = uart0RxHead;
+    uint32_t status = UART0_MIS_R;
+    TRACE(TRACE_ISR_BEGIN, TRACE_VECTOR_UART0);
+    UART0_ICR_R = status;
+
+    while (!(UART0_FR_R & UART_FR_RXFE))
+    {
+        if ((uint16_t)(head - uart0RxTail) < UART0_RX_BUFFER)
+            uart0RxRing[head++ & (UART0_RX_BUFFER - 1)] = UART0_DR_R & 0xFF;
+        else
+        {
+            UART0_DR_R;                                 // discard
+            uart0RxDrops++;
+        }
+    }
+    if (head != uart0RxHead)
+    {
+        uart0RxHead = head;
+        eventPostFromIsr(EVENT_CLI, 0);
+    }
+
+    // the uDMA completion interrupt comes on this vector
+    if (uart0TxDma && (UDMA_CHIS_R & (1 << UART0_TX_DMA_CHANNEL)))
+    {
+        UDMA_CHIS_R = 1 << UART0_TX_DMA_CHANNEL;
+        UART0_DMACTL_R &= ~UART_DMACTL_TXDMAE;
+        uart0TxDma = false;
+        UART0_IM_R |= UART_IM_TXIM;
+    }
+
+    // putcUart0() masks TXIM while it fills the FIFO itself
+    if (UART0_IM_R & UART_IM_TXIM)
+    {
+        uart0TxFill();
+        if (uart0TxTail == uart0TxHead)
+            UART0_IM_R &= ~UART_IM_TXIM;
+    }
+    TRACE(TRACE_ISR_END, 0);
+}
+
+// Returns true if uart0TxDmaStart() would start now
+bool uart0TxDmaReady()
+{
+    return !uart0TxDma && uart0TxTail == uart0TxHead;
+}
+
+// Sends size bytes by uDMA, buffer must not change until uart0TxDmaReady()
+// Returns false while text or another transfer is waiting
+bool uart0TxDmaStart(uint8_t buffer[], uint16_t size)
+{
+    udmaControl* entry = udmaPrimary(UART0_TX_DMA_CHANNEL);
+    if (!uart0TxDmaReady() || size == 0 || size > 1024)
+        return false;
+    UART0_IM_R &= ~UART_IM_TXIM;
+    uart0TxDma = true;
+    entry->srcEnd = &buffer[size - 1];
+    entry->dstEnd = &UART0_DR_R;
+    entry->control = UART0_TX_DMA_CONTROL | ((size - 1) << UDMA_CHCTL_XFERSIZE_S);
+    UDMA_ENASET_R = 1 << UART0_TX_DMA_CHANNEL;
+    UART0_DMACTL_R |= UART_DMACTL_TXDMAE;
+    return true;
+}
+
+// Waits until everything queued has left the UART, before a baud change
+void uart0Flush()
+{
+    while (uart0TxDma || uart0TxTail != uart0TxHead || (UART0_FR_R & UART_FR_BUSY));
+}
+
+// Returns how many characters putcUart0() can queue without dropping
+uint16_t uart0TxSpace()
+{
+    return UART0_TX_BUFFER - (uint16_t)(uart0TxHead - uart0TxTail);
+}
+
+// Characters lost to a full ring
+uint32_t uart0TxDropped()
+{
+    return uart0TxDrops;
+}
+
+uint32_t uart0RxDropped()
+{
+    return uart0RxDrops;
 }
 
 
@@ -154,45 +322,41 @@ bool stringcmp (const char str1[],char str2[])
         return false;
 }
 
-void getsUart0(USER_DATA* data)
+// Edits the line in data with the characters received so far
+// Returns true once Enter (or MAX_CHARS) completes it, the next call
+// starts a new line
+bool getsUart0(USER_DATA* data)
 {
-    uint8_t count = 0;
     char c;
-    while(count<MAX_CHARS)
+    while (kbhitUart0())
     {
-       c = getcUart0();
-       if(c == 0x08 || c == 0x7F)
-       {
-           if (count>0)
-           {
-               count--;
-               continue;
-           }
-           else
-           {
-               continue;
-           }
-       }
-       else if(c == 0x0D || c == 0x0A)
-       {
-           data->buffer[count] = '\0';
-           break;
-       }
-       else if(c >= 0x20)
-       {
-           data->buffer[count++] = tolower(c);
-           if(count == MAX_CHARS)
-           {
-               data->buffer[count] = '\0';
-               break;
-           }
-           else
-           {
-               continue;
-           }
-       }
+        c = getcUart0();
+        if (c == 0x08 || c == 0x7F)
+        {
+            if (uart0LineCount > 0)
+                uart0LineCount--;
+        }
+        else if (c == 0x0D || c == 0x0A)
+        {
+            // CR LF is one Enter, an empty line is not a command
+            if (uart0LineCount == 0)
+                continue;
+            data->buffer[uart0LineCount] = '\0';
+            uart0LineCount = 0;
+            return true;
+        }
+        else if (c >= 0x20)
+        {
+            data->buffer[uart0LineCount++] = tolower(c);
+            if (uart0LineCount == MAX_CHARS)
+            {
+                data->buffer[uart0LineCount] = '\0';
+                uart0LineCount = 0;
+                return true;
+            }
+        }
     }
-
+    return false;
 }
 
 void parseFields(USER_DATA* data)
@@ -1,59 +1,70 @@
-// UART0 Library
-// Jason Losh
-
-//-----------------------------------------------------------------------------
-// Hardware Target
-//-----------------------------------------------------------------------------
-
-// Target Platform: EK-TM4C123GXL
-// Target uC:       TM4C123GH6PM
-// System Clock:    -
-
-// Hardware configuration:
-// UART Interface:
-//   U0TX (PA1) and U0RX (PA0) are connected to the 2nd controller
-//   The USB on the 2nd controller enumerates to an ICDI interface and a virtual COM port
-
-//-----------------------------------------------------------------------------
-// Device includes, defines, and assembler directives
-//-----------------------------------------------------------------------------
-
-#ifndef UART0_H_
-#define UART0_H_
-
-#include <stdint.h>
-
-#define MAX_CHARS        80
-#define MAX_FIELD        5
-
-typedef struct
-{
-    char buffer[MAX_CHARS + 1];
-    uint8_t fieldcount;
-    uint8_t fieldPosition[MAX_FIELD];
-    char fieldType[MAX_FIELD];
-}USER_DATA;
-
-//-----------------------------------------------------------------------------
-// Subroutines
-//-----------------------------------------------------------------------------
-
-void initUart0();
-void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc);
-void putcUart0(char c);
-void putsUart0(char* str);
-char getcUart0();
-bool kbhitUart0();
-//bool strcmp (const char str1[],char str2[]);
-void getsUart0(USER_DATA* data);
-void parseFields(USER_DATA* data);
-char* getFieldString(USER_DATA* data, uint8_t fieldNumber);
-int32_t getFieldInteger(USER_DATA* data, uint8_t fieldNumber);
-bool isCommand(USER_DATA* data, const char strCommand[], uint8_t minArguments);
-bool stringcmp (const char str1[],char str2[]);
-char* itostring(int n);
-
-
-
-
-#endif
+// UART0 Library
+// Jason Losh
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Hardware configuration:
+// UART Interface:
+//   U0TX (PA1) and U0RX (PA0) are connected to the 2nd controller
+//   The USB on the 2nd controller enumerates to an ICDI interface and a virtual COM port
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef UART0_H_
+#define UART0_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define MAX_CHARS        80
+#define MAX_FIELD        10
+#define UART0_TX_BUFFER  1024    // power of 2
+#define UART0_RX_BUFFER  128     // power of 2
+
+typedef struct
+{
+    char buffer[MAX_CHARS + 1];
+    uint8_t fieldcount;
+    uint8_t fieldPosition[MAX_FIELD];
+    char fieldType[MAX_FIELD];
+}USER_DATA;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initUart0();
+void setUart0BaudRate(uint32_t baudRate, uint32_t fcyc);
+void putcUart0(char c);
+void putsUart0(char* str);
+char getcUart0();
+bool kbhitUart0();
+void uart0Isr();
+uint32_t uart0TxDropped();
+uint32_t uart0RxDropped();
+uint16_t uart0TxSpace();
+void initUart0TxDma();
+bool uart0TxDmaReady();
+bool uart0TxDmaStart(uint8_t buffer[], uint16_t size);
+void uart0Flush();
+//bool strcmp (const char str1[],char str2[]);
+bool getsUart0(USER_DATA* data);
+void parseFields(USER_DATA* data);
+char* getFieldString(USER_DATA* data, uint8_t fieldNumber);
+int32_t getFieldInteger(USER_DATA* data, uint8_t fieldNumber);
+bool isCommand(USER_DATA* data, const char strCommand[], uint8_t minArguments);
+bool stringcmp (const char str1[],char str2[]);
+char* itostring(int n);
+
+
+
+
+#endif
@@ -0,0 +1,61 @@
+// uDMA Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Hardware configuration:
+// uDMA controller
+
+// Owns the channel control table shared by every uDMA user. Drivers fill in
+// the primary/alternate structures of their own channel and then enable it.
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#include <stdint.h>
+#include <stdbool.h>
+#include "tm4c123gh6pm.h"
+#include "udma.h"
+
+//-----------------------------------------------------------------------------
+// Global variables
+//-----------------------------------------------------------------------------
+
+// Primary structures 0-31 followed by alternate structures 0-31,
+// the controller requires the table on a 1024 byte boundary
+#pragma DATA_ALIGN(udmaTable, 1024)
+udmaControl udmaTable[2 * UDMA_CHANNELS];
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initUdma()
+{
+    SYSCTL_RCGCDMA_R |= SYSCTL_RCGCDMA_R0;
+    _delay_cycles(3);
+    UDMA_CFG_R = UDMA_CFG_MASTEN;                    // enable controller
+    UDMA_CTLBASE_R = (uint32_t)udmaTable;
+}
+
+udmaControl* udmaPrimary(uint8_t channel)
+{
+    return &udmaTable[channel];
+}
+
+udmaControl* udmaAlternate(uint8_t channel)
+{
+    return &udmaTable[UDMA_CHANNELS + channel];
+}
+
+// A structure is stopped once its transfer completed
+bool udmaIsStopped(udmaControl* entry)
+{
+    return (entry->control & UDMA_CHCTL_XFERMODE_M) == UDMA_CHCTL_XFERMODE_STOP;
+}
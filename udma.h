@@ -0,0 +1,44 @@
+// uDMA Library
+
+//-----------------------------------------------------------------------------
+// Hardware Target
+//-----------------------------------------------------------------------------
+
+// Target Platform: EK-TM4C123GXL
+// Target uC:       TM4C123GH6PM
+// System Clock:    -
+
+// Hardware configuration:
+// uDMA controller
+
+//-----------------------------------------------------------------------------
+// Device includes, defines, and assembler directives
+//-----------------------------------------------------------------------------
+
+#ifndef UDMA_H_
+#define UDMA_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#define UDMA_CHANNELS       32
+
+// Channel control structure as laid out in the control table
+typedef struct _udmaControl
+{
+    volatile void* srcEnd;          // last source address
+    volatile void* dstEnd;          // last destination address
+    volatile uint32_t control;      // DMACHCTL word
+    uint32_t spare;
+} udmaControl;
+
+//-----------------------------------------------------------------------------
+// Subroutines
+//-----------------------------------------------------------------------------
+
+void initUdma();
+udmaControl* udmaPrimary(uint8_t channel);
+udmaControl* udmaAlternate(uint8_t channel);
+bool udmaIsStopped(udmaControl* entry);
+
+#endif